@@ -0,0 +1,441 @@
+#pragma once
+#include <array>
+#include <tuple>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <algorithm>
+#include <concepts>
+#include "gpcc/gpcc.h"
+
+using namespace std;
+
+// Models fixed at compile time. A block chain is written as an expression over block constants,
+//
+//     auto model = dsl::Storage<"rab1", 2> >> dsl::Generate<dsl::Exp<0.5>> >> dsl::Queue<"q"> >> dsl::Enter<"rab1">
+//                  >> dsl::Depart<"q"> >> dsl::Advance<dsl::Uniform<1.0, 3.0>> >> dsl::Leave<"rab1"> >> dsl::Terminate;
+//     dsl::Engine<decltype(model)> engine(1000);
+//     engine.launch();
+//
+// and dsl::Engine turns its type into an event loop with the blocks inlined: no virtual calls, no std::function,
+// queues, storages and generators are plain members, entities and labels are resolved by the compiler.
+// Blocks behave as their counterparts in gpcc.h, draws come from the same engines (distributions take a seed like
+// RandomGenerator(minstd_rand(seed), ...)), and events are ordered the same way, so an engine prints the same report
+// as the model built by SimBuilder with set_graph_optimization(false). Differences:
+// - Label<"x"> names the block after it (SimBuilder::add_label names the one before);
+// - Storage and Table are declarations and may stand anywhere in the chain;
+// - only the blocks below are supported, and there is no RESET, warm-up detection or stopping rule
+namespace dsl {
+
+// string literal as a template argument: Queue<"q">
+template <size_t N>
+struct Name {
+    char text[N];
+    constexpr Name(const char (&literal)[N]) { copy_n(literal, N, text); }
+    constexpr string_view view() const { return string_view(text, N - 1); }
+};
+
+// distributions: types used as GENERATE and ADVANCE times
+template <double Rate, unsigned Seed = 1>
+struct Exp {
+    stream_engine engine = stream_engine(minstd_rand(Seed));
+    exponential_distribution<> dist = exponential_distribution<>(Rate);
+    double operator()() { return dist(engine); }
+};
+
+template <double Low, double High, unsigned Seed = 1>
+struct Uniform {
+    stream_engine engine = stream_engine(minstd_rand(Seed));
+    uniform_real_distribution<> dist = uniform_real_distribution<>(Low, High);
+    double operator()() { return dist(engine); }
+};
+
+template <double Value>
+struct Const {
+    double operator()() { return Value; }
+};
+
+enum kind_t: int {STORAGE, TABLE, GENERATE, QUEUE, DEPART, ENTER, LEAVE, ADVANCE, MARK, TABULATE, LABEL, TRANSFER, TRANSFER_PROB, TERMINATE};
+
+struct Item { // base of blocks and declarations
+    struct None {};
+    using state_t = None;       // per-block state kept by the engine
+    static constexpr string_view name = ""; // entity or label
+};
+
+template <typename Interval, unsigned long Priority>
+struct GenerateItem: Item {
+    static constexpr kind_t kind = GENERATE;
+    static constexpr unsigned long priority = Priority;
+    using state_t = Interval;
+};
+
+template <Name Q, kind_t Kind>
+struct EntityItem: Item {
+    static constexpr kind_t kind = Kind;
+    static constexpr string_view name = Q.view();
+};
+
+template <Name S, size_t Capacity>
+struct StorageItem: EntityItem<S, STORAGE> {
+    static constexpr size_t capacity = Capacity;
+};
+
+template <Name T, Histogram::scale_t Scale, double Low, double Step, size_t Count>
+struct TableItem: EntityItem<T, TABLE> {
+    static Histogram layout() { return Histogram(Scale, Low, Step, Count); }
+};
+
+template <typename Delay>
+struct AdvanceItem: Item {
+    static constexpr kind_t kind = ADVANCE;
+    using state_t = Delay;
+};
+
+template <Name L, double Prob, int Seed>
+struct TransferProbItem: EntityItem<L, TRANSFER_PROB> {
+    static constexpr double prob = Prob;
+    struct state_t {
+        mt19937 gen = Seed ? mt19937(Seed) : mt19937();
+    };
+};
+
+struct MarkItem: Item { static constexpr kind_t kind = MARK; };
+struct TerminateItem: Item { static constexpr kind_t kind = TERMINATE; };
+
+template <typename Interval, unsigned long Priority = 0> constexpr GenerateItem<Interval, Priority> Generate{};
+template <Name Q> constexpr EntityItem<Q, QUEUE> Queue{};
+template <Name Q> constexpr EntityItem<Q, DEPART> Depart{};
+template <Name S> constexpr EntityItem<S, ENTER> Enter{};
+template <Name S> constexpr EntityItem<S, LEAVE> Leave{};
+template <typename Delay> constexpr AdvanceItem<Delay> Advance{};
+constexpr MarkItem Mark{};
+template <Name T> constexpr EntityItem<T, TABULATE> Tabulate{}; // M1
+template <Name L> constexpr EntityItem<L, LABEL> Label{};
+template <Name L> constexpr EntityItem<L, TRANSFER> Transfer{};
+template <Name L, double Prob, int Seed = 1> constexpr TransferProbItem<L, Prob, Seed> TransferProb{}; // to L with probability Prob
+constexpr TerminateItem Terminate{};
+template <Name S, size_t Capacity> constexpr StorageItem<S, Capacity> Storage{};
+template <Name T, Histogram::scale_t Scale, double Low, double Step, size_t Count = 0> constexpr TableItem<T, Scale, Low, Step, Count> Table{};
+
+template <typename... Items>
+struct Chain {};
+
+template <derived_from<Item> A, derived_from<Item> B>
+constexpr Chain<A, B> operator>>(A, B) { return {}; }
+
+template <typename... Items, derived_from<Item> B>
+constexpr Chain<Items..., B> operator>>(Chain<Items...>, B) { return {}; }
+
+template <typename Model>
+class Engine;
+
+template <typename... Items>
+class Engine<Chain<Items...>> {
+private:
+    using priority_t = unsigned long;
+    using items = tuple<Items...>;
+    static constexpr size_t n = sizeof...(Items);
+    static constexpr size_t npos = -1;
+
+    // compile-time view of the chain
+    static constexpr array<kind_t, n> kinds = {Items::kind...};
+    static constexpr array<string_view, n> names = {Items::name...};
+
+    struct Entities {
+        array<string_view, n> names{};
+        size_t count = 0;
+
+        constexpr size_t find(string_view name) const {
+            for (size_t i = 0; i < count; ++i) if (names[i] == name) return i;
+            return npos;
+        }
+    };
+
+    // distinct names of items of a kind, in the order of their first appearance
+    static consteval Entities collect(kind_t kind) {
+        Entities list;
+        for (size_t i = 0; i < n; ++i) if (kinds[i] == kind && list.find(names[i]) == npos) list.names[list.count++] = names[i];
+        return list;
+    }
+
+    static constexpr Entities queue_names = collect(QUEUE);
+    static constexpr Entities storage_names = collect(STORAGE);
+    static constexpr Entities table_names = collect(TABLE);
+    static constexpr size_t queues_n = queue_names.count, storages_n = storage_names.count, tables_n = table_names.count;
+
+    static consteval size_t label(string_view name) {
+        size_t at = npos;
+        for (size_t i = 0; i < n; ++i) if (kinds[i] == LABEL && names[i] == name) {
+            if (at != npos) return npos - 1; // declared twice
+            at = i;
+        }
+        return at;
+    }
+
+    static consteval array<size_t, storages_n> capacities() {
+        array<size_t, storages_n> result{};
+        size_t k = 0;
+        ((Items::kind == STORAGE ? void(result[k++] = capacity_of<Items>()) : void()), ...);
+        return result;
+    }
+    template <typename T>
+    static consteval size_t capacity_of() {
+        if constexpr (requires { T::capacity; }) return T::capacity;
+        else return 0;
+    }
+    static constexpr array<size_t, storages_n> capacity = capacities();
+
+    struct Transaction {
+        priority_t priority;
+        uint64_t id;
+        bool just_generated;
+        double mark = 0;
+    };
+    struct Resume {
+        Transaction transaction;
+        size_t position;
+    };
+    struct Event {
+        double time;
+        Resume resume;
+
+        // as Simulation::TimedSpawn: earlier first, then higher priority
+        bool operator<(const Event& rhs) const {
+            return time > rhs.time ? true : time < rhs.time ? false : resume.transaction.priority < rhs.resume.transaction.priority;
+        }
+    };
+    struct StorageState {
+        size_t current = 0;
+        WaitChain<Resume, priority_t> chain;
+    };
+    struct Stat { // as Simulation::Stat
+        size_t max = 0;
+        double m = 0;
+        double empty = 0;
+        double full = 0;
+        BatchMeans m_bm, empty_bm, full_bm;
+        Histogram length;
+    };
+
+    double g_time = 0;
+    double end_time;
+    double confidence = 0.95;
+    double stat_start = 0;
+    uint64_t transaction_id = 0;
+    uint64_t events = 0;
+    array<size_t, queues_n> queue{};
+    array<StorageState, storages_n> storage;
+    array<Histogram, tables_n> table;
+    array<Stat, queues_n> q_stat;
+    array<Stat, storages_n> storage_stat;
+    tuple<typename Items::state_t...> state;
+    priority_queue<Event> schedule;
+    std::queue<Resume> immediate; // transactions let into a storage, served before the next event
+
+    // the transaction passes the block at I and everything after it that it reaches within this event
+    template <size_t I>
+    void run(Transaction& transaction) {
+        if constexpr (I == n) return; // fell out of the chain
+        else {
+            using B = tuple_element_t<I, items>;
+            constexpr kind_t kind = B::kind;
+            if constexpr (kind == STORAGE || kind == TABLE || kind == LABEL) run<I + 1>(transaction);
+            else if constexpr (kind == GENERATE) {
+                if (transaction.just_generated) {
+                    Transaction next{B::priority, transaction_id++, true};
+                    double time = get<I>(state)();
+                    if (time < 0) throw SimulationException("negative time between arrivals");
+                    schedule.push(Event{g_time + time, Resume{next, I}});
+                    transaction.just_generated = false;
+                    transaction.mark = g_time;
+                }
+                run<I + 1>(transaction);
+            }
+            else if constexpr (kind == QUEUE) {
+                ++queue[queue_names.find(B::name)];
+                run<I + 1>(transaction);
+            }
+            else if constexpr (kind == DEPART) {
+                constexpr size_t q = queue_names.find(B::name);
+                static_assert(q != npos, "DEPART from a queue no QUEUE block uses");
+                if (queue[q] == 0) throw SimulationException("Attempted to leave empty queue");
+                --queue[q];
+                run<I + 1>(transaction);
+            }
+            else if constexpr (kind == ENTER) {
+                constexpr size_t s = storage_names.find(B::name);
+                static_assert(s != npos, "ENTER of an undeclared storage");
+                if (storage[s].current < capacity[s]) {
+                    ++storage[s].current;
+                    run<I + 1>(transaction);
+                }
+                else storage[s].chain.push(transaction.priority, Resume{transaction, I + 1}, g_time);
+            }
+            else if constexpr (kind == LEAVE) {
+                constexpr size_t s = storage_names.find(B::name);
+                static_assert(s != npos, "LEAVE of an undeclared storage");
+                if (storage[s].current == 0) throw SimulationException("Attempted to leave empty storage");
+                if (!storage[s].chain.empty()) immediate.push(storage[s].chain.pop(g_time)); // the place is handed over
+                else --storage[s].current;
+                run<I + 1>(transaction);
+            }
+            else if constexpr (kind == ADVANCE) {
+                double time = get<I>(state)();
+                if (time < 0) throw SimulationException("negative ADVANCE time");
+                schedule.push(Event{g_time + time, Resume{transaction, I + 1}});
+            }
+            else if constexpr (kind == MARK) {
+                transaction.mark = g_time;
+                run<I + 1>(transaction);
+            }
+            else if constexpr (kind == TABULATE) {
+                constexpr size_t t = table_names.find(B::name);
+                static_assert(t != npos, "TABULATE to an undeclared table");
+                table[t].add(g_time - transaction.mark);
+                run<I + 1>(transaction);
+            }
+            else if constexpr (kind == TRANSFER) {
+                constexpr size_t to = label(B::name);
+                static_assert(to < n, "TRANSFER to an undefined or twice defined label");
+                run<to>(transaction);
+            }
+            else if constexpr (kind == TRANSFER_PROB) {
+                constexpr size_t to = label(B::name);
+                static_assert(to < n, "TRANSFER to an undefined or twice defined label");
+                if (uniform_real_distribution<>()(get<I>(state).gen) < B::prob) run<to>(transaction);
+                else run<I + 1>(transaction);
+            }
+            // TERMINATE: the transaction dies
+        }
+    }
+
+    // entry points of events by position: one indirect call per event, the chain itself is inlined
+    template <size_t... Is>
+    static constexpr array<void (Engine::*)(Transaction&), n + 1> entries(index_sequence<Is...>) { return {&Engine::run<Is>...}; }
+    static constexpr array<void (Engine::*)(Transaction&), n + 1> entry = entries(make_index_sequence<n + 1>());
+
+    void record(Stat& stat, size_t value, bool empty, bool full, double delta) { // as Simulation::save_stat
+        stat.max = max(stat.max, value);
+        stat.m += value * delta;
+        if (empty) stat.empty += delta;
+        else if (full) stat.full += delta;
+        stat.m_bm.add(value, delta);
+        stat.empty_bm.add(empty, delta);
+        stat.full_bm.add(!empty && full, delta);
+        if (delta > 0) stat.length.add(value, delta);
+    }
+
+    void advance_clock(double time) {
+        double delta = time - g_time;
+        for (size_t i = 0; i < queues_n; ++i) record(q_stat[i], queue[i], queue[i] == 0, false, delta);
+        for (size_t i = 0; i < storages_n; ++i) record(storage_stat[i], storage[i].current, storage[i].current == 0, storage[i].current == capacity[i], delta);
+        g_time = time;
+    }
+
+    void serve_next() {
+        advance_clock(schedule.top().time);
+        Event event = schedule.top();
+        schedule.pop();
+        ++events;
+        (this->*entry[event.resume.position])(event.resume.transaction);
+        while (!immediate.empty()) {
+            Resume resume = immediate.front();
+            immediate.pop();
+            (this->*entry[resume.position])(resume.transaction);
+        }
+    }
+
+    void process(double until) {
+        while (!schedule.empty() && schedule.top().time < until) serve_next();
+    }
+
+    template <size_t... Is>
+    void start(index_sequence<Is...>) { // first arrivals, in the order of the GENERATE blocks
+        ([&] {
+            if constexpr (kinds[Is] == GENERATE) {
+                double time = get<Is>(state)();
+                if (time < 0) throw SimulationException("negative time between arrivals");
+                schedule.push(Event{time, Resume{Transaction{tuple_element_t<Is, items>::priority, transaction_id++, true}, Is}});
+            }
+        }(), ...);
+    }
+
+    template <size_t... Is>
+    void make_tables(index_sequence<Is...>) {
+        size_t k = 0;
+        ([&] { if constexpr (kinds[Is] == TABLE) table[k++] = tuple_element_t<Is, items>::layout(); }(), ...);
+    }
+
+    static Simulation::ChainStats chain_stats(const WaitChain<Resume, priority_t>& chain, double now) {
+        return Simulation::ChainStats{chain.size(), chain.get_max(), chain.get_mean_length(now), chain.get_entries(), chain.get_mean_wait()};
+    }
+
+public:
+    Engine(double end_time): end_time(end_time) {
+        make_tables(make_index_sequence<n>());
+        start(make_index_sequence<n>());
+        double batch_length = end_time / 1024;
+        for (auto& stat : q_stat) stat.m_bm = stat.empty_bm = stat.full_bm = BatchMeans(batch_length);
+        for (auto& stat : storage_stat) stat.m_bm = stat.empty_bm = stat.full_bm = BatchMeans(batch_length);
+    }
+
+    double get_time() const { return g_time; }
+    uint64_t get_events() const { return events; }
+
+    void run_until(double time) { // serves every event up to time (inclusive), then moves the clock to time
+        if (time < g_time) throw SimulationException("run_until: time is in the past");
+        process(nextafter(time, numeric_limits<double>::infinity()));
+        advance_clock(time);
+    }
+
+    Simulation::QStats get_q_stats(size_t index) const {
+        const Stat& stat = q_stat[index];
+        double elapsed = g_time - stat_start;
+        if (elapsed <= 0) elapsed = numeric_limits<double>::infinity();
+        return Simulation::QStats{
+            queue[index], stat.max,
+            stat.m / elapsed, stat.m_bm.half_width(confidence),
+            stat.empty / elapsed, stat.empty_bm.half_width(confidence)
+        };
+    }
+
+    Simulation::StorageStats get_storage_stats(size_t index) const {
+        const Stat& stat = storage_stat[index];
+        double elapsed = g_time - stat_start;
+        if (elapsed <= 0) elapsed = numeric_limits<double>::infinity();
+        return Simulation::StorageStats{
+            capacity[index], storage[index].current, stat.max,
+            stat.m / elapsed, stat.m_bm.half_width(confidence),
+            stat.m / elapsed / capacity[index],
+            stat.empty / elapsed, stat.empty_bm.half_width(confidence),
+            stat.full / elapsed, stat.full_bm.half_width(confidence)
+        };
+    }
+
+    const Histogram& get_table(size_t index) const { return table[index]; }
+
+    void report() const {
+        Simulation::Report report;
+        report.time = g_time;
+        report.stat_start = stat_start;
+        report.confidence = confidence;
+        for (size_t i = 0; i < queues_n; ++i) report.queues.push_back({string(queue_names.names[i]), get_q_stats(i), &q_stat[i].length});
+        for (size_t i = 0; i < storages_n; ++i)
+            report.storages.push_back({string(storage_names.names[i]), get_storage_stats(i), &storage_stat[i].length, chain_stats(storage[i].chain, g_time)});
+        for (size_t i = 0; i < tables_n; ++i) report.tables.push_back({string(table_names.names[i]), &table[i]});
+        Simulation::print_report(report);
+    }
+
+    void launch() { // runs until end_time and prints the report
+        process(end_time);
+        advance_clock(end_time);
+        report();
+    }
+};
+
+}
@@ -0,0 +1,86 @@
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include "experiment.h"
+
+using namespace std;
+
+static double mean(const vector<double>& sample) {
+    double sum = 0;
+    for (double x : sample) sum += x;
+    return sum / sample.size();
+}
+
+static double variance(const vector<double>& sample) {
+    double m = mean(sample), s2 = 0;
+    for (double x : sample) s2 += (x - m) * (x - m);
+    return s2 / (sample.size() - 1);
+}
+
+Experiment::Experiment(double end_time, size_t replications): end_time(end_time), replications(replications) {
+    if (replications < 2) throw invalid_argument("an experiment needs at least 2 replications");
+}
+
+Experiment& Experiment::set_confidence(double level) {
+    if (level <= 0 || level >= 1) throw invalid_argument("confidence level must be in (0; 1)");
+    confidence = level;
+
+    return *this;
+}
+
+Experiment& Experiment::set_seed(uint64_t seed) {
+    this->seed = seed;
+
+    return *this;
+}
+
+double Experiment::run(const SimBuilder::recipe_t& recipe, const metric_t& metric, uint64_t replication, bool antithetic) {
+    SimBuilder builder(end_time);
+    builder.set_streams(seed + replication, antithetic);
+    recipe(builder);
+    auto sim = builder.build();
+    sim->run_until(end_time);
+    return metric(*sim);
+}
+
+Experiment::Estimate Experiment::estimate(const vector<double>& sample, double variance_ratio) {
+    size_t n = sample.size();
+    double hw = t_quantile((1 + confidence) / 2, n - 1) * sqrt(variance(sample) / n);
+    return Estimate{n, mean(sample), hw, variance_ratio};
+}
+
+Experiment::Estimate Experiment::antithetic(const SimBuilder::recipe_t& recipe, const metric_t& metric) {
+    vector<double> runs, pairs;
+    for (size_t r = 0; r < replications; ++r) {
+        double x = run(recipe, metric, r, false), y = run(recipe, metric, r, true);
+        runs.push_back(x);
+        runs.push_back(y);
+        pairs.push_back((x + y) / 2);
+    }
+    // Var(mean of 2n independent runs) = Var X / 2n; Var(mean of n pairs) = Var pair / n
+    double with = variance(pairs);
+    double ratio = with > 0 ? variance(runs) / (2 * with) : numeric_limits<double>::infinity();
+    return estimate(pairs, ratio);
+}
+
+Experiment::Estimate Experiment::compare(const SimBuilder::recipe_t& a, const SimBuilder::recipe_t& b, const metric_t& metric) {
+    vector<double> xa, xb, diff;
+    for (size_t r = 0; r < replications; ++r) {
+        xa.push_back(run(a, metric, r, false));
+        xb.push_back(run(b, metric, r, false));
+        diff.push_back(xa.back() - xb.back());
+    }
+    // independent streams: Var(A - B) = Var A + Var B, the covariance is what CRN adds
+    double with = variance(diff);
+    double ratio = with > 0 ? (variance(xa) + variance(xb)) / with : numeric_limits<double>::infinity();
+    return estimate(diff, ratio);
+}
+
+void Experiment::report(const string& title, const Estimate& estimate) {
+    cout << fixed << showpoint << setprecision(4);
+    cout << title << " (" << estimate.replications << " replications):\n";
+    cout << "\tmean\t\t±\t\tVariance reduction\n";
+    cout << "\t" << estimate.mean << "\t\t" << estimate.half_width << "\t\t" << setprecision(2) << estimate.variance_ratio << "x\n";
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include "gpcc/gpcc.h"
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+// Independent replications of a model given as a recipe, with variance reduction.
+// Every replication is built with SimBuilder::set_streams, so random blocks draw from named streams:
+// - compare() runs two alternatives on common random numbers (replication r of both sees the same streams);
+// - antithetic() runs pairs of replications, the second one on 1 - U.
+// The variance reduction is estimated from the same runs: for CRN it is (Var A + Var B) / Var(A - B),
+// for antithetic pairs it is the variance of a mean of 2n independent runs over the variance of the mean of n pairs
+class Experiment {
+public:
+    using metric_t = function<double(Simulation&)>; // read after the run, e.g. [](Simulation& s) { return s.get_q_stats(0).m; }
+
+    struct Estimate {
+        size_t replications;   // pairs for antithetic(), runs of every alternative for compare()
+        double mean;
+        double half_width;     // of the confidence interval
+        double variance_ratio; // variance without the technique / variance with it
+    };
+
+private:
+    double end_time;
+    size_t replications;
+    double confidence = 0.95;
+    uint64_t seed = 0; // added to the replication number
+
+    double run(const SimBuilder::recipe_t& recipe, const metric_t& metric, uint64_t replication, bool antithetic);
+    Estimate estimate(const vector<double>& sample, double variance_ratio);
+
+public:
+    Experiment(double end_time, size_t replications);
+
+    Experiment& set_confidence(double level);
+    Experiment& set_seed(uint64_t seed); // shifts every stream; experiments with different seeds are independent
+
+    Estimate antithetic(const SimBuilder::recipe_t& recipe, const metric_t& metric);
+    Estimate compare(const SimBuilder::recipe_t& a, const SimBuilder::recipe_t& b, const metric_t& metric); // estimates a - b
+
+    static void report(const string& title, const Estimate& estimate);
+};
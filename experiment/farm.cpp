@@ -0,0 +1,259 @@
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <format>
+#include <stdexcept>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "farm.h"
+
+using namespace std;
+
+namespace {
+
+// the results table: Header | Worker x workers | Row (with its metrics) x replications, in one anonymous shared
+// mapping made before the fork. Only lock-free atomics cross the processes
+struct Header {
+    atomic<uint64_t> next; // next replication to claim
+};
+
+struct Worker {
+    atomic<int64_t> replication; // being run; -1: none
+    atomic<int64_t> started;     // steady clock, ns
+};
+
+struct Row {
+    enum state_t: uint32_t {PENDING, DONE, FAILED};
+    atomic<uint32_t> state; // metrics, events and seconds are written before DONE
+    uint32_t reserved;
+    double seconds;
+    uint64_t events;
+    char error[112];        // FAILED by an exception: its message
+};
+
+static_assert(atomic<uint64_t>::is_always_lock_free && atomic<int64_t>::is_always_lock_free && atomic<uint32_t>::is_always_lock_free);
+
+int64_t now_ns() { return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count(); }
+
+class Table {
+private:
+    void* data = nullptr;
+    size_t size = 0, workers, stride;
+
+public:
+    Table(size_t workers, size_t replications, size_t metrics): workers(workers), stride(sizeof(Row) + metrics * sizeof(double)) {
+        size = sizeof(Header) + workers * sizeof(Worker) + replications * stride;
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) throw runtime_error("can not map the results table");
+        // anonymous pages are zero: every row is PENDING
+        new (&header().next) atomic<uint64_t>(0);
+        for (size_t w = 0; w < workers; ++w) {
+            new (&worker(w).replication) atomic<int64_t>(-1);
+            new (&worker(w).started) atomic<int64_t>(0);
+        }
+    }
+    Table(const Table&) = delete;
+    Table& operator=(const Table&) = delete;
+    ~Table() { munmap(data, size); }
+
+    Header& header() { return *static_cast<Header*>(data); }
+    Worker& worker(size_t w) { return reinterpret_cast<Worker*>(static_cast<char*>(data) + sizeof(Header))[w]; }
+    Row& row(size_t r) { return *reinterpret_cast<Row*>(static_cast<char*>(data) + sizeof(Header) + workers * sizeof(Worker) + r * stride); }
+    double* values(size_t r) { return reinterpret_cast<double*>(&row(r) + 1); }
+};
+
+void fail(Row& row, const string& reason) {
+    memset(row.error, 0, sizeof(row.error));
+    memcpy(row.error, reason.data(), min(reason.size(), sizeof(row.error) - 1));
+    row.state.store(Row::FAILED, memory_order_release);
+}
+
+} // namespace
+
+Farm::Farm(double end_time, size_t replications): end_time(end_time), replications(replications) {
+    if (replications < 2) throw invalid_argument("a farm needs at least 2 replications");
+    if (workers == 0) workers = 1;
+}
+
+Farm& Farm::add_metric(const string& name, metric_t metric) {
+    metrics.emplace_back(name, move(metric));
+
+    return *this;
+}
+
+Farm& Farm::set_workers(size_t workers) {
+    this->workers = max<size_t>(workers, 1);
+
+    return *this;
+}
+
+Farm& Farm::set_timeout(double seconds) {
+    if (seconds < 0) throw invalid_argument("timeout must not be negative");
+    timeout = seconds;
+
+    return *this;
+}
+
+Farm& Farm::set_memory_limit(size_t bytes) {
+    memory_limit = bytes;
+
+    return *this;
+}
+
+Farm& Farm::set_confidence(double level) {
+    if (level <= 0 || level >= 1) throw invalid_argument("confidence level must be in (0; 1)");
+    confidence = level;
+
+    return *this;
+}
+
+Farm& Farm::set_seed(uint64_t seed) {
+    this->seed = seed;
+
+    return *this;
+}
+
+Farm::Result Farm::run(const SimBuilder::recipe_t& recipe) {
+    if (metrics.empty()) throw invalid_argument("a farm needs at least one metric");
+    auto start = chrono::steady_clock::now();
+    size_t n = min(workers, replications);
+    Table table(n, replications, metrics.size());
+
+    // worker process: claims replications until there are none left. Never returns
+    auto work = [&](size_t w) {
+        if (memory_limit > 0) {
+            rlimit limit{memory_limit, memory_limit};
+            setrlimit(RLIMIT_AS, &limit);
+        }
+        Worker& self = table.worker(w);
+        for (uint64_t r; (r = table.header().next.fetch_add(1)) < replications;) {
+            self.started.store(now_ns());
+            self.replication.store(r);
+            Row& row = table.row(r);
+            try {
+                auto t0 = chrono::steady_clock::now();
+                SimBuilder builder(end_time);
+                builder.set_streams(seed + r);
+                recipe(builder);
+                auto sim = builder.build();
+                sim->run_until(end_time);
+                for (size_t m = 0; m < metrics.size(); ++m) table.values(r)[m] = metrics[m].second(*sim);
+                row.events = sim->get_events();
+                row.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+                row.state.store(Row::DONE, memory_order_release);
+            }
+            catch (const exception& e) { fail(row, e.what()); }
+            catch (...) { fail(row, "unknown exception"); }
+            self.replication.store(-1);
+        }
+        _exit(0); // no destructors or atexit handlers of the parent's objects
+    };
+
+    vector<pid_t> pid(n, -1);
+    vector<bool> timed_out(n, false);
+    auto spawn = [&](size_t w) {
+        table.worker(w).replication.store(-1);
+        timed_out[w] = false;
+        cout.flush(); // or the child would write the parent's buffer again
+        cerr.flush();
+        pid_t child = fork();
+        if (child < 0) throw runtime_error(format("can not fork a worker: {}", strerror(errno)));
+        if (child == 0) work(w);
+        pid[w] = child;
+    };
+    size_t live = 0;
+    try {
+        for (size_t w = 0; w < n; ++w, ++live) spawn(w);
+
+        // reaps only its own workers (waitpid(-1) would take children of the caller too); polls every 10 ms
+        auto reap = [&](size_t w, int status) {
+            pid[w] = -1;
+            --live;
+            int64_t r = table.worker(w).replication.load();
+            if (r >= 0 && table.row(r).state.load(memory_order_acquire) == Row::PENDING) {
+                if (timed_out[w]) fail(table.row(r), format("timed out after {} s", timeout));
+                else if (WIFSIGNALED(status)) fail(table.row(r), format("killed by signal {} ({})", WTERMSIG(status), strsignal(WTERMSIG(status))));
+                else fail(table.row(r), format("worker exited with code {}", WIFEXITED(status) ? WEXITSTATUS(status) : -1));
+            }
+            bool clean = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            if (!clean && table.header().next.load() < replications) {
+                spawn(w);
+                ++live;
+            }
+        };
+        while (live > 0) {
+            bool reaped = false;
+            for (size_t w = 0; w < n; ++w) {
+                if (pid[w] < 0) continue;
+                int status;
+                pid_t child = waitpid(pid[w], &status, WNOHANG);
+                if (child < 0 && errno != EINTR) throw runtime_error(format("waitpid failed: {}", strerror(errno)));
+                if (child == pid[w]) {
+                    reap(w, status);
+                    reaped = true;
+                }
+            }
+            if (reaped) continue;
+            if (timeout > 0) {
+                int64_t now = now_ns();
+                for (size_t w = 0; w < n; ++w) {
+                    if (pid[w] < 0 || timed_out[w] || table.worker(w).replication.load() < 0) continue;
+                    if ((now - table.worker(w).started.load()) * 1e-9 > timeout) {
+                        timed_out[w] = true;
+                        kill(pid[w], SIGKILL);
+                    }
+                }
+            }
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+    }
+    catch (...) { // no worker outlives run()
+        for (pid_t child : pid) if (child > 0) { kill(child, SIGKILL); waitpid(child, nullptr, 0); }
+        throw;
+    }
+
+    Result result{0, {}, {}, 0, 0};
+    vector<vector<double>> sample(metrics.size());
+    for (size_t r = 0; r < replications; ++r) {
+        Row& row = table.row(r);
+        switch (row.state.load(memory_order_acquire)) {
+            case Row::DONE:
+                ++result.replications;
+                result.events += row.events;
+                for (size_t m = 0; m < metrics.size(); ++m) sample[m].push_back(table.values(r)[m]);
+                break;
+            case Row::FAILED: result.failures.push_back(Failure{r, row.error}); break;
+            default: result.failures.push_back(Failure{r, "lost: its worker died before recording it"}); break;
+        }
+    }
+    size_t k = result.replications;
+    for (size_t m = 0; m < metrics.size(); ++m) {
+        double mean = numeric_limits<double>::quiet_NaN(), hw = numeric_limits<double>::infinity();
+        if (k > 0) mean = accumulate(sample[m].begin(), sample[m].end(), 0.0) / k;
+        if (k >= 2) {
+            double s2 = 0;
+            for (double x : sample[m]) s2 += (x - mean) * (x - mean);
+            hw = t_quantile((1 + confidence) / 2, k - 1) * sqrt(s2 / (k - 1) / k);
+        }
+        result.metrics.push_back(Estimate{metrics[m].first, mean, hw});
+    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void Farm::report(const string& title, const Result& result) {
+    cout << fixed << showpoint << setprecision(4);
+    cout << title << " (" << result.replications << " replications, " << result.failures.size() << " failed, "
+         << result.events << " events, " << setprecision(2) << result.seconds << " s):\n" << setprecision(4);
+    cout << "\tmetric\t\tmean\t\t±\n";
+    for (auto& [name, mean, hw] : result.metrics) cout << "\t" << name << "\t\t" << mean << "\t\t" << hw << "\n";
+    for (auto& [replication, reason] : result.failures) cout << "\tfailed: replication " << replication << ": " << reason << "\n";
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <thread>
+#include "gpcc/gpcc.h"
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+// Independent replications in worker processes, for long runs that must not take each other down:
+//
+//     Farm farm(1e6, 100);
+//     farm.add_metric("wait", [](Simulation& s) { return s.get_q_stats(0).m; }).set_workers(8).set_timeout(600);
+//     Farm::report("model", farm.run(recipe));
+//
+// run() maps a results table into shared memory and forks the workers. Each one claims the next replication from a
+// counter in the table, builds the recipe with SimBuilder::set_streams(seed + r), runs it to end_time and writes the
+// metrics into the row of r. A worker that crashes, runs out of memory (set_memory_limit) or is killed for running
+// past the timeout loses only the replication it had: the parent marks its row failed and forks a replacement.
+// The parent merges the finished rows into confidence intervals. Failed replications are left out, which biases the
+// estimates if failures depend on the outcome, so the report lists them.
+// Call run() from a process without other threads: a forked child has only the thread that forked
+class Farm {
+public:
+    using metric_t = function<double(Simulation&)>; // read after the run
+
+    struct Estimate {
+        string name;
+        double mean;
+        double half_width; // of the confidence interval; infinity with less than 2 replications
+    };
+    struct Failure {
+        size_t replication;
+        string reason;
+    };
+    struct Result {
+        size_t replications; // that finished
+        vector<Estimate> metrics;
+        vector<Failure> failures;
+        uint64_t events;     // simulated by the finished replications
+        double seconds;      // wall time of run()
+    };
+
+private:
+    double end_time;
+    size_t replications;
+    size_t workers = thread::hardware_concurrency();
+    double timeout = 0;       // seconds per replication; 0: none
+    size_t memory_limit = 0;  // bytes of address space per worker; 0: none
+    double confidence = 0.95;
+    uint64_t seed = 0;
+    vector<pair<string, metric_t>> metrics;
+
+public:
+    Farm(double end_time, size_t replications);
+
+    Farm& add_metric(const string& name, metric_t metric);
+    Farm& set_workers(size_t workers);
+    Farm& set_timeout(double seconds);
+    Farm& set_memory_limit(size_t bytes);
+    Farm& set_confidence(double level);
+    Farm& set_seed(uint64_t seed); // shifts every stream, as in Experiment
+
+    Result run(const SimBuilder::recipe_t& recipe); // throws runtime_error if the table or a worker can't be created
+
+    static void report(const string& title, const Result& result);
+};
@@ -0,0 +1,236 @@
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <limits>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include "optimizer.h"
+
+using namespace std;
+
+void Optimizer::Candidate::add(double value) {
+    ++replications;
+    double d = value - mean;
+    mean += d / replications;
+    m2 += d * (value - mean);
+}
+
+double Optimizer::Candidate::variance() const { return replications > 1 ? m2 / (replications - 1) : 0; }
+
+Optimizer::Optimizer(double end_time): end_time(end_time) {
+    if (threads == 0) threads = 1;
+}
+
+Optimizer& Optimizer::add_integer(const string& name, long low, long high) {
+    if (low > high) throw invalid_argument("empty range of parameter " + name);
+    params.push_back(Param{name, double(low), double(high), size_t(high - low + 1), true});
+
+    return *this;
+}
+
+Optimizer& Optimizer::add_real(const string& name, double low, double high, size_t points) {
+    if (low > high || points == 0 || (points == 1 && low != high)) throw invalid_argument("bad range of parameter " + name);
+    params.push_back(Param{name, low, high, points, false});
+
+    return *this;
+}
+
+Optimizer& Optimizer::set_initial(size_t replications) {
+    if (replications < 2) throw invalid_argument("at least 2 initial replications are needed for a variance");
+    n0 = replications;
+
+    return *this;
+}
+
+Optimizer& Optimizer::set_budget(size_t replications) {
+    budget = replications;
+
+    return *this;
+}
+
+Optimizer& Optimizer::set_round(size_t replications) {
+    round = replications;
+
+    return *this;
+}
+
+Optimizer& Optimizer::set_threads(size_t threads) {
+    this->threads = max<size_t>(threads, 1);
+
+    return *this;
+}
+
+Optimizer& Optimizer::set_confidence(double level) {
+    if (level <= 0 || level >= 1) throw invalid_argument("confidence level must be in (0; 1)");
+    confidence = level;
+
+    return *this;
+}
+
+Optimizer& Optimizer::set_seed(uint64_t seed) {
+    this->seed = seed;
+
+    return *this;
+}
+
+vector<Optimizer::point_t> Optimizer::grid() const {
+    if (params.empty()) throw invalid_argument("no parameters to optimize");
+    size_t size = 1;
+    for (auto& p : params) size *= p.points;
+
+    vector<point_t> points(size, point_t(params.size()));
+    for (size_t k = 0; k < size; ++k) {
+        size_t rest = k;
+        for (size_t j = params.size(); j-- > 0;) { // the first parameter varies slowest
+            const Param& p = params[j];
+            size_t i = rest % p.points;
+            rest /= p.points;
+            points[k][j] = p.integer || p.points == 1 ? p.low + i : p.low + (p.high - p.low) * i / (p.points - 1);
+        }
+    }
+    return points;
+}
+
+// runs one replication per job (a candidate index). Replication numbers continue those the candidate already has
+uint64_t Optimizer::run(const model_t& model, const objective_t& objective, vector<Candidate>& candidates, const vector<size_t>& jobs) {
+    vector<uint64_t> replication(jobs.size());
+    vector<size_t> next_replication(candidates.size());
+    for (size_t i = 0; i < candidates.size(); ++i) next_replication[i] = candidates[i].replications;
+    for (size_t j = 0; j < jobs.size(); ++j) replication[j] = next_replication[jobs[j]]++;
+
+    vector<double> value(jobs.size());
+    atomic<size_t> next = 0;
+    atomic<uint64_t> events = 0;
+    exception_ptr error;
+    mutex lock;
+    auto work = [&]() {
+        for (size_t j; (j = next++) < jobs.size();) {
+            try {
+                const point_t& point = candidates[jobs[j]].point;
+                SimBuilder builder(end_time);
+                builder.set_streams(seed + replication[j]);
+                model(builder, point);
+                auto sim = builder.build();
+                sim->run_until(end_time);
+                value[j] = objective(*sim, point);
+                events += sim->get_events();
+            }
+            catch (...) {
+                lock_guard<mutex> guard(lock);
+                if (!error) error = current_exception();
+                next = jobs.size();
+            }
+        }
+    };
+    vector<thread> pool;
+    for (size_t t = 1; t < min(threads, jobs.size()); ++t) pool.emplace_back(work);
+    work();
+    for (auto& t : pool) t.join();
+    if (error) rethrow_exception(error);
+
+    for (size_t j = 0; j < jobs.size(); ++j) candidates[jobs[j]].add(value[j]);
+    return events;
+}
+
+Optimizer::Result Optimizer::result(vector<Candidate> candidates, size_t replications, uint64_t events) const {
+    size_t best = 0;
+    for (size_t i = 1; i < candidates.size(); ++i) if (candidates[i].mean < candidates[best].mean) best = i;
+    const Candidate& b = candidates[best];
+
+    // P(CS) >= 1 - sum over i != best of P(mean_i < mean_best), with normal means
+    double pcs = 1;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (i == best) continue;
+        double se = sqrt(candidates[i].variance() / candidates[i].replications + b.variance() / b.replications);
+        double gap = candidates[i].mean - b.mean;
+        pcs -= se > 0 ? erfc(gap / se / sqrt(2.0)) / 2 : (gap > 0 ? 0 : 0.5);
+    }
+
+    double hw = t_quantile((1 + confidence) / 2, b.replications - 1) * sqrt(b.variance() / b.replications);
+    return Result{best, b.mean, hw, max(pcs, 0.0), replications, events, move(candidates)};
+}
+
+Optimizer::Result Optimizer::optimize(const model_t& model, const objective_t& objective) {
+    auto points = grid();
+    size_t k = points.size();
+    if (n0 * k > budget) throw invalid_argument("the budget is less than the initial replications of every candidate");
+    vector<Candidate> candidates(k);
+    for (size_t i = 0; i < k; ++i) candidates[i].point = move(points[i]);
+
+    vector<size_t> jobs;
+    for (size_t r = 0; r < n0; ++r) for (size_t i = 0; i < k; ++i) jobs.push_back(i);
+    uint64_t events = run(model, objective, candidates, jobs);
+    size_t total = n0 * k;
+    size_t step = round > 0 ? round : 2 * threads;
+
+    while (true) {
+        Result current = result(candidates, total, events);
+        if (current.pcs >= confidence || total >= budget || k == 1) return current;
+
+        // OCBA: N_i ~ s_i^2 / d_i^2 for i != b, N_b = s_b * sqrt(sum N_i^2 / s_i^2). Variances and gaps are floored
+        // so that ties and constant objectives still get finite shares
+        size_t b = current.best;
+        double scale = abs(candidates[b].mean) + 1;
+        vector<double> weight(k);
+        double sum_b = 0;
+        for (size_t i = 0; i < k; ++i) {
+            if (i == b) continue;
+            double s2 = max(candidates[i].variance(), 1e-12 * scale * scale);
+            double gap = max(candidates[i].mean - candidates[b].mean, 1e-9 * scale);
+            weight[i] = s2 / (gap * gap);
+            sum_b += weight[i] * weight[i] / s2;
+        }
+        weight[b] = sqrt(max(candidates[b].variance(), 1e-12 * scale * scale) * sum_b);
+        double total_weight = accumulate(weight.begin(), weight.end(), 0.0);
+
+        // the next replications go one by one to the candidates furthest below their share of the new total
+        size_t more = min(step, budget - total);
+        vector<double> deficit(k);
+        for (size_t i = 0; i < k; ++i) deficit[i] = (total + more) * weight[i] / total_weight - candidates[i].replications;
+        jobs.clear();
+        for (size_t r = 0; r < more; ++r) {
+            size_t i = max_element(deficit.begin(), deficit.end()) - deficit.begin();
+            jobs.push_back(i);
+            deficit[i] -= 1;
+        }
+        events += run(model, objective, candidates, jobs);
+        total += more;
+    }
+}
+
+Optimizer::Result Optimizer::exhaustive(const model_t& model, const objective_t& objective, size_t replications) {
+    if (replications < 2) throw invalid_argument("at least 2 replications per candidate are needed");
+    auto points = grid();
+    size_t k = points.size();
+    vector<Candidate> candidates(k);
+    for (size_t i = 0; i < k; ++i) candidates[i].point = move(points[i]);
+
+    vector<size_t> jobs;
+    for (size_t r = 0; r < replications; ++r) for (size_t i = 0; i < k; ++i) jobs.push_back(i);
+    uint64_t events = run(model, objective, candidates, jobs);
+    return result(move(candidates), replications * k, events);
+}
+
+void Optimizer::report(const Result& result) const {
+    const size_t shown = 10;
+    vector<size_t> order(result.candidates.size());
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) { return result.candidates[a].mean < result.candidates[b].mean; });
+
+    cout << fixed << showpoint << setprecision(4);
+    cout << "Optimization (" << result.candidates.size() << " candidates, " << result.replications << " replications, "
+         << result.events << " events, P(CS) >= " << result.pcs << "):\n";
+    cout << "\t";
+    for (auto& p : params) cout << p.name << "\t\t";
+    cout << "Replications\tmean\t\t±\n";
+    for (size_t r = 0; r < min(shown, order.size()); ++r) {
+        const Candidate& c = result.candidates[order[r]];
+        double hw = t_quantile((1 + confidence) / 2, c.replications - 1) * sqrt(c.variance() / c.replications);
+        cout << "\t";
+        for (double x : c.point) cout << x << "\t\t";
+        cout << c.replications << "\t\t" << c.mean << "\t\t" << hw << (order[r] == result.best ? "\t\tbest" : "") << "\n";
+    }
+}
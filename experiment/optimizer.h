@@ -0,0 +1,88 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <thread>
+#include "gpcc/gpcc.h"
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+// Simulation-based optimization over a grid of parameters: integer ones (e.g. storage capacities) and continuous
+// ones sampled at evenly spaced points (e.g. rates). Every point of the grid is a candidate; the best one is the
+// one with the smallest mean objective, e.g. cost of the capacities plus a penalty when a queue breaks its SLA:
+//
+//     Optimizer opt(1000);
+//     opt.add_integer("servers", 1, 8).add_real("rate", 0.5, 2, 7);
+//     auto result = opt.optimize([](SimBuilder& b, const Optimizer::point_t& x) { ... b.add_storage("s", x[0]) ... },
+//                                [](Simulation& s, const Optimizer::point_t& x) { return 10 * x[0] + 100 * s.get_q_stats(0).m; });
+//
+// optimize() allocates replications by OCBA (Chen et al.): after n0 replications of every candidate, each round
+// gives the next replications to the candidates that most raise the approximate probability of correct selection,
+// so clearly bad points stop early. It ends when that probability reaches the confidence level or the budget is spent.
+// exhaustive() gives every candidate the same number of replications, as a grid would.
+// Replication r of every candidate runs on the same streams (SimBuilder::set_streams), and the replications of a
+// round run on a pool of threads
+class Optimizer {
+public:
+    using point_t = vector<double>;
+    using model_t = function<void(SimBuilder&, const point_t&)>;                 // adds the model for a point to a fresh builder
+    using objective_t = function<double(Simulation&, const point_t&)>;          // read after the run; smaller is better
+
+    struct Candidate {
+        point_t point;
+        size_t replications = 0;
+        double mean = 0;
+        double m2 = 0; // sum of squared deviations from the mean (Welford)
+
+        void add(double value);
+        double variance() const; // of one replication
+    };
+
+    struct Result {
+        size_t best;                  // index in candidates
+        double mean, half_width;      // of the best candidate
+        double pcs;                   // approximate probability of correct selection (Bonferroni bound)
+        size_t replications;          // over all candidates
+        uint64_t events;              // timed events simulated
+        vector<Candidate> candidates;
+    };
+
+private:
+    struct Param {
+        string name;
+        double low, high;
+        size_t points;
+        bool integer;
+    };
+
+    double end_time;
+    vector<Param> params;
+    size_t n0 = 5;
+    size_t budget = 10000;          // replications over all candidates
+    size_t round = 0;               // replications per round; 0: twice the threads
+    size_t threads = thread::hardware_concurrency();
+    double confidence = 0.95;
+    uint64_t seed = 0;
+
+    vector<point_t> grid() const;
+    uint64_t run(const model_t& model, const objective_t& objective, vector<Candidate>& candidates, const vector<size_t>& jobs);
+    Result result(vector<Candidate> candidates, size_t replications, uint64_t events) const;
+
+public:
+    Optimizer(double end_time);
+
+    Optimizer& add_integer(const string& name, long low, long high);            // low, low + 1, ..., high
+    Optimizer& add_real(const string& name, double low, double high, size_t points); // points evenly spaced values in [low; high]
+    Optimizer& set_initial(size_t replications); // n0, at least 2
+    Optimizer& set_budget(size_t replications);
+    Optimizer& set_round(size_t replications);
+    Optimizer& set_threads(size_t threads);
+    Optimizer& set_confidence(double level);    // target probability of correct selection
+    Optimizer& set_seed(uint64_t seed);
+
+    Result optimize(const model_t& model, const objective_t& objective);
+    Result exhaustive(const model_t& model, const objective_t& objective, size_t replications);
+
+    void report(const Result& result) const;
+};
@@ -0,0 +1,167 @@
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include <numeric>
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include "splitting.h"
+
+using namespace std;
+
+Splitting::Splitting(double horizon, vector<double> levels, size_t effort): horizon(horizon), levels(move(levels)), effort(effort) {
+    if (!(horizon > 0)) throw invalid_argument("splitting horizon must be positive");
+    if (this->levels.empty()) throw invalid_argument("splitting needs at least one level");
+    for (size_t k = 1; k < this->levels.size(); ++k) if (!(this->levels[k] > this->levels[k - 1])) throw invalid_argument("splitting levels must increase");
+    if (effort == 0) throw invalid_argument("splitting effort must be positive");
+    if (threads == 0) threads = 1;
+}
+
+Splitting& Splitting::set_repetitions(size_t repetitions) {
+    if (repetitions < 2) throw invalid_argument("at least 2 repetitions are needed for a confidence interval");
+    this->repetitions = repetitions;
+
+    return *this;
+}
+
+Splitting& Splitting::set_threads(size_t threads) {
+    this->threads = max<size_t>(threads, 1);
+
+    return *this;
+}
+
+Splitting& Splitting::set_confidence(double level) {
+    if (level <= 0 || level >= 1) throw invalid_argument("confidence level must be in (0; 1)");
+    confidence = level;
+
+    return *this;
+}
+
+Splitting& Splitting::set_seed(uint64_t seed) {
+    this->seed = seed;
+
+    return *this;
+}
+
+// runs sim from its current state until the importance reaches level (true) or the clock passes the horizon
+bool Splitting::climb(Simulation& sim, Simulation::Expr& importance, double level, uint64_t& events) const {
+    uint64_t start = sim.get_events();
+    bool hit;
+    while (!(hit = importance.eval(sim) >= level)) {
+        if (sim.step() == 0 || sim.get_time() > horizon) break;
+    }
+    events += sim.get_events() - start;
+    return hit;
+}
+
+// one fixed-effort estimate. stages gets the frequency of every stage
+double Splitting::repetition(const SimBuilder::recipe_t& recipe, const importance_t& importance, size_t r, vector<double>& stages, uint64_t& events) const {
+    stages.assign(levels.size(), 0);
+    unique_ptr<Simulation> sim;
+    Simulation::Expr value = 0;
+    vector<vector<char>> entrances, next;
+
+    for (size_t i = 0; i < effort; ++i) {
+        SimBuilder builder(horizon);
+        builder.set_streams(stream_seed(format("splitting {} 0 {}", r, i), seed));
+        recipe(builder);
+        value = importance(builder);
+        sim = builder.build();
+        if (climb(*sim, value, levels[0], events)) entrances.push_back(sim->image());
+    }
+    stages[0] = double(entrances.size()) / effort;
+    double p = stages[0];
+
+    for (size_t k = 1; k < levels.size() && !entrances.empty(); ++k) {
+        // every entrance state starts effort / n runs; the rest start from distinct states drawn at random
+        size_t n = entrances.size();
+        vector<size_t> extra(n);
+        iota(extra.begin(), extra.end(), 0);
+        minstd_rand shuffle(stream_seed(format("splitting {} {}", r, k), seed) % (minstd_rand::modulus - 1) + 1);
+        for (size_t i = 0; i < effort % n; ++i) swap(extra[i], extra[i + shuffle() % (n - i)]);
+
+        next.clear();
+        for (size_t i = 0; i < effort; ++i) {
+            sim->restore_image(entrances[i < effort - effort % n ? i % n : extra[i - (effort - effort % n)]]);
+            sim->reseed(stream_seed(format("splitting {} {} {}", r, k, i), seed));
+            if (climb(*sim, value, levels[k], events)) next.push_back(sim->image());
+        }
+        stages[k] = double(next.size()) / effort;
+        p *= stages[k];
+        swap(entrances, next);
+    }
+    if (entrances.empty()) p = 0;
+    return p;
+}
+
+template <typename F>
+void Splitting::pool(size_t jobs, F job) const {
+    atomic<size_t> next = 0;
+    exception_ptr error;
+    mutex lock;
+    auto work = [&]() {
+        for (size_t j; (j = next++) < jobs;) {
+            try { job(j); }
+            catch (...) {
+                lock_guard<mutex> guard(lock);
+                if (!error) error = current_exception();
+                next = jobs;
+            }
+        }
+    };
+    vector<thread> workers;
+    for (size_t t = 1; t < min(threads, jobs); ++t) workers.emplace_back(work);
+    work();
+    for (auto& t : workers) t.join();
+    if (error) rethrow_exception(error);
+}
+
+Splitting::Estimate Splitting::estimate(const vector<double>& sample, vector<double> stages, uint64_t events) const {
+    size_t n = sample.size();
+    double mean = accumulate(sample.begin(), sample.end(), 0.0) / n;
+    double s2 = 0;
+    for (double x : sample) s2 += (x - mean) * (x - mean);
+    double hw = t_quantile((1 + confidence) / 2, n - 1) * sqrt(s2 / (n - 1) / n);
+    return Estimate{mean, hw, n, move(stages), events};
+}
+
+Splitting::Estimate Splitting::estimate(const SimBuilder::recipe_t& recipe, const importance_t& importance) {
+    vector<double> p(repetitions);
+    vector<vector<double>> stages(repetitions);
+    vector<uint64_t> events(repetitions, 0);
+    pool(repetitions, [&](size_t r) { p[r] = repetition(recipe, importance, r, stages[r], events[r]); });
+
+    vector<double> mean_stages(levels.size(), 0);
+    for (auto& s : stages) for (size_t k = 0; k < levels.size(); ++k) mean_stages[k] += s[k] / repetitions;
+    return estimate(p, move(mean_stages), accumulate(events.begin(), events.end(), uint64_t(0)));
+}
+
+Splitting::Estimate Splitting::crude(const SimBuilder::recipe_t& recipe, const importance_t& importance, size_t runs) {
+    if (runs < 2) throw invalid_argument("at least 2 runs are needed for a confidence interval");
+    vector<double> hit(runs);
+    vector<uint64_t> events(runs, 0);
+    pool(runs, [&](size_t i) {
+        SimBuilder builder(horizon);
+        builder.set_streams(stream_seed(format("crude {}", i), seed));
+        recipe(builder);
+        Simulation::Expr value = importance(builder);
+        auto sim = builder.build();
+        hit[i] = climb(*sim, value, levels.back(), events[i]);
+    });
+    double p = accumulate(hit.begin(), hit.end(), 0.0) / runs;
+    return estimate(hit, vector<double>{p}, accumulate(events.begin(), events.end(), uint64_t(0)));
+}
+
+void Splitting::report(const string& title, const Estimate& estimate) {
+    cout << scientific << setprecision(4);
+    cout << title << ": p = " << estimate.p << " ± " << estimate.half_width;
+    if (estimate.p > 0) cout << " (relative " << fixed << setprecision(3) << estimate.half_width / estimate.p << ")";
+    cout << ", " << estimate.repetitions << " repetitions, " << estimate.events << " events\n";
+    if (estimate.stages.size() > 1) {
+        cout << fixed << setprecision(4) << "\tstage frequencies:";
+        for (double s : estimate.stages) cout << ' ' << s;
+        cout << '\n';
+    }
+}
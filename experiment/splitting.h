@@ -0,0 +1,62 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <thread>
+#include "gpcc/gpcc.h"
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+// Probability of a rare event: the importance function, an expression over queues and storages, reaches a level
+// within a horizon of model time, e.g. P(queue "q3" reaches 500 before time 10000):
+//
+//     Splitting split(10000, {100, 200, 300, 400, 500}, 1000);
+//     auto estimate = split.estimate(recipe, [](SimBuilder& b) { return b.q_length("q3"); });
+//
+// Fixed-effort multilevel splitting: stage 0 runs effort replications from the start until the importance reaches
+// levels[0] or the clock passes the horizon, and saves the state of each one that got there (Simulation::image).
+// Stage k starts effort runs from those states, every state about equally often, on new random streams
+// (Simulation::reseed), until levels[k] or the horizon. The product of the stage frequencies is an unbiased
+// estimate of the probability; independent repetitions of the whole procedure give its confidence interval.
+// Levels should be close enough that every stage succeeds with a probability of about 0.1 or more.
+// Repetitions run on a pool of threads
+class Splitting {
+public:
+    using importance_t = function<Simulation::Expr(SimBuilder&)>; // evaluated after every event
+
+    struct Estimate {
+        double p, half_width;
+        size_t repetitions;
+        vector<double> stages; // mean frequency of reaching each level from the previous one
+        uint64_t events;       // simulated by all runs
+    };
+
+private:
+    double horizon;
+    vector<double> levels;
+    size_t effort;
+    size_t repetitions = 20;
+    size_t threads = thread::hardware_concurrency();
+    double confidence = 0.95;
+    uint64_t seed = 0;
+
+    bool climb(Simulation& sim, Simulation::Expr& importance, double level, uint64_t& events) const;
+    double repetition(const SimBuilder::recipe_t& recipe, const importance_t& importance, size_t r, vector<double>& stages, uint64_t& events) const;
+    template <typename F>
+    void pool(size_t jobs, F job) const;
+    Estimate estimate(const vector<double>& sample, vector<double> stages, uint64_t events) const;
+
+public:
+    Splitting(double horizon, vector<double> levels, size_t effort); // levels increase; the last one is the rare event
+
+    Splitting& set_repetitions(size_t repetitions); // at least 2
+    Splitting& set_threads(size_t threads);
+    Splitting& set_confidence(double level);
+    Splitting& set_seed(uint64_t seed);
+
+    Estimate estimate(const SimBuilder::recipe_t& recipe, const importance_t& importance);
+    Estimate crude(const SimBuilder::recipe_t& recipe, const importance_t& importance, size_t runs); // plain runs, for comparison
+
+    static void report(const string& title, const Estimate& estimate);
+};
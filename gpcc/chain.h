@@ -0,0 +1,217 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <bit>
+#include <algorithm>
+#include <stdexcept>
+#include "state.h"
+
+using namespace std;
+
+// Wait chain: FIFO among equal priorities, higher priority first. Every priority level is a bucket with an
+// intrusive FIFO list of pooled nodes; a bitmap of non-empty buckets gives the head in O(1).
+// Priorities are expected to take a handful of distinct values: a new level costs O(levels) once.
+// Lists are doubly linked, so an item can also leave from the middle (remove) by the node push returned; an item may
+// carry a tag, e.g. the ticket of a reneging transaction.
+// The chain also keeps its own statistics: length (time-weighted), entries, removals and time spent waiting
+template <typename T, typename priority_t = unsigned long>
+class WaitChain {
+private:
+    struct Node {
+        T item;
+        uint32_t next, prev;
+        uint32_t tag;
+        priority_t priority;
+        double since; // time of entry
+    };
+    struct Bucket {
+        priority_t priority;
+        uint32_t head = nil, tail = nil;
+    };
+
+    vector<Node> nodes;
+    uint32_t free_node = nil;
+    vector<Bucket> buckets;  // ascending by priority
+    vector<uint64_t> filled; // bit i: buckets[i] is not empty
+    size_t length = 0;
+
+    // statistics since the last reset
+    size_t max_length = 0;
+    uint64_t entries = 0;
+    uint64_t removed = 0;  // by remove()
+    double total_wait = 0; // of transactions that already left
+    double area = 0;       // integral of length over time
+    double last_change = 0;
+    double stat_start = 0;
+
+    size_t bucket(priority_t priority) {
+        auto it = lower_bound(buckets.begin(), buckets.end(), priority, [](const Bucket& b, priority_t p) { return b.priority < p; });
+        size_t index = it - buckets.begin();
+        if (it != buckets.end() && it->priority == priority) return index;
+
+        // new level: shift the bitmap together with the buckets
+        buckets.insert(it, Bucket{priority});
+        filled.resize((buckets.size() + 63) / 64, 0);
+        for (size_t i = buckets.size() - 1; i > index; --i) set_filled(i, is_filled(i - 1));
+        set_filled(index, false);
+        return index;
+    }
+
+    bool is_filled(size_t i) const { return filled[i / 64] >> (i % 64) & 1; }
+    void set_filled(size_t i, bool value) {
+        if (value) filled[i / 64] |= uint64_t(1) << (i % 64);
+        else filled[i / 64] &= ~(uint64_t(1) << (i % 64));
+    }
+
+    size_t top_bucket() const {
+        for (size_t w = filled.size(); w-- > 0;) if (filled[w]) return w * 64 + 63 - countl_zero(filled[w]);
+        throw runtime_error("top of an empty wait chain");
+    }
+
+    void account(double now) {
+        area += length * (now - last_change);
+        last_change = now;
+    }
+
+    T release(uint32_t n, double now) { // n is unlinked
+        total_wait += now - nodes[n].since;
+        nodes[n].next = free_node;
+        free_node = n;
+        --length;
+        return nodes[n].item;
+    }
+
+public:
+    static constexpr uint32_t nil = UINT32_MAX;
+
+    bool empty() const { return length == 0; }
+    size_t size() const { return length; }
+
+    uint32_t push(priority_t priority, const T& item, double now, uint32_t tag = nil) { // returns the node of item
+        account(now);
+        size_t b = bucket(priority);
+        Node node{item, nil, buckets[b].tail, tag, priority, now};
+        uint32_t n;
+        if (free_node != nil) { n = free_node; free_node = nodes[n].next; nodes[n] = node; }
+        else { n = nodes.size(); nodes.push_back(node); }
+
+        if (buckets[b].tail == nil) buckets[b].head = n;
+        else nodes[buckets[b].tail].next = n;
+        buckets[b].tail = n;
+        set_filled(b, true);
+
+        ++length;
+        ++entries;
+        max_length = max(max_length, length);
+        return n;
+    }
+
+    const T& front() const { return nodes[buckets[top_bucket()].head].item; }
+    priority_t front_priority() const { return buckets[top_bucket()].priority; }
+
+    T pop(double now, uint32_t* tag = nullptr) {
+        account(now);
+        size_t b = top_bucket();
+        uint32_t n = buckets[b].head;
+        buckets[b].head = nodes[n].next;
+        if (buckets[b].head == nil) { buckets[b].tail = nil; set_filled(b, false); }
+        else nodes[buckets[b].head].prev = nil;
+
+        if (tag != nullptr) *tag = nodes[n].tag;
+        return release(n, now);
+    }
+
+    T remove(uint32_t n, double now) { // n must be in the chain
+        account(now);
+        size_t b = bucket(nodes[n].priority);
+        uint32_t next = nodes[n].next, prev = nodes[n].prev;
+        if (prev == nil) buckets[b].head = next;
+        else nodes[prev].next = next;
+        if (next == nil) buckets[b].tail = prev;
+        else nodes[next].prev = prev;
+        if (buckets[b].head == nil) set_filled(b, false);
+
+        ++removed;
+        return release(n, now);
+    }
+
+    // f(node, tag) for every item in chain order
+    template <typename F>
+    void visit(F f) const {
+        for (size_t b = buckets.size(); b-- > 0;) for (uint32_t n = buckets[b].head; n != nil; n = nodes[n].next) f(n, nodes[n].tag);
+    }
+
+    void reset_stat(double now) {
+        max_length = length;
+        entries = length; // transactions already waiting are counted as entries of the new period
+        removed = 0;
+        total_wait = 0;
+        area = 0;
+        last_change = stat_start = now;
+        // waits of those still in the chain are counted from now on
+        for (auto& b : buckets) for (uint32_t n = b.head; n != nil; n = nodes[n].next) nodes[n].since = now;
+    }
+
+    size_t get_max() const { return max_length; }
+    uint64_t get_entries() const { return entries; }
+    uint64_t get_removed() const { return removed; }
+    double get_mean_length(double now) const { // time-weighted
+        double elapsed = now - stat_start;
+        return elapsed > 0 ? (area + length * (now - last_change)) / elapsed : 0;
+    }
+    double get_mean_wait() const { // over transactions that already left the chain
+        uint64_t left = entries - length;
+        return left > 0 ? total_wait / left : 0;
+    }
+
+    // waiting items in chain order and the statistics. The node pool is rebuilt on load: only the order matters
+    template <typename F>
+    void save(StateWriter& out, F save_item) const {
+        out.put(uint64_t(buckets.size()));
+        for (auto& b : buckets) {
+            out.put(b.priority);
+            uint64_t count = 0;
+            for (uint32_t n = b.head; n != nil; n = nodes[n].next) ++count;
+            out.put(count);
+            for (uint32_t n = b.head; n != nil; n = nodes[n].next) { save_item(out, nodes[n].item); out.put(nodes[n].since); out.put(nodes[n].tag); }
+        }
+        out.put(uint64_t(max_length));
+        out.put(entries);
+        out.put(removed);
+        out.put(total_wait);
+        out.put(area);
+        out.put(last_change);
+        out.put(stat_start);
+    }
+
+    template <typename F>
+    void load(StateReader& in, F load_item) {
+        nodes.clear();
+        free_node = nil;
+        buckets.resize(in.get<uint64_t>());
+        filled.assign((buckets.size() + 63) / 64, 0);
+        length = 0;
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            buckets[i] = Bucket{in.get<priority_t>()};
+            uint64_t count = in.get<uint64_t>();
+            for (uint64_t k = 0; k < count; ++k) {
+                uint32_t n = nodes.size();
+                T item = load_item(in);
+                double since = in.get<double>();
+                nodes.push_back(Node{item, nil, buckets[i].tail, in.get<uint32_t>(), buckets[i].priority, since});
+                if (buckets[i].tail == nil) buckets[i].head = n;
+                else nodes[buckets[i].tail].next = n;
+                buckets[i].tail = n;
+            }
+            set_filled(i, count > 0);
+            length += count;
+        }
+        max_length = in.get<uint64_t>();
+        in.get(entries);
+        in.get(removed);
+        in.get(total_wait);
+        in.get(area);
+        in.get(last_change);
+        in.get(stat_start);
+    }
+};
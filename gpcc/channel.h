@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+using namespace std;
+
+// Unbounded lock-free single-producer single-consumer queue. Items are stored in fixed-size chunks,
+// so the producer allocates only once per chunk and the consumer frees chunks it has drained
+template <typename T, size_t chunk_size = 256>
+class SpscQueue {
+private:
+    struct Chunk {
+        T items[chunk_size];
+        atomic<size_t> written = 0;
+        atomic<Chunk*> next = nullptr;
+    };
+
+    Chunk* head; // consumer side
+    size_t read = 0;
+    Chunk* tail; // producer side
+
+public:
+    SpscQueue(): head(new Chunk()), tail(head) {}
+    SpscQueue(const SpscQueue&) = delete;
+    ~SpscQueue() {
+        while (head != nullptr) { Chunk* next = head->next.load(); delete head; head = next; }
+    }
+
+    void push(const T& item) {
+        size_t w = tail->written.load(memory_order_relaxed);
+        if (w == chunk_size) {
+            Chunk* chunk = new Chunk();
+            tail->next.store(chunk, memory_order_release);
+            tail = chunk;
+            w = 0;
+        }
+        tail->items[w] = item;
+        tail->written.store(w + 1, memory_order_release);
+    }
+
+    bool pop(T& item) {
+        while (true) {
+            if (read < head->written.load(memory_order_acquire)) { item = head->items[read++]; return true; }
+            if (read < chunk_size) return false;
+            Chunk* next = head->next.load(memory_order_acquire);
+            if (next == nullptr) return false;
+            delete head;
+            head = next;
+            read = 0;
+        }
+    }
+};
@@ -0,0 +1,313 @@
+#include <fstream>
+#include <filesystem>
+#include <typeinfo>
+#include <cstring>
+#include "gpcc.h"
+#include "checkpoint.h"
+
+using namespace std;
+
+static const char magic[8] = {'G', 'P', 'C', 'C', 'C', 'K', 'P', '1'};
+
+CheckpointFile::CheckpointFile(const string& path): path(path), worker(&CheckpointFile::run, this) {}
+
+CheckpointFile::~CheckpointFile() {
+    {
+        lock_guard guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+void CheckpointFile::run() {
+    unique_lock guard(lock);
+    while (true) {
+        wake.wait(guard, [this]() { return has_pending || quit; });
+        if (!has_pending) return;
+        vector<char> image = move(pending);
+        has_pending = false;
+        writing = true;
+        guard.unlock();
+        string failure;
+        try { write(path, image); }
+        catch (const exception& e) { failure = e.what(); }
+        guard.lock();
+        writing = false;
+        if (!failure.empty()) error = failure;
+        wake.notify_all();
+    }
+}
+
+void CheckpointFile::post(vector<char> image) {
+    {
+        lock_guard guard(lock);
+        if (!error.empty()) throw runtime_error(exchange(error, ""));
+        pending = move(image);
+        has_pending = true;
+    }
+    wake.notify_all();
+}
+
+void CheckpointFile::flush() {
+    unique_lock guard(lock);
+    wake.wait(guard, [this]() { return !has_pending && !writing; });
+    if (!error.empty()) throw runtime_error(exchange(error, ""));
+}
+
+void CheckpointFile::write(const string& path, const vector<char>& image) {
+    string tmp = path + ".tmp";
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        out.write(image.data(), image.size());
+        out.flush();
+        if (!out) throw runtime_error("can not write checkpoint " + tmp);
+    }
+    error_code ec;
+    filesystem::rename(tmp, path, ec);
+    if (ec) throw runtime_error("can not replace checkpoint " + path + ": " + ec.message());
+}
+
+vector<char> CheckpointFile::read(const string& path) {
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in) throw runtime_error("can not open checkpoint " + path);
+    vector<char> image(size_t(in.tellg()));
+    in.seekg(0);
+    in.read(image.data(), image.size());
+    if (!in) throw runtime_error("can not read checkpoint " + path);
+    return image;
+}
+
+// the schedule is saved in heap order, so events with equal keys come out in the same order after a restore
+template <typename Q>
+static auto& container(Q& q) {
+    struct Access: Q { static auto& get(Q& q) { return q.*&Access::c; } };
+    return Access::get(q);
+}
+
+static void mix(uint64_t& h, const void* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) { h ^= static_cast<const unsigned char*>(data)[i]; h *= 1099511628211ull; } // FNV-1a
+}
+static void mix(uint64_t& h, const string& value) { mix(h, value.data(), value.size() + 1); }
+
+uint64_t Simulation::fingerprint() {
+    uint64_t h = 14695981039346656037ull;
+    for (auto& block : blocks) mix(h, typeid(*block).name());
+    for (auto& q : queues) mix(h, q.name);
+    for (auto& storage : storages) {
+        mix(h, storage.name);
+        size_t capacity = storage.data->get_capacity();
+        mix(h, &capacity, sizeof(capacity));
+    }
+    for (auto& table : tables) mix(h, table.name);
+    for (auto& group : groups) {
+        mix(h, group.name);
+        for (size_t m = 0; m < group.data->size(); ++m) {
+            size_t storage = group.data->storage(m);
+            mix(h, &storage, sizeof(storage));
+        }
+    }
+    size_t counts[] = {blocks.size(), queues.size(), storages.size(), gates.size(), tables.size(), monitors.size()};
+    mix(h, counts, sizeof(counts));
+    return h;
+}
+
+void Simulation::save_transaction(StateWriter& out, const Transaction& transaction) {
+    out.put(transaction.priority);
+    out.put(transaction.id);
+    out.put(transaction.family);
+    out.put(transaction.just_generated);
+    out.put(transaction.scaled);
+    out.put(transaction.timer);
+    out.put(transaction.selected);
+    out.put(transaction.mark);
+    out.put(transaction.perturbation);
+}
+
+Simulation::Transaction Simulation::load_transaction(StateReader& in) {
+    Transaction transaction(0, 0);
+    in.get(transaction.priority);
+    in.get(transaction.id);
+    in.get(transaction.family);
+    in.get(transaction.just_generated);
+    in.get(transaction.scaled);
+    in.get(transaction.timer);
+    in.get(transaction.selected);
+    in.get(transaction.mark);
+    in.get(transaction.perturbation);
+    return transaction;
+}
+
+void Simulation::save_spawn(StateWriter& out, const SpawnData& spawn) {
+    uint64_t id = UINT64_MAX; // nullptr
+    if (spawn.block != nullptr) {
+        auto it = block_ids.find(spawn.block);
+        if (it == block_ids.end()) throw SimulationException("a transaction is suspended in a coroutine: the state can not be saved");
+        id = it->second;
+    }
+    out.put(id);
+    save_transaction(out, spawn.transaction);
+}
+
+Simulation::SpawnData Simulation::load_spawn(StateReader& in) {
+    uint64_t id = in.get<uint64_t>();
+    if (id != UINT64_MAX && id >= blocks.size()) throw runtime_error("state image is corrupted");
+    Block* block = id == UINT64_MAX ? nullptr : blocks[id].get();
+    return SpawnData(load_transaction(in), block);
+}
+
+void Simulation::save_state(StateWriter& out) {
+    if (live_coroutines != nullptr) throw SimulationException("a transaction is suspended in a coroutine: the state can not be saved");
+    block_ids.clear();
+    for (size_t i = 0; i < blocks.size(); ++i) block_ids[blocks[i].get()] = i;
+
+    out.put(g_time);
+    out.put(g_transaction_id);
+    out.put(events);
+    out.put(stat_start);
+    out.put(reset_time);
+    out.put(warmup_done);
+    out.put(uint64_t(mser_check));
+    out.put(check_pending);
+    out.put(stopped);
+
+    auto& schedule = container(spawn_schedule);
+    out.put(uint64_t(schedule.size()));
+    for (auto& spawn : schedule) {
+        save_spawn(out, spawn.spawn_data);
+        out.put(spawn.time);
+    }
+
+    for (auto& q : queues) out.put(uint64_t(q.data));
+    for (auto& storage : storages) storage.data->save(out);
+    for (auto& block : blocks) block->save(out);
+    for (auto& table : tables) table.data.save(out);
+    for (auto* stats : {&q_stat, &storage_stat}) for (auto& stat : *stats) {
+        out.put(uint64_t(stat.max));
+        out.put(stat.m);
+        out.put(stat.empty);
+        out.put(stat.full);
+        stat.m_bm.save(out);
+        stat.empty_bm.save(out);
+        stat.full_bm.save(out);
+        stat.length.save(out);
+        out.put(stat.dm);
+    }
+    for (auto& monitor : monitors) monitor.mser.save(out);
+
+    // tickets keep their slots and generations, the timers in the schedule refer to them
+    out.put(uint64_t(tickets.size()));
+    for (auto& ticket : tickets) {
+        out.put(ticket.generation);
+        out.put(ticket.node);
+        out.put(ticket.timed);
+        out.put(uint64_t(ticket.gate != nullptr ? block_ids.at(ticket.gate) : UINT64_MAX));
+        out.put(uint64_t(ticket.storage));
+        out.put(uint64_t(ticket.renege != nullptr ? block_ids.at(ticket.renege) : UINT64_MAX));
+    }
+    out.put(free_ticket);
+    out.put(stale_timers);
+    block_ids.clear();
+}
+
+void Simulation::load_state(StateReader& in) {
+    in.get(g_time);
+    in.get(g_transaction_id);
+    in.get(events);
+    in.get(stat_start);
+    in.get(reset_time);
+    in.get(warmup_done);
+    mser_check = in.get<uint64_t>();
+    in.get(check_pending);
+    in.get(stopped);
+
+    auto& schedule = container(spawn_schedule);
+    schedule.clear();
+    uint64_t n = in.get<uint64_t>();
+    for (uint64_t i = 0; i < n; ++i) {
+        SpawnData spawn = load_spawn(in);
+        schedule.emplace_back(spawn, in.get<double>());
+    }
+
+    for (auto& q : queues) q.data = in.get<uint64_t>();
+    for (auto& storage : storages) storage.data->load(in);
+    for (auto& block : blocks) block->load(in);
+    for (auto& table : tables) table.data.load(in);
+    for (auto* stats : {&q_stat, &storage_stat}) for (auto& stat : *stats) {
+        stat.max = in.get<uint64_t>();
+        in.get(stat.m);
+        in.get(stat.empty);
+        in.get(stat.full);
+        stat.m_bm.load(in);
+        stat.empty_bm.load(in);
+        stat.full_bm.load(in);
+        stat.length.load(in);
+        in.get(stat.dm);
+    }
+    for (auto& monitor : monitors) monitor.mser.load(in);
+
+    tickets.resize(in.get<uint64_t>());
+    auto block = [&](uint64_t id) -> Block* {
+        if (id != UINT64_MAX && id >= blocks.size()) throw runtime_error("state image is corrupted");
+        return id == UINT64_MAX ? nullptr : blocks[id].get();
+    };
+    for (auto& ticket : tickets) {
+        in.get(ticket.generation);
+        in.get(ticket.node);
+        in.get(ticket.timed);
+        Block* gate = block(in.get<uint64_t>());
+        ticket.gate = dynamic_cast<GateBlock*>(gate);
+        if (gate != nullptr && ticket.gate == nullptr) throw runtime_error("state image is corrupted");
+        ticket.storage = in.get<uint64_t>();
+        ticket.renege = block(in.get<uint64_t>());
+    }
+    in.get(free_ticket);
+    in.get(stale_timers);
+    // the chains were rebuilt with new nodes
+    for (size_t i = 0; i < storages.size(); ++i)
+        storages[i].data->get_chain().visit([&](uint32_t node, uint32_t ticket) { if (ticket != no_ticket) tickets.at(ticket).node = node; });
+    for (auto* gate : gates)
+        gate->get_chain().visit([&](uint32_t node, uint32_t ticket) { if (ticket != no_ticket) tickets.at(ticket).node = node; });
+}
+
+vector<char> Simulation::image() {
+    StateWriter out;
+    for (char c : magic) out.put(c);
+    out.put(fingerprint());
+    save_state(out);
+    return move(out.bytes());
+}
+
+void Simulation::save_checkpoint(const string& path) {
+    if (checkpoint_file) checkpoint_file->flush(); // an older periodic image must not land after this one
+    try { CheckpointFile::write(path, image()); }
+    catch (const SimulationException&) { throw; }
+    catch (const runtime_error& e) { throw SimulationException(e.what()); }
+}
+
+// on failure the simulation is left half-loaded and must be discarded
+void Simulation::load_image(const vector<char>& data) {
+    StateReader in(data);
+    char header[sizeof(magic)];
+    for (char& c : header) in.get(c);
+    if (memcmp(header, magic, sizeof(magic)) != 0) throw runtime_error("not a checkpoint");
+    if (in.get<uint64_t>() != fingerprint()) throw runtime_error("checkpoint of a different model");
+    load_state(in);
+    if (!in.done()) throw runtime_error("state image is corrupted");
+    if (checkpoint_file) next_checkpoint = g_time + checkpoint_interval;
+    if (live) next_publish = events;
+}
+
+void Simulation::restore(const string& path) {
+    try { load_image(CheckpointFile::read(path)); }
+    catch (const runtime_error& e) { throw SimulationException("checkpoint " + path + ": " + e.what()); }
+}
+
+void Simulation::restore_image(const vector<char>& image) {
+    try { load_image(image); }
+    catch (const runtime_error& e) { throw SimulationException(string("state image: ") + e.what()); }
+}
+
+void Simulation::reseed(uint64_t seed) {
+    for (size_t i = 0; i < blocks.size(); ++i) blocks[i]->reseed(stream_seed(to_string(i), seed));
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+// Writer of checkpoint files on a background thread: the event loop only hands over a serialized image.
+// A file is written next to path and renamed over it, so a crash during the write leaves the previous checkpoint intact.
+// If images come faster than the disk takes them, only the newest pending one is written
+class CheckpointFile {
+private:
+    string path;
+    mutex lock;
+    condition_variable wake;
+    vector<char> pending;
+    bool has_pending = false;
+    bool writing = false;
+    bool quit = false;
+    string error; // of the last failed write, reported by the next post() or flush()
+    thread worker;
+
+    void run();
+
+public:
+    CheckpointFile(const string& path);
+    CheckpointFile(const CheckpointFile&) = delete;
+    ~CheckpointFile(); // writes what is pending
+
+    void post(vector<char> image);
+    void flush(); // waits until every posted image is written
+
+    static void write(const string& path, const vector<char>& image); // throws runtime_error on I/O errors
+    static vector<char> read(const string& path);
+};
@@ -0,0 +1,150 @@
+#pragma once
+#include <coroutine>
+#include <functional>
+#include "simulation.h"
+
+using namespace std;
+
+// Custom blocks written as coroutines:
+//
+//     Simulation::Coroutine service(Simulation::Context ctx) {
+//         co_await ctx.enter(rab1);
+//         co_await ctx.delay(ctx.transaction_priority() * 2.0);
+//         ctx.leave(rab1);
+//         co_await ctx.wait_until([&]() { return !sim->is_storage_full(rab2); });
+//     }
+//
+// Every transaction that reaches the block runs its own instance of the coroutine and moves to the next block
+// when the coroutine returns. While it is suspended the transaction is parked in the schedule, in a storage
+// delay chain or in the list of condition waits and is resumed from there by the scheduler.
+// Frames come from the simulation's FramePool, so after warm-up a transaction passing the block does not allocate.
+
+class Simulation::Coroutine {
+public:
+    class promise_type;
+
+private:
+    promise_type* promise;
+    friend class CoroutineBlock;
+
+public:
+    Coroutine(promise_type* promise): promise(promise) {}
+};
+
+class Simulation::Context {
+private:
+    Simulation& sim;
+    Block* exit;                      // where the transaction goes when the coroutine returns
+    Coroutine::promise_type* promise = nullptr;
+
+    friend class Coroutine::promise_type;
+    friend class CoroutineBlock;
+
+    Context(Simulation& sim, Block* exit): sim(sim), exit(exit) {}
+
+public:
+    struct Delay {
+        Coroutine::promise_type& promise;
+        double time;
+
+        bool await_ready() { return false; }
+        void await_suspend(coroutine_handle<>);
+        void await_resume() {}
+    };
+
+    struct Enter {
+        Coroutine::promise_type& promise;
+        size_t storage;
+
+        bool await_ready() { return false; }
+        bool await_suspend(coroutine_handle<>); // false: entered at once, no suspension
+        void await_resume() {}
+    };
+
+    template <typename F>
+    struct WaitUntil {
+        Coroutine::promise_type& promise;
+        F cond; // stays in the frame while suspended
+
+        bool await_ready() { return cond(); }
+        void await_suspend(coroutine_handle<>);
+        void await_resume() {}
+
+        static bool check(void* cond) { return (*static_cast<F*>(cond))(); }
+    };
+
+    Simulation& simulation() { return sim; }
+    double time() { return sim.g_time; }
+    uint64_t transaction_id();
+    priority_t transaction_priority();
+    void set_priority(priority_t priority);
+
+    Delay delay(double time) { return Delay{*promise, time}; }
+    Enter enter(size_t storage) { return Enter{*promise, storage}; }
+    void leave(size_t storage);
+    void queue(size_t q);
+    void depart(size_t q);
+    template <typename F>
+    WaitUntil<F> wait_until(F cond) { return WaitUntil<F>{*promise, move(cond)}; } // checked with gates at the end of every tick; all waiters whose condition holds resume together
+};
+
+class Simulation::Coroutine::promise_type: public Simulation::Block, public Simulation::CoroutineLink {
+private:
+    Transaction* current = nullptr; // valid while the coroutine runs
+
+    friend class Context;
+
+    template <typename... Args>
+    static Context& find_context(Context& ctx, Args&...) { return ctx; }
+    template <typename T, typename... Args>
+    static Context& find_context(T&, Args&... args) { return find_context(args...); }
+
+public:
+    promise_type(Context& ctx);
+    template <typename... Args>
+    promise_type(Args&... args): promise_type(find_context(args...)) {} // coroutine lambdas and extra arguments
+    ~promise_type();
+
+    // the frame is preceded by a header with its pool so that it can be freed without the context
+    static constexpr size_t header = alignof(max_align_t);
+    template <typename... Args>
+    static void* operator new(size_t size, Args&... args) {
+        Context& ctx = find_context(args...);
+        char* ptr = static_cast<char*>(ctx.sim.frames.allocate(size + header));
+        *reinterpret_cast<FramePool**>(ptr) = &ctx.sim.frames;
+        return ptr + header;
+    }
+    static void operator delete(void* ptr, size_t size);
+
+    Coroutine get_return_object() { return Coroutine(this); }
+    suspend_always initial_suspend() noexcept { return {}; }
+    suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { throw; }
+
+    void schedule(double delay);
+    bool try_enter(size_t storage);
+    void wait(bool (*check)(void*), void* cond);
+
+    virtual Block* advance(Transaction&) override; // resumes the coroutine
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
+
+template <typename F>
+void Simulation::Context::WaitUntil<F>::await_suspend(coroutine_handle<>) { promise.wait(&check, &cond); }
+
+class Simulation::CoroutineBlock: public Block {
+private:
+    function<Coroutine(Context)> body;
+public:
+    CoroutineBlock(Simulation& s, Block* next, function<Coroutine(Context)> body);
+    virtual Block* advance(Transaction&) override;
+    virtual ~CoroutineBlock() {};
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
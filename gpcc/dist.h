@@ -1,26 +1,100 @@
 #pragma once
 #include <random>
 #include <memory>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <sstream>
+#include "state.h"
 
 using namespace std;
 
+// minstd_rand that can be switched to antithetic output: x -> min + max - x, which turns a uniform U into 1 - U
+// (up to the resolution of the engine). Distributions that invert a CDF then give negatively correlated samples
+class stream_engine {
+private:
+    minstd_rand engine;
+    bool antithetic = false;
+public:
+    using result_type = minstd_rand::result_type;
+    static constexpr result_type min() { return minstd_rand::min(); }
+    static constexpr result_type max() { return minstd_rand::max(); }
+
+    stream_engine(const minstd_rand& engine): engine(engine) {}
+    result_type operator()() { result_type x = engine(); return antithetic ? min() + max() - x : x; }
+    void seed(result_type value) { engine.seed(value); }
+    void set_antithetic(bool value) { antithetic = value; }
+
+    // the engine in its standard text form
+    void save(StateWriter& out) const {
+        ostringstream text;
+        text << engine;
+        out.put_string(text.str());
+        out.put(antithetic);
+    }
+    void load(StateReader& in) {
+        istringstream text(in.get_string());
+        if (!(text >> engine)) throw runtime_error("state image is corrupted");
+        in.get(antithetic);
+    }
+};
+
+// seed of a named stream in a given replication. Depends on nothing else, so streams stay put when the model changes
+inline uint64_t stream_seed(const string& name, uint64_t replication) {
+    uint64_t h = 14695981039346656037ull; // FNV-1a
+    for (char c : name) { h ^= (unsigned char)c; h *= 1099511628211ull; }
+    h ^= replication * 0x9e3779b97f4a7c15ull;
+    // splitmix64 finalizer
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
 class distribution {
 public:
-    virtual double operator()(minstd_rand&) { return 42; }
+    virtual double operator()(stream_engine&) { return 42; }
+    virtual double lower_bound() { return 0; } // no sample is smaller. Used as lookahead by parallel execution
+    virtual bool has_quantile() { return false; }
+    virtual double quantile(double) { return 42; } // inverse CDF, for engines that draw uniforms themselves
+    virtual void quantiles(const double* u, double* x, size_t n) { for (size_t i = 0; i < n; ++i) x[i] = quantile(u[i]); }
 };
 class exponential_distribution_wrapper: public exponential_distribution<>, public distribution {
 public:
     using exponential_distribution::exponential_distribution; // expose needed constructors
-    virtual double operator()(minstd_rand& engine) override { return exponential_distribution::operator()(engine); }
+    virtual double operator()(stream_engine& engine) override { return exponential_distribution::operator()(engine); }
+    virtual bool has_quantile() override { return true; }
+    virtual double quantile(double u) override { return -log1p(-u) / lambda(); }
+    virtual void quantiles(const double* u, double* x, size_t n) override {
+        double inv = 1 / lambda();
+        for (size_t i = 0; i < n; ++i) x[i] = -log1p(-u[i]) * inv;
+    }
+};
+class uniform_real_distribution_wrapper: public uniform_real_distribution<>, public distribution {
+public:
+    using uniform_real_distribution::uniform_real_distribution;
+    virtual double operator()(stream_engine& engine) override { return uniform_real_distribution::operator()(engine); }
+    virtual double lower_bound() override { return a(); }
+    virtual bool has_quantile() override { return true; }
+    virtual double quantile(double u) override { return a() + (b() - a()) * u; }
+    virtual void quantiles(const double* u, double* x, size_t n) override {
+        double from = a(), width = b() - a();
+        for (size_t i = 0; i < n; ++i) x[i] = from + width * u[i];
+    }
 };
 // class normal_distribution_wrapper: public normal_distribution<>, distribution {};
 // and so on
 
 class RandomGenerator {
 private:
-    minstd_rand engine;
+    stream_engine engine;
     shared_ptr<distribution> dist; // smart ptr to avoid slicing
 public:
     RandomGenerator(const minstd_rand& engine, shared_ptr<distribution> dist): engine(engine), dist(dist) {}
     double operator()() { return (*dist)(engine); }
+    double lower_bound() { return dist->lower_bound(); }
+    void seed(uint64_t value) { engine.seed(value % (minstd_rand::modulus - 1) + 1); } // minstd_rand seeds must be nonzero mod m
+    void set_antithetic(bool value) { engine.set_antithetic(value); }
+    const shared_ptr<distribution>& get_distribution() const { return dist; }
+    void save(StateWriter& out) const { engine.save(out); } // distributions are stateless
+    void load(StateReader& in) { engine.load(in); }
 };
\ No newline at end of file
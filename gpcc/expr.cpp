@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "gpcc.h"
+
+using namespace std;
+
+Simulation::Expr::Expr(op_t op, size_t index) { code.push_back(Instr{op, {}}); code.back().index = index; }
+Simulation::Expr::Expr(double value) { code.push_back(Instr{CONST, {}}); code.back().value = value; }
+Simulation::Expr::Expr(int value): Expr(double(value)) {}
+Simulation::Expr::Expr(RandomGenerator rng): Expr(RAND, 0) { rngs.push_back(move(rng)); }
+
+Simulation::Expr Simulation::Expr::q_length(size_t queue) { return Expr(Q, queue); }
+Simulation::Expr Simulation::Expr::storage_content(size_t storage) { return Expr(S, storage); }
+Simulation::Expr Simulation::Expr::clock() { return Expr(C1, 0); }
+Simulation::Expr Simulation::Expr::priority() { return Expr(PR, 0); }
+
+static double apply(Simulation::Expr::op_t op, double l, double r) {
+    using E = Simulation::Expr;
+    switch (op) {
+        case E::ADD: return l + r;
+        case E::SUB: return l - r;
+        case E::MUL: return l * r;
+        case E::DIV: return l / r;
+        case E::MIN: return min(l, r);
+        case E::MAX: return max(l, r);
+        case E::LT: return l < r;
+        case E::LE: return l <= r;
+        case E::GT: return l > r;
+        case E::GE: return l >= r;
+        case E::EQ: return l == r;
+        case E::NE: return l != r;
+        default: return 0; // must be unreachable
+    }
+}
+
+bool Simulation::Expr::constant() const { return code.size() == 1 && code[0].op == CONST; }
+
+Simulation::Expr Simulation::Expr::unary(op_t op, Expr arg) {
+    if (arg.constant()) return Expr(-arg.code[0].value);
+    arg.code.push_back(Instr{op, {}});
+    return arg;
+}
+
+Simulation::Expr Simulation::Expr::binary(op_t op, Expr l, Expr r) {
+    if (r.depth + 1 > max_depth) throw SimulationException("expression is too deep");
+    if (l.constant() && r.constant()) return Expr(apply(op, l.code[0].value, r.code[0].value));
+
+    l.code.reserve(l.code.size() + r.code.size() + 1);
+    for (auto instr : r.code) {
+        if (instr.op == RAND) instr.index += l.rngs.size();
+        l.code.push_back(instr);
+    }
+    move(r.rngs.begin(), r.rngs.end(), back_inserter(l.rngs));
+    l.code.push_back(Instr{op, {}});
+    l.depth = max(l.depth, r.depth + 1);
+    return l;
+}
+
+double Simulation::Expr::eval(Simulation& sim) {
+    if (code.size() == 1 && code[0].op == RAND) return rngs[0](); // plain ADVANCE and GENERATE
+    double stack[max_depth];
+    size_t top = 0;
+    for (auto& instr : code) {
+        switch (instr.op) {
+            case CONST: stack[top++] = instr.value; break;
+            case RAND: stack[top++] = rngs[instr.index](); break;
+            case Q: stack[top++] = sim.queues[instr.index].data; break;
+            case S: stack[top++] = sim.storages[instr.index].data->get_current(); break;
+            case C1: stack[top++] = sim.g_time; break;
+            case PR: stack[top++] = sim.active != nullptr ? sim.active->priority : 0; break;
+            case NEG: stack[top - 1] = -stack[top - 1]; break;
+            default: --top; stack[top - 1] = apply(instr.op, stack[top - 1], stack[top]);
+        }
+    }
+    return stack[0];
+}
+
+void Simulation::Expr::save(StateWriter& out) const {
+    for (auto& rng : rngs) rng.save(out);
+}
+
+void Simulation::Expr::load(StateReader& in) {
+    for (auto& rng : rngs) rng.load(in);
+}
+
+void Simulation::Expr::reseed(uint64_t seed) {
+    for (size_t i = 0; i < rngs.size(); ++i) rngs[i].seed(stream_seed(to_string(i), seed));
+}
+
+double Simulation::Expr::lower_bound() const {
+    // intervals [lo, hi] on the same stack machine: attributes and the clock are in [0, inf), samples are not below
+    // the lower bound of their distribution. Only the result is clamped to 0, any subterm may go negative
+    constexpr double inf = numeric_limits<double>::infinity();
+    struct Range { double lo, hi; };
+    auto mul = [](double a, double b) { return a == 0 || b == 0 ? 0 : a * b; }; // 0 * inf: the attribute is finite
+    Range stack[max_depth];
+    size_t top = 0;
+    for (auto& instr : code) {
+        switch (instr.op) {
+            case CONST: stack[top++] = {instr.value, instr.value}; break;
+            case RAND: stack[top++] = {const_cast<RandomGenerator&>(rngs[instr.index]).lower_bound(), inf}; break;
+            case Q: case S: case C1: case PR: stack[top++] = {0, inf}; break;
+            case NEG: stack[top - 1] = {-stack[top - 1].hi, -stack[top - 1].lo}; break;
+            default: {
+                Range r = stack[--top], &l = stack[top - 1];
+                switch (instr.op) {
+                    case ADD: l = {l.lo + r.lo, l.hi + r.hi}; break;
+                    case SUB: l = {l.lo - r.hi, l.hi - r.lo}; break;
+                    case MUL: {
+                        double p[] = {mul(l.lo, r.lo), mul(l.lo, r.hi), mul(l.hi, r.lo), mul(l.hi, r.hi)};
+                        l = {*min_element(p, p + 4), *max_element(p, p + 4)};
+                        break;
+                    }
+                    case DIV: {
+                        if (r.lo <= 0 && r.hi >= 0) { l = {-inf, inf}; break; }
+                        double p[] = {l.lo / r.lo, l.lo / r.hi, l.hi / r.lo, l.hi / r.hi};
+                        if (any_of(p, p + 4, [](double x) { return isnan(x); })) l = {-inf, inf};
+                        else l = {*min_element(p, p + 4), *max_element(p, p + 4)};
+                        break;
+                    }
+                    case MIN: l = {std::min(l.lo, r.lo), std::min(l.hi, r.hi)}; break;
+                    case MAX: l = {std::max(l.lo, r.lo), std::max(l.hi, r.hi)}; break;
+                    default: l = {0, 1}; // comparisons
+                }
+                if (isnan(l.lo)) l.lo = -inf; // inf - inf
+                if (isnan(l.hi)) l.hi = inf;
+            }
+        }
+    }
+    return std::max(stack[0].lo, 0.0);
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "dist.h"
+#include "simulation.h"
+
+using namespace std;
+
+// Numeric expression over standard numerical attributes, compiled to flat bytecode for a stack machine:
+//
+//     Expr service = 2.0 + 0.5 * builder.q_length("qrab1");
+//     builder.add_gate(LogicNode(builder.test(builder.q_length("qrab3") > 10)));
+//
+// Operands are constants, samples of a RandomGenerator, queue length, storage content, the clock (C1) and the
+// priority of the active transaction (PR). Comparisons give 1 or 0. Constant subexpressions are folded.
+// Evaluation uses a fixed array on the stack, so it never allocates
+class Simulation::Expr {
+public:
+    enum op_t: uint8_t {CONST, RAND, Q, S, C1, PR, ADD, SUB, MUL, DIV, NEG, MIN, MAX, LT, LE, GT, GE, EQ, NE};
+    static constexpr size_t max_depth = 32; // of the evaluation stack
+
+private:
+    struct Instr {
+        op_t op;
+        union {
+            double value; // CONST
+            size_t index; // RAND: index in rngs; Q, S: entity
+        };
+    };
+
+    vector<Instr> code;
+    vector<RandomGenerator> rngs;
+    size_t depth = 1;
+
+    Expr(op_t op, size_t index);
+    static Expr unary(op_t op, Expr arg);
+    static Expr binary(op_t op, Expr l, Expr r);
+    bool constant() const;
+
+    friend class SimBuilder; // seeds rngs for named streams, collects entities read
+    friend class LaneSimulation;
+public:
+    Expr(double value); // CONST
+    Expr(int value);
+    Expr(RandomGenerator rng); // every evaluation draws a new sample. Copies of an Expr have copies of its generators
+
+    static Expr q_length(size_t queue);
+    static Expr storage_content(size_t storage);
+    static Expr clock();
+    static Expr priority(); // of the transaction being served; 0 outside of a transaction
+
+    double eval(Simulation& sim);
+    double lower_bound() const; // no value is smaller; 0 if unknown. Used as lookahead of ADVANCE
+    void save(StateWriter& out) const; // states of the generators
+    void load(StateReader& in);
+    void reseed(uint64_t seed); // generator i moves to stream_seed(i, seed)
+
+    friend Expr operator+(Expr l, Expr r) { return binary(ADD, move(l), move(r)); }
+    friend Expr operator-(Expr l, Expr r) { return binary(SUB, move(l), move(r)); }
+    friend Expr operator*(Expr l, Expr r) { return binary(MUL, move(l), move(r)); }
+    friend Expr operator/(Expr l, Expr r) { return binary(DIV, move(l), move(r)); }
+    friend Expr operator-(Expr arg) { return unary(NEG, move(arg)); }
+    friend Expr operator<(Expr l, Expr r) { return binary(LT, move(l), move(r)); }
+    friend Expr operator<=(Expr l, Expr r) { return binary(LE, move(l), move(r)); }
+    friend Expr operator>(Expr l, Expr r) { return binary(GT, move(l), move(r)); }
+    friend Expr operator>=(Expr l, Expr r) { return binary(GE, move(l), move(r)); }
+    friend Expr operator==(Expr l, Expr r) { return binary(EQ, move(l), move(r)); }
+    friend Expr operator!=(Expr l, Expr r) { return binary(NE, move(l), move(r)); }
+    friend Expr min(Expr l, Expr r) { return binary(MIN, move(l), move(r)); }
+    friend Expr max(Expr l, Expr r) { return binary(MAX, move(l), move(r)); }
+};
+
+using Expr = Simulation::Expr;
@@ -0,0 +1,145 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <bit>
+#include <algorithm>
+#include "state.h"
+
+using namespace std;
+
+// Families with members held at an ASSEMBLE, GATHER or MATCH block. Families are keyed by id in an open-addressing
+// table (linear probing with backward-shift deletion, so there are no tombstones); held members form intrusive FIFO
+// lists of pooled nodes. An entry is 24 bytes, and once the pool and the table have grown holding a member does not
+// allocate. Slot numbers stay valid until the next insert or erase
+template <typename T>
+class FamilyTable {
+private:
+    static constexpr uint64_t free_slot = UINT64_MAX;
+    static constexpr uint32_t nil = UINT32_MAX;
+
+    struct Slot {
+        uint64_t family = free_slot;
+        uint32_t count = 0; // block specific: members arrived so far
+        uint32_t head = nil, tail = nil;
+    };
+    struct Node {
+        T item;
+        uint32_t next;
+    };
+
+    vector<Slot> slots = vector<Slot>(16);
+    size_t used = 0;
+    int shift = 60; // 64 - log2(slots.size())
+    vector<Node> nodes;
+    uint32_t free_node = nil;
+    size_t held = 0;
+
+    size_t home(uint64_t family) const { return family * 0x9e3779b97f4a7c15ull >> shift; } // Fibonacci hashing
+    size_t mask() const { return slots.size() - 1; }
+
+    void grow() {
+        vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        --shift;
+        for (auto& slot : old) if (slot.family != free_slot) {
+            size_t i = home(slot.family);
+            while (slots[i].family != free_slot) i = (i + 1) & mask();
+            slots[i] = slot;
+        }
+    }
+
+public:
+    static constexpr size_t npos = -1;
+
+    size_t find(uint64_t family) const {
+        for (size_t i = home(family);; i = (i + 1) & mask()) {
+            if (slots[i].family == family) return i;
+            if (slots[i].family == free_slot) return npos;
+        }
+    }
+
+    size_t insert(uint64_t family) { // the family must not be present
+        if ((used + 1) * 4 > slots.size() * 3) grow();
+        size_t i = home(family);
+        while (slots[i].family != free_slot) i = (i + 1) & mask();
+        slots[i] = Slot{family};
+        ++used;
+        return i;
+    }
+
+    void erase(size_t slot) { // members still held are dropped
+        while (has_members(slot)) pop(slot);
+        // shift back the entries of the probe run that can move closer to their home
+        size_t i = slot;
+        for (size_t j = (i + 1) & mask(); slots[j].family != free_slot; j = (j + 1) & mask()) {
+            if (((j - home(slots[j].family)) & mask()) >= ((j - i) & mask())) {
+                slots[i] = slots[j];
+                i = j;
+            }
+        }
+        slots[i] = Slot{};
+        --used;
+    }
+
+    uint32_t& count(size_t slot) { return slots[slot].count; }
+
+    void push(size_t slot, const T& item) {
+        uint32_t n;
+        if (free_node != nil) { n = free_node; free_node = nodes[n].next; nodes[n] = Node{item, nil}; }
+        else { n = nodes.size(); nodes.push_back(Node{item, nil}); }
+        Slot& s = slots[slot];
+        if (s.tail == nil) s.head = n;
+        else nodes[s.tail].next = n;
+        s.tail = n;
+        ++held;
+    }
+
+    bool has_members(size_t slot) const { return slots[slot].head != nil; }
+
+    T pop(size_t slot) {
+        Slot& s = slots[slot];
+        uint32_t n = s.head;
+        s.head = nodes[n].next;
+        if (s.head == nil) s.tail = nil;
+        nodes[n].next = free_node;
+        free_node = n;
+        --held;
+        return nodes[n].item;
+    }
+
+    size_t families() const { return used; }
+    size_t members() const { return held; }
+
+    template <typename F>
+    void save(StateWriter& out, F save_item) const {
+        out.put(uint64_t(used));
+        for (auto& slot : slots) {
+            if (slot.family == free_slot) continue;
+            out.put(slot.family);
+            out.put(slot.count);
+            uint64_t n = 0;
+            for (uint32_t k = slot.head; k != nil; k = nodes[k].next) ++n;
+            out.put(n);
+            for (uint32_t k = slot.head; k != nil; k = nodes[k].next) save_item(out, nodes[k].item);
+        }
+    }
+
+    template <typename F>
+    void load(StateReader& in, F load_item) {
+        uint64_t n = in.get<uint64_t>();
+        slots.assign(max<size_t>(16, bit_ceil(n * 4 / 3 + 1)), Slot{});
+        shift = 64 - countr_zero(slots.size());
+        used = 0;
+        nodes.clear();
+        free_node = nil;
+        held = 0;
+        for (uint64_t k = 0; k < n; ++k) {
+            uint64_t family = in.get<uint64_t>();
+            if (family == free_slot || find(family) != npos) throw runtime_error("state image is corrupted");
+            size_t slot = insert(family);
+            in.get(slots[slot].count);
+            uint64_t members = in.get<uint64_t>();
+            for (uint64_t m = 0; m < members; ++m) push(slot, load_item(in));
+        }
+    }
+};
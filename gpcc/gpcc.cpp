@@ -2,7 +2,10 @@
 #include <functional> 
 #include <memory>
 #include <iostream>
+#include <sstream>
 #include "gpcc.h"
+#include "checkpoint.h"
+#include "live.h"
 
 using namespace std;
 
@@ -13,14 +16,34 @@ Simulation::QueueBlock::QueueBlock(Simulation& s, Block* next, size_t q_index):
 Simulation::DepartBlock::DepartBlock(Simulation& s, Block* next, size_t q_index): Block(s, next), q_index(q_index) {}
 Simulation::EnterBlock::EnterBlock(Simulation& s, Block* next, size_t storage_index): Block(s, next), storage_index(storage_index) {}
 Simulation::LeaveBlock::LeaveBlock(Simulation& s, Block* next, size_t storage_index): Block(s, next), storage_index(storage_index) {}
-Simulation::GenBlock::GenBlock(Simulation& s, Block* next, priority_t priority, RandomGenerator rng): Block(s, next), rng(rng) {}
-Simulation::AdvanceBlock::AdvanceBlock(Simulation& s, Block* next, RandomGenerator rng): Block(s, next), rng(rng) {}
+Simulation::GenBlock::GenBlock(Simulation& s, Block* next, priority_t priority, Expr interval): Block(s, next), priority(priority), interval(move(interval)) {}
+Simulation::GenBlock::GenBlock(Simulation& s, Block* next, priority_t priority, unique_ptr<TraceReader> trace): Block(s, next), priority(priority), interval(0.0), trace(move(trace)) {}
+Simulation::GenBlock::GenBlock(Simulation& s, Block* next, priority_t priority, Expr unit, RateTable rates):
+    Block(s, next), priority(priority), interval(move(unit)), rates(make_unique<RateTable>(move(rates))) {}
+Simulation::AdvanceBlock::AdvanceBlock(Simulation& s, Block* next, Expr delay): Block(s, next), delay(move(delay)) {}
 Simulation::GateBlock::GateBlock(Simulation& s, Block* next, LogicNode expr): Block(s, next), expr(move(expr)) {}
 Simulation::TransferBlock_imm::TransferBlock_imm(Simulation& s, Block* next, size_t index): Block(s, next), index(index) {}
 Simulation::TransferBlock_expr::TransferBlock_expr(Simulation& s, Block* next, size_t alt_index, LogicNode expr): Block(s, next), alt_index(alt_index), expr(move(expr)) {}
 Simulation::TransferBlock_prob::TransferBlock_prob(Simulation& s, Block* next, size_t alt_index, double prob, int seed): Block(s, next), alt_index(alt_index), prob(prob) { if (seed) gen.seed(seed); }
 Simulation::DebugBlock::DebugBlock(Simulation& s, Block* next, const string& debug_message): Block(s, next), debug_message(debug_message) {}
 Simulation::TerminateBlock::TerminateBlock(Simulation& sim): Block(sim, nullptr) {}
+Simulation::CoroutineBlock::CoroutineBlock(Simulation& s, Block* next, function<Coroutine(Context)> body): Block(s, next), body(move(body)) {}
+Simulation::MarkBlock::MarkBlock(Simulation& s, Block* next): Block(s, next) {}
+Simulation::TabulateBlock::TabulateBlock(Simulation& s, Block* next, size_t table, function<double()> value): Block(s, next), table(table), value(move(value)) {}
+Simulation::SplitBlock::SplitBlock(Simulation& s, Block* next, size_t count, size_t index): Block(s, next), count(count), index(index) {}
+Simulation::AssembleBlock::AssembleBlock(Simulation& s, Block* next, size_t count): Block(s, next), count(count) {}
+Simulation::GatherBlock::GatherBlock(Simulation& s, Block* next, size_t count): Block(s, next), count(count) {}
+Simulation::MatchBlock::MatchBlock(Simulation& s, Block* next, size_t index): Block(s, next), index(index) {}
+Simulation::FlowBlock::FlowBlock(Simulation& s, size_t storage_index, size_t q_index, double rate, double holding, double step, bool fluid):
+    Block(s, nullptr), storage_index(storage_index), q_index(q_index), rate(rate), step(step), leave_prob(step / holding), fluid(fluid) {}
+Simulation::SelectBlock::SelectBlock(Simulation& s, Block* next, size_t group, StorageGroup::policy_t policy, size_t alt_index):
+    Block(s, next), group(group), policy(policy), alt_index(alt_index) {}
+Simulation::EnterBlock_renege::EnterBlock_renege(Simulation& s, Block* next, size_t storage_index, Expr patience, size_t renege_index):
+    Block(s, next), storage_index(storage_index), patience(move(patience)), renege_index(renege_index) {}
+Simulation::GateBlock_renege::GateBlock_renege(Simulation& s, Block* next, LogicNode expr, Expr patience, size_t renege_index):
+    GateBlock(s, next, move(expr)), patience(move(patience)), renege_index(renege_index) {}
+Simulation::InterruptBlock::InterruptBlock(Simulation& s, Block* next, size_t storage_index): Block(s, next), storage_index(storage_index) {}
+Simulation::FusedBlock::FusedBlock(Simulation& s, Block* next, vector<Op> ops): Block(s, next), ops(move(ops)) {}
 
 /*
 Simulation::Block::~Block() {}
@@ -50,55 +73,295 @@ string Simulation::TransferBlock_expr::name() { return "transfer_expr"; }
 string Simulation::TransferBlock_prob::name() { return "transfer_prob"; }
 string Simulation::DebugBlock::name() { return "debug"; }
 string Simulation::TerminateBlock::name() { return "terminate"; }
+string Simulation::CoroutineBlock::name() { return "coroutine"; }
+string Simulation::Coroutine::promise_type::name() { return "coroutine (resume)"; }
+string Simulation::MarkBlock::name() { return "mark"; }
+string Simulation::TabulateBlock::name() { return "tabulate"; }
+string Simulation::SplitBlock::name() { return "split"; }
+string Simulation::AssembleBlock::name() { return "assemble"; }
+string Simulation::GatherBlock::name() { return "gather"; }
+string Simulation::MatchBlock::name() { return "match"; }
+string Simulation::FlowBlock::name() { return "flow"; }
+string Simulation::SelectBlock::name() { return "select"; }
+string Simulation::EnterBlock_renege::name() { return "enter (renege)"; }
+string Simulation::GateBlock_renege::name() { return "gate (renege)"; }
+string Simulation::InterruptBlock::name() { return "interrupt"; }
+string Simulation::FusedBlock::name() { return "fused (" + to_string(ops.size()) + " blocks)"; }
 #endif
 
-Simulation::Block* Simulation::QueueBlock::advance(Transaction&) {
+Simulation::Block* Simulation::QueueBlock::advance(Transaction& transaction) {
     ++sim.queues[q_index].data;
+    sim.ipa_arrive(sim.q_stat[q_index], transaction);
     return next;
 }
 
-Simulation::Block* Simulation::DepartBlock::advance(Transaction&) {
+Simulation::Block* Simulation::DepartBlock::advance(Transaction& transaction) {
     if (sim.queues[q_index].data == 0) throw SimulationException("Attempted to leave empty queue");
     --sim.queues[q_index].data;
+    sim.ipa_depart(sim.q_stat[q_index], transaction);
     return next;
 }
 
 Simulation::Block* Simulation::EnterBlock::advance(Transaction& transaction) {
-    if ( sim.storages[storage_index].data->enter(transaction, this)) return next;
+    if ( sim.storages[storage_index].data->enter(transaction, next)) return next;
     return nullptr; 
 }
 
-Simulation::Block* Simulation::LeaveBlock::advance(Transaction&) {
-    sim.storages[storage_index].data->leave();
+Simulation::Block* Simulation::EnterBlock_renege::advance(Transaction& transaction) {
+    if (transaction.timer) { sim.expire(transaction); return nullptr; }
+    Storage& storage = *sim.storages[storage_index].data;
+    if (storage.enter_now(transaction)) return next;
+    uint32_t ticket = sim.take_ticket(nullptr, storage_index, sim.labels[renege_index].data);
+    storage.wait(transaction, next, ticket);
+    sim.start_timer(ticket, transaction, this, patience.eval(sim));
+    return nullptr;
+}
+
+void Simulation::EnterBlock_renege::save(StateWriter& out) { patience.save(out); }
+void Simulation::EnterBlock_renege::load(StateReader& in) { patience.load(in); }
+void Simulation::EnterBlock_renege::reseed(uint64_t seed) { patience.reseed(seed); }
+
+Simulation::Block* Simulation::InterruptBlock::advance(Transaction&) {
+    if (!on_gate || gate != nullptr) sim.interrupt(gate, storage_index);
+    return next;
+}
+
+Simulation::Block* Simulation::LeaveBlock::advance(Transaction& transaction) {
+    sim.storages[storage_index == selected ? transaction.selected : storage_index].data->leave(transaction);
     return next;
 }
 
 Simulation::Block* Simulation::GenBlock::advance(Transaction& transaction) {
     if (transaction.just_generated) {
-        Transaction tranasction(priority, sim.g_transaction_id++, true);
-        sim.spawn_schedule.emplace(SpawnData(tranasction, this), sim.g_time + rng());
+        double time;
+        uint64_t p = priority;
+        bool more = true;
+        if (trace == nullptr) time = interval.eval(sim);
+        else more = trace->next(time, p); // false: the trace is over
+        if (rates != nullptr) more = isfinite(time = rates->gap(sim.g_time, time)); // infinite: the rate stays at 0
+        if (more && time < 0) throw SimulationException("negative time between arrivals");
+        if (more) {
+            Transaction arrival(p, sim.g_transaction_id++, true);
+            arrival.perturbation = transaction.perturbation + time * sensitivity;
+            arrival.scaled = transaction.scaled;
+            sim.spawn_schedule.emplace(SpawnData(arrival, this), sim.g_time + time);
+        }
         transaction.just_generated = false;
+        transaction.mark = sim.g_time;
     }
     return next;
 }
 
+void Simulation::GenBlock::save(StateWriter& out) {
+    if (trace != nullptr) trace->save(out);
+    else interval.save(out);
+}
+
+void Simulation::GenBlock::load(StateReader& in) {
+    if (trace != nullptr) trace->load(in);
+    else interval.load(in);
+}
+
+void Simulation::GenBlock::reseed(uint64_t seed) {
+    if (trace == nullptr) interval.reseed(seed); // recorded arrivals stay as they are
+}
+
+Simulation::Block* Simulation::MarkBlock::advance(Transaction& transaction) {
+    transaction.mark = sim.g_time;
+    return next;
+}
+
+Simulation::Block* Simulation::TabulateBlock::advance(Transaction& transaction) {
+    sim.tables[table].data.add(value ? value() : sim.g_time - transaction.mark);
+    return next;
+}
+
+Simulation::Block* Simulation::SplitBlock::advance(Transaction& transaction) {
+    Block* target = sim.labels[index].data;
+    for (size_t i = 0; i < count; ++i) {
+        Transaction copy = transaction;
+        copy.id = sim.g_transaction_id++;
+        copy.just_generated = false;
+        sim.priority_spawn_schedule.push(SpawnData(copy, target));
+    }
+    return next;
+}
+
+Simulation::Block* Simulation::AssembleBlock::advance(Transaction& transaction) {
+    if (count <= 1) return next;
+    size_t slot = waiting.find(transaction.family);
+    if (slot == waiting.npos) { // the first one waits for the rest
+        slot = waiting.insert(transaction.family);
+        waiting.count(slot) = 1;
+        waiting.push(slot, transaction);
+        return nullptr;
+    }
+    if (++waiting.count(slot) == count) {
+        Transaction first = waiting.pop(slot);
+        first.perturbation = transaction.perturbation; // it leaves when the last one comes
+        sim.priority_spawn_schedule.push(SpawnData(first, next));
+        waiting.erase(slot);
+    }
+    return nullptr; // destroyed
+}
+
+void Simulation::AssembleBlock::save(StateWriter& out) { waiting.save(out, save_transaction); }
+void Simulation::AssembleBlock::load(StateReader& in) { waiting.load(in, load_transaction); }
+
+Simulation::Block* Simulation::GatherBlock::advance(Transaction& transaction) {
+    if (count <= 1) return next;
+    size_t slot = waiting.find(transaction.family);
+    if (slot == waiting.npos) {
+        slot = waiting.insert(transaction.family);
+        waiting.count(slot) = 0;
+    }
+    if (++waiting.count(slot) < count) {
+        waiting.push(slot, transaction);
+        return nullptr;
+    }
+    while (waiting.has_members(slot)) {
+        Transaction member = waiting.pop(slot);
+        member.perturbation = transaction.perturbation;
+        sim.priority_spawn_schedule.push(SpawnData(member, next));
+    }
+    waiting.erase(slot);
+    return next; // the last one goes first
+}
+
+void Simulation::GatherBlock::save(StateWriter& out) { waiting.save(out, save_transaction); }
+void Simulation::GatherBlock::load(StateReader& in) { waiting.load(in, load_transaction); }
+
+Simulation::Block* Simulation::MatchBlock::advance(Transaction& transaction) {
+    size_t slot = conjugate->waiting.find(transaction.family);
+    if (slot != waiting.npos) {
+        Transaction match = conjugate->waiting.pop(slot);
+        match.perturbation = transaction.perturbation;
+        sim.priority_spawn_schedule.push(SpawnData(match, conjugate->next));
+        if (!conjugate->waiting.has_members(slot)) conjugate->waiting.erase(slot);
+        return next;
+    }
+    slot = waiting.find(transaction.family);
+    if (slot == waiting.npos) slot = waiting.insert(transaction.family);
+    waiting.push(slot, transaction);
+    return nullptr;
+}
+
+void Simulation::MatchBlock::save(StateWriter& out) { waiting.save(out, save_transaction); }
+void Simulation::MatchBlock::load(StateReader& in) { waiting.load(in, load_transaction); }
+
+Simulation::Block* Simulation::FlowBlock::advance(Transaction& transaction) {
+    Storage& storage = *sim.storages[storage_index].data;
+    auto expected = [](double& carry, double mean) { // whole part of the running sum
+        carry += mean;
+        double n = floor(carry);
+        carry -= n;
+        return uint64_t(n);
+    };
+    uint64_t out = fluid ? min(inside, expected(carry_out, inside * leave_prob)) : binomial_distribution<uint64_t>(inside, leave_prob)(gen);
+    inside -= out;
+    storage.release(out);
+
+    uint64_t in = fluid ? expected(carry_in, rate * step) : poisson_distribution<uint64_t>(rate * step)(gen);
+    uint64_t n = storage.admit(backlog + in);
+    arrivals += in;
+    admitted += n;
+    inside += n;
+    backlog = backlog + in - n;
+    if (q_index != none) sim.queues[q_index].data = sim.queues[q_index].data + in - n;
+    sim.spawn_schedule.emplace(SpawnData(transaction, this), sim.g_time + step);
+    return nullptr;
+}
+
+void Simulation::FlowBlock::save(StateWriter& out) {
+    ostringstream text;
+    text << gen;
+    out.put_string(text.str());
+    out.put(inside);
+    out.put(backlog);
+    out.put(carry_in);
+    out.put(carry_out);
+    out.put(arrivals);
+    out.put(admitted);
+}
+
+void Simulation::FlowBlock::load(StateReader& in) {
+    istringstream text(in.get_string());
+    if (!(text >> gen)) throw runtime_error("state image is corrupted");
+    in.get(inside);
+    in.get(backlog);
+    in.get(carry_in);
+    in.get(carry_out);
+    in.get(arrivals);
+    in.get(admitted);
+}
+
+void Simulation::FlowBlock::reseed(uint64_t seed) { gen.seed(seed); }
+
+void Simulation::FlowBlock::reset_stat() { arrivals = admitted = 0; }
+
+Simulation::Report::FlowRow Simulation::FlowBlock::row() const {
+    return Report::FlowRow{sim.storages[storage_index].name, rate, step, inside, backlog, arrivals, admitted};
+}
+
+Simulation::Block* Simulation::SelectBlock::advance(Transaction& transaction) {
+    StorageGroup& members = *sim.groups[group].data;
+    size_t member = members.select(policy);
+    if (member == StorageGroup::none || !members.available(member)) {
+        if (alt_index != none) return sim.labels[alt_index].data;
+        if (member == StorageGroup::none) member = members.select(StorageGroup::MIN_LOAD);
+    }
+    transaction.selected = members.storage(member);
+    if (sim.storages[transaction.selected].data->enter(transaction, next)) return next;
+    return nullptr;
+}
+
 Simulation::Block* Simulation::AdvanceBlock::advance(Transaction& transaction) {
-    sim.spawn_schedule.emplace(SpawnData(transaction, next), sim.g_time + rng());
+    double time = delay.eval(sim);
+    if (time < 0) throw SimulationException("negative ADVANCE time");
+    transaction.perturbation += time * sensitivity;
+    if (remote_lp != local) { sim.post(remote_lp, remote_block, transaction, sim.g_time + time); return nullptr; }
+    sim.spawn_schedule.emplace(SpawnData(transaction, next), sim.g_time + time);
     return nullptr;
 }
 
+void Simulation::AdvanceBlock::save(StateWriter& out) { delay.save(out); }
+void Simulation::AdvanceBlock::load(StateReader& in) { delay.load(in); }
+void Simulation::AdvanceBlock::reseed(uint64_t seed) { delay.reseed(seed); }
+
 bool Simulation::GateBlock::refresh() {
     if (q.empty()) return false;
-    if (expr.eval()) { sim.priority_spawn_schedule.emplace(q.top(), next); q.pop(); return true; }
-    return false;
+    sim.active = &q.front(); // the condition is checked for the head of the chain
+    if (!expr.eval()) return false;
+    uint32_t ticket;
+    sim.priority_spawn_schedule.emplace(q.pop(sim.g_time, &ticket), next);
+    if (ticket != no_ticket) sim.release_ticket(ticket);
+    return true;
 }
 
+WaitChain<Simulation::Transaction, Simulation::priority_t>& Simulation::GateBlock::get_chain() { return q; }
+
+void Simulation::GateBlock::save(StateWriter& out) { q.save(out, save_transaction); }
+void Simulation::GateBlock::load(StateReader& in) { q.load(in, load_transaction); }
+
 Simulation::Block* Simulation::GateBlock::advance(Transaction& transaction) {
-    if ((q.empty() || (transaction.priority > q.top().priority)) && expr.eval()) return next; // avoid unnecessary death upon hitting open gate without queue
-    q.push(transaction); 
+    if ((q.empty() || (transaction.priority > q.front_priority())) && expr.eval()) return next; // avoid unnecessary death upon hitting open gate without queue
+    q.push(transaction.priority, transaction, sim.g_time);
     return nullptr; // check will be conducted in the end of tick
 }
 
+Simulation::Block* Simulation::GateBlock_renege::advance(Transaction& transaction) {
+    if (transaction.timer) { sim.expire(transaction); return nullptr; }
+    if ((q.empty() || (transaction.priority > q.front_priority())) && expr.eval()) return next;
+    uint32_t ticket = sim.take_ticket(this, 0, sim.labels[renege_index].data);
+    sim.tickets[ticket].node = q.push(transaction.priority, transaction, sim.g_time, ticket);
+    sim.start_timer(ticket, transaction, this, patience.eval(sim));
+    return nullptr;
+}
+
+void Simulation::GateBlock_renege::save(StateWriter& out) { GateBlock::save(out); patience.save(out); }
+void Simulation::GateBlock_renege::load(StateReader& in) { GateBlock::load(in); patience.load(in); }
+void Simulation::GateBlock_renege::reseed(uint64_t seed) { patience.reseed(seed); }
+
 Simulation::Block* Simulation::TransferBlock_imm::advance(Transaction&) {
     return sim.labels[index].data;
 }
@@ -109,10 +372,25 @@ Simulation::Block* Simulation::TransferBlock_expr::advance(Transaction&) {
 }
 
 Simulation::Block* Simulation::TransferBlock_prob::advance(Transaction&) {
-    if (dist(gen) < prob) return sim.labels[alt_index].data;
+    double u = dist(gen);
+    if (antithetic) u = 1 - u;
+    if (u < prob) return sim.labels[alt_index].data;
     return next;
 }
 
+void Simulation::TransferBlock_prob::save(StateWriter& out) {
+    ostringstream text;
+    text << gen;
+    out.put_string(text.str());
+}
+
+void Simulation::TransferBlock_prob::load(StateReader& in) {
+    istringstream text(in.get_string());
+    if (!(text >> gen)) throw runtime_error("state image is corrupted");
+}
+
+void Simulation::TransferBlock_prob::reseed(uint64_t seed) { gen.seed(seed); }
+
 Simulation::Block* Simulation::DebugBlock::advance(Transaction& transaction) {
     cout << "Transaction[" << transaction.id << "]: " << debug_message << '\n';
     return next;
@@ -120,28 +398,186 @@ Simulation::Block* Simulation::DebugBlock::advance(Transaction& transaction) {
 
 Simulation::Block* Simulation::TerminateBlock::advance(Transaction&) { return nullptr; }
 
-Simulation::Storage::Storage(Simulation& s, size_t capacity): sim(s), capacity(capacity) {}
+Simulation::Block* Simulation::CoroutineBlock::advance(Transaction& transaction) {
+    Coroutine coroutine = body(Context(sim, next)); // starts suspended
+    return coroutine.promise->advance(transaction);
+}
+
+Simulation::Block* Simulation::FusedBlock::advance(Transaction& transaction) {
+    for (auto& op : ops) {
+        switch (op.kind) {
+            case Op::QUEUE:
+                ++sim.queues[op.index].data;
+                sim.ipa_arrive(sim.q_stat[op.index], transaction);
+                break;
+            case Op::DEPART:
+                if (sim.queues[op.index].data == 0) throw SimulationException("Attempted to leave empty queue");
+                --sim.queues[op.index].data;
+                sim.ipa_depart(sim.q_stat[op.index], transaction);
+                break;
+            case Op::ENTER: if (!sim.storages[op.index].data->enter(transaction, op.resume)) return nullptr; break;
+            case Op::LEAVE: sim.storages[op.index].data->leave(transaction); break;
+        }
+    }
+    return next;
+}
+
+Simulation::Coroutine::promise_type::promise_type(Context& ctx): Block(ctx.sim, ctx.exit) {
+    ctx.promise = this;
+    CoroutineLink::next = sim.live_coroutines; // Block::next is the exit
+    if (sim.live_coroutines != nullptr) sim.live_coroutines->prev = this;
+    sim.live_coroutines = this;
+}
+
+Simulation::Coroutine::promise_type::~promise_type() {
+    if (prev != nullptr) prev->next = CoroutineLink::next;
+    else sim.live_coroutines = CoroutineLink::next;
+    if (CoroutineLink::next != nullptr) CoroutineLink::next->prev = prev;
+}
+
+void Simulation::Coroutine::promise_type::operator delete(void* ptr, size_t size) {
+    char* base = static_cast<char*>(ptr) - header;
+    (*reinterpret_cast<FramePool**>(base))->deallocate(base, size + header);
+}
+
+void Simulation::Coroutine::promise_type::schedule(double delay) {
+    sim.spawn_schedule.emplace(SpawnData(*current, this), sim.g_time + delay);
+}
+
+bool Simulation::Coroutine::promise_type::try_enter(size_t storage) {
+    return !sim.storages[storage].data->enter(*current, this);
+}
+
+void Simulation::Coroutine::promise_type::wait(bool (*check)(void*), void* cond) {
+    sim.cond_waits.push_back(CondWait{check, cond, SpawnData(*current, this)});
+}
+
+Simulation::Block* Simulation::Coroutine::promise_type::advance(Transaction& transaction) {
+    auto handle = coroutine_handle<promise_type>::from_promise(*this);
+    current = &transaction;
+    handle.resume();
+    if (!handle.done()) return nullptr; // parked by an awaitable
+    Block* exit = Block::next;
+    handle.destroy();
+    return exit;
+}
+
+void Simulation::Context::Delay::await_suspend(coroutine_handle<>) { promise.schedule(time); }
+bool Simulation::Context::Enter::await_suspend(coroutine_handle<>) { return promise.try_enter(storage); }
+
+uint64_t Simulation::Context::transaction_id() { return promise->current->id; }
+Simulation::priority_t Simulation::Context::transaction_priority() { return promise->current->priority; }
+void Simulation::Context::set_priority(priority_t priority) { promise->current->priority = priority; }
+void Simulation::Context::leave(size_t storage) { sim.storages[storage].data->leave(*promise->current); }
+void Simulation::Context::queue(size_t q) {
+    ++sim.queues[q].data;
+    sim.ipa_arrive(sim.q_stat[q], *promise->current);
+}
+void Simulation::Context::depart(size_t q) {
+    if (sim.queues[q].data == 0) throw SimulationException("Attempted to leave empty queue");
+    --sim.queues[q].data;
+    sim.ipa_depart(sim.q_stat[q], *promise->current);
+}
+
+Simulation::Storage::Storage(Simulation& s, size_t capacity, size_t index): sim(s), capacity(capacity), index(index) {}
 bool Simulation::Storage::empty() { return current == 0; }
 bool Simulation::Storage::available() { return current < capacity; }
 bool Simulation::Storage::full() { return current == capacity; }
 size_t Simulation::Storage::get_current() { return current; }
 size_t Simulation::Storage::get_capacity() { return capacity; }
 
-bool Simulation::Storage::enter(const Transaction& transaction, EnterBlock* ret) {
-    if (available()) { ++current; return true; }
-    q.emplace(transaction, ret);
+WaitChain<Simulation::SpawnData, Simulation::priority_t>& Simulation::Storage::get_chain() { return q; }
+
+void Simulation::Storage::save(StateWriter& out) const {
+    out.put(uint64_t(current));
+    q.save(out, [this](StateWriter& out, const SpawnData& spawn) { sim.save_spawn(out, spawn); });
+}
+
+void Simulation::Storage::load(StateReader& in) {
+    current = in.get<uint64_t>();
+    q.load(in, [this](StateReader& in) { return sim.load_spawn(in); });
+    changed();
+}
+
+void Simulation::Storage::join(StorageGroup* group, size_t member) {
+    this->group = group;
+    this->member = member;
+    changed();
+}
+
+bool Simulation::Storage::enter(const Transaction& transaction, Block* ret) {
+    if (enter_now(transaction)) return true;
+    wait(transaction, ret, no_ticket);
     return false;
 }
 
-void Simulation::Storage::leave() {
+bool Simulation::Storage::enter_now(const Transaction& transaction) {
+    if (!available()) return false;
+    ++current;
+    changed();
+    sim.ipa_arrive(sim.storage_stat[index], transaction);
+    return true;
+}
+
+void Simulation::Storage::wait(const Transaction& transaction, Block* ret, uint32_t ticket) {
+    uint32_t node = q.push(transaction.priority, SpawnData(transaction, ret), sim.g_time, ticket);
+    if (ticket != no_ticket) sim.tickets[ticket].node = node;
+    changed();
+}
+
+Simulation::SpawnData Simulation::Storage::withdraw(uint32_t node) {
+    SpawnData spawn = q.remove(node, sim.g_time);
+    changed();
+    return spawn;
+}
+
+Simulation::SpawnData Simulation::Storage::hand_over() {
+    uint32_t ticket;
+    SpawnData spawn = q.pop(sim.g_time, &ticket);
+    if (ticket != no_ticket) sim.release_ticket(ticket);
+    return spawn;
+}
+
+uint64_t Simulation::Storage::admit(uint64_t n) {
+    if (!q.empty()) return 0;
+    n = min<uint64_t>(n, capacity - current);
+    current += n;
+    changed();
+    return n;
+}
+
+void Simulation::Storage::release(uint64_t n) {
+    if (n > current) throw SimulationException("Attempted to leave empty storage");
+    for (; n > 0 && !q.empty(); --n) { // handed over, as by leave()
+        SpawnData spawn = hand_over();
+        spawn.transaction.perturbation = 0; // the flow does not depend on the parameter
+        sim.ipa_arrive(sim.storage_stat[index], spawn.transaction);
+        sim.priority_spawn_schedule.push(spawn);
+    }
+    current -= n;
+    changed();
+}
+
+void Simulation::Storage::leave(const Transaction& transaction) {
     if (current == 0) throw SimulationException("Attempted to leave empty storage");
-    if (!q.empty()) {
-        SpawnData spawn_data = q.top();
-        q.pop();
-        sim.priority_spawn_schedule.emplace(spawn_data.transaction, spawn_data.block);
+    if (!q.empty()) { // the place is handed over, current stays the same
+        SpawnData spawn = hand_over();
+        spawn.transaction.perturbation = transaction.perturbation; // it is let in when this one leaves
+        sim.ipa_depart(sim.storage_stat[index], transaction);
+        sim.ipa_arrive(sim.storage_stat[index], spawn.transaction);
+        sim.priority_spawn_schedule.push(spawn);
+    }
+    else {
+        --current;
+        sim.ipa_depart(sim.storage_stat[index], transaction);
     }
-    else --current;
+    changed();
 }
 
 Simulation::Simulation() {}
-Simulation::~Simulation() {}
\ No newline at end of file
+Simulation::~Simulation() {
+    while (live_coroutines != nullptr) { // suspended coroutines; destroying a frame unlinks it
+        auto promise = static_cast<Coroutine::promise_type*>(live_coroutines);
+        coroutine_handle<Coroutine::promise_type>::from_promise(*promise).destroy();
+    }
+}
\ No newline at end of file
@@ -7,20 +7,37 @@
 #include <utility>
 #include "logic/logic.h"
 #include "dist.h"
+#include "chain.h"
 #include "simulation.h"
+#include "expr.h"
+#include "trace.h"
+#include "family.h"
+#include "rate.h"
 
 using namespace std;
 
 typedef function<void()> action;
 
+// background traffic of a storage kept in aggregate (SimBuilder::add_flow)
+struct FlowOptions {
+    double step = 0;     // model time between updates; 0: holding time / 20
+    bool fluid = false;  // move the expected numbers instead of random ones
+    string queue;        // arrivals waiting for a place are counted in this queue; empty: not counted
+    string stream;       // name of the random stream, see SimBuilder::set_streams
+};
+
 class Simulation::Block {
 protected:
     Simulation& sim;
     Block* next;
 
     friend class SimBuilder;
+    friend class LaneSimulation; // reads next pointers
 public:
     virtual Block* advance(Transaction&) = 0;
+    virtual void save(StateWriter&) {} // own state (generators, waiting transactions), for checkpoints
+    virtual void load(StateReader&) {}
+    virtual void reseed(uint64_t) {}   // moves the generators to new streams, e.g. in clones of one state
     Block(Simulation& s, Block* next);
 
     #ifndef NDEBUG
@@ -69,8 +86,10 @@ public:
 
 class Simulation::LeaveBlock: public Block {
 private:
-    size_t storage_index;
+    size_t storage_index; // selected: the one of the transaction's last SELECT
 public:
+    static constexpr size_t selected = -1;
+
     LeaveBlock(Simulation& s, Block* next, size_t storage_index);
     virtual Block* advance(Transaction&) override;
     virtual ~LeaveBlock() {};
@@ -83,11 +102,20 @@ public:
 class Simulation::GenBlock: public Block {
 private:
     priority_t priority;
-    RandomGenerator rng;
+    Expr interval;                // time to the next transaction
+    unique_ptr<TraceReader> trace; // replaces interval and may set the priority, if present
+    unique_ptr<RateTable> rates;   // non-homogeneous Poisson arrivals, if present: interval is Exp(1) in units of the cumulative rate
+    double sensitivity = 0;        // IPA: derivative of an interval by the parameter per unit of time (-1 / rate); 0: independent
 
+    friend class SimBuilder;
 public:
-    GenBlock(Simulation& s, Block* next, priority_t priority, RandomGenerator rng);
+    GenBlock(Simulation& s, Block* next, priority_t priority, Expr interval);
+    GenBlock(Simulation& s, Block* next, priority_t priority, unique_ptr<TraceReader> trace);
+    GenBlock(Simulation& s, Block* next, priority_t priority, Expr unit, RateTable rates); // unit: Exp(1)
     virtual Block* advance(Transaction&) override;
+    virtual void save(StateWriter& out) override;
+    virtual void load(StateReader& in) override;
+    virtual void reseed(uint64_t seed) override;
     virtual ~GenBlock() {};
         
     #ifndef NDEBUG
@@ -97,10 +125,20 @@ public:
 
 class Simulation::AdvanceBlock: public Block {
 private:
-    RandomGenerator rng;
+    Expr delay;
+    double sensitivity = 0; // as in GenBlock
+    // parallel execution: when next belongs to another logical process, the transaction is posted there
+    static constexpr size_t local = -1;
+    size_t remote_lp = local;
+    size_t remote_block;
+
+    friend class SimBuilder;
 public:
-    AdvanceBlock(Simulation& s, Block* next, RandomGenerator rng);
+    AdvanceBlock(Simulation& s, Block* next, Expr delay);
     virtual Block* advance(Transaction&) override;
+    virtual void save(StateWriter& out) override;
+    virtual void load(StateReader& in) override;
+    virtual void reseed(uint64_t seed) override;
     virtual ~AdvanceBlock() {};
         
     #ifndef NDEBUG
@@ -109,13 +147,16 @@ public:
 };
 
 class Simulation::GateBlock: public Block {
-private:
-    priority_queue<Transaction> q;
+protected:
+    WaitChain<Transaction, priority_t> q;
     LogicNode expr;
 public:
     GateBlock(Simulation& s, Block* next, LogicNode expr);
     bool refresh();
+    WaitChain<Transaction, priority_t>& get_chain();
     virtual Block* advance(Transaction&) override;
+    virtual void save(StateWriter& out) override;
+    virtual void load(StateReader& in) override;
     virtual ~GateBlock() {};
         
     #ifndef NDEBUG
@@ -157,10 +198,16 @@ private:
     size_t alt_index;
     double prob;
     mt19937 gen;
+    bool antithetic = false; // compare 1 - U instead of U
     static uniform_real_distribution<> dist; // by default returns value in [0; 1)
+
+    friend class SimBuilder;
 public:
     TransferBlock_prob(Simulation& s, Block* next, size_t alt_index, double prob, int seed);
     Block* advance(Transaction&) override;
+    virtual void save(StateWriter& out) override;
+    virtual void load(StateReader& in) override;
+    virtual void reseed(uint64_t seed) override;
     virtual ~TransferBlock_prob() {};
         
     #ifndef NDEBUG
@@ -193,22 +240,271 @@ public:
     #endif
 };
 
+class Simulation::MarkBlock: public Block {
+public:
+    MarkBlock(Simulation& s, Block* next);
+    virtual Block* advance(Transaction&) override;
+    virtual ~MarkBlock() {};
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
+
+// adds a value to a table: M1 (time since the transaction's mark) or the given function
+class Simulation::TabulateBlock: public Block {
+private:
+    size_t table;
+    function<double()> value; // empty: M1
+public:
+    TabulateBlock(Simulation& s, Block* next, size_t table, function<double()> value);
+    virtual Block* advance(Transaction&) override;
+    virtual ~TabulateBlock() {};
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
+
+// SPLIT: the transaction goes on, and count copies of it start at a label. Copies get new ids and join its family
+class Simulation::SplitBlock: public Block {
+private:
+    size_t count;
+    size_t index; // label
+public:
+    SplitBlock(Simulation& s, Block* next, size_t count, size_t index);
+    virtual Block* advance(Transaction&) override;
+    virtual ~SplitBlock() {};
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
+
+// ASSEMBLE: the first member of a family to arrive waits until count members have arrived, the others are destroyed
+class Simulation::AssembleBlock: public Block {
+private:
+    size_t count;
+    FamilyTable<Transaction> waiting;
+public:
+    AssembleBlock(Simulation& s, Block* next, size_t count);
+    virtual Block* advance(Transaction&) override;
+    virtual void save(StateWriter& out) override;
+    virtual void load(StateReader& in) override;
+    virtual ~AssembleBlock() {};
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
+
+// GATHER: members of a family wait until count of them have arrived, then all of them go on
+class Simulation::GatherBlock: public Block {
+private:
+    size_t count;
+    FamilyTable<Transaction> waiting;
+public:
+    GatherBlock(Simulation& s, Block* next, size_t count);
+    virtual Block* advance(Transaction&) override;
+    virtual void save(StateWriter& out) override;
+    virtual void load(StateReader& in) override;
+    virtual ~GatherBlock() {};
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
+
+// MATCH: a transaction waits until a member of its family reaches the conjugate MATCH, then both go on
+class Simulation::MatchBlock: public Block {
+private:
+    size_t index;                   // label of the conjugate
+    MatchBlock* conjugate = nullptr; // resolved by the builder
+    FamilyTable<Transaction> waiting;
+
+    friend class SimBuilder;
+public:
+    MatchBlock(Simulation& s, Block* next, size_t index);
+    virtual Block* advance(Transaction&) override;
+    virtual void save(StateWriter& out) override;
+    virtual void load(StateReader& in) override;
+    virtual ~MatchBlock() {};
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
+
+// GENERATE (exponential) -> ENTER -> ADVANCE (exponential) -> LEAVE of one storage in aggregate: no transaction per arrival.
+// A clock transaction comes every step, releases a binomial number of the places the flow holds, with p = step / holding
+// (a geometric number of steps: the mean holding time is exact), then lets in the arrivals of the step, Poisson in
+// number, and the backlog. The places it holds are a part of the storage content, so gates, expressions and statistics
+// see them; released places go to waiting transactions first, and arrivals that find no place wait in the backlog
+class Simulation::FlowBlock: public Block {
+private:
+    size_t storage_index;
+    size_t q_index;          // backlog; none: not counted
+    double rate, step, leave_prob;
+    bool fluid;
+    mt19937 gen;
+    uint64_t inside = 0, backlog = 0;
+    double carry_in = 0, carry_out = 0;  // fluid: fractions of arrivals and departures not moved yet
+    uint64_t arrivals = 0, admitted = 0; // since the last reset
+
+    friend class SimBuilder;
+public:
+    static constexpr size_t none = -1;
+
+    FlowBlock(Simulation& s, size_t storage_index, size_t q_index, double rate, double holding, double step, bool fluid);
+    virtual Block* advance(Transaction&) override;
+    virtual void save(StateWriter& out) override;
+    virtual void load(StateReader& in) override;
+    virtual void reseed(uint64_t seed) override;
+    void reset_stat();
+    Report::FlowRow row() const;
+    virtual ~FlowBlock() {};
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
+
+// SELECT: enters the member of a storage group chosen by the policy and records it in the transaction, for the LEAVE
+// of SimBuilder::add_leave_selected. If no member has a free place, the transaction goes to the alternative label;
+// without one it waits in the chain of the least loaded member (for MIN_LOAD and MAX_FREE that is the chosen one)
+class Simulation::SelectBlock: public Block {
+private:
+    size_t group;
+    StorageGroup::policy_t policy;
+    size_t alt_index; // label; none: wait
+
+public:
+    static constexpr size_t none = -1;
+
+    SelectBlock(Simulation& s, Block* next, size_t group, StorageGroup::policy_t policy, size_t alt_index);
+    virtual Block* advance(Transaction&) override;
+    virtual ~SelectBlock() {};
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
+
+// ENTER with a patience (SimBuilder::add_enter): a transaction that has to wait takes a ticket and starts its timer;
+// if the timer fires before it gets a place, it leaves the delay chain for the renege label
+class Simulation::EnterBlock_renege: public Block {
+private:
+    size_t storage_index;
+    Expr patience;
+    size_t renege_index; // label
+
+public:
+    EnterBlock_renege(Simulation& s, Block* next, size_t storage_index, Expr patience, size_t renege_index);
+    virtual Block* advance(Transaction&) override; // also gets the timers back
+    virtual void save(StateWriter& out) override;
+    virtual void load(StateReader& in) override;
+    virtual void reseed(uint64_t seed) override;
+    virtual ~EnterBlock_renege() {};
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
+
+// GATE with a patience, as EnterBlock_renege
+class Simulation::GateBlock_renege: public GateBlock {
+private:
+    Expr patience;
+    size_t renege_index; // label
+
+public:
+    GateBlock_renege(Simulation& s, Block* next, LogicNode expr, Expr patience, size_t renege_index);
+    virtual Block* advance(Transaction&) override;
+    virtual void save(StateWriter& out) override;
+    virtual void load(StateReader& in) override;
+    virtual void reseed(uint64_t seed) override;
+    virtual ~GateBlock_renege() {};
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
+
+// every transaction with a renege label waiting for a storage or at a gate reneges at once; the others keep waiting
+class Simulation::InterruptBlock: public Block {
+private:
+    bool on_gate = false;      // else the chain of storages[storage_index]
+    GateBlock* gate = nullptr; // nullptr on a gate: it was unreachable
+    size_t storage_index;
+
+    friend class SimBuilder;
+public:
+    InterruptBlock(Simulation& s, Block* next, size_t storage_index);
+    virtual Block* advance(Transaction&) override;
+    virtual ~InterruptBlock() {};
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
+
+// superblock made by the builder out of a run of QUEUE, DEPART, ENTER and LEAVE blocks: one dispatch instead of one per block.
+// If ENTER has to wait, the transaction resumes at the block that followed that ENTER in the original graph
+class Simulation::FusedBlock: public Block {
+public:
+    struct Op {
+        enum kind_t: int {QUEUE, DEPART, ENTER, LEAVE};
+        kind_t kind;
+        size_t index;  // queue or storage
+        Block* resume; // ENTER: where the transaction continues once it is let in
+    };
+
+private:
+    vector<Op> ops;
+    friend class SimBuilder;
+public:
+    FusedBlock(Simulation& s, Block* next, vector<Op> ops);
+    virtual Block* advance(Transaction&) override;
+    virtual ~FusedBlock() {};
+
+    #ifndef NDEBUG
+    virtual string name() override;
+    #endif
+};
+
 class Simulation::Storage {
 private:
     Simulation& sim;
     const size_t capacity;
-    priority_queue<SpawnData> q;
-    size_t current;
+    const size_t index; // in Simulation::storages
+    WaitChain<SpawnData, priority_t> q; // delay chain
+    size_t current = 0;
+    StorageGroup* group = nullptr; // of SELECT, told about every change of current and of the chain length
+    size_t member = 0;             // in group
+
+    void changed() { if (group != nullptr) group->update(member, current, q.size()); }
+    SpawnData hand_over(); // the head of the delay chain gets a place
 
 public:
-    Storage(Simulation& s, size_t capacity = 0);
+    Storage(Simulation& s, size_t capacity, size_t index);
 
     bool empty();
     bool available();
     bool full();
     size_t get_current();
     size_t get_capacity();
+    WaitChain<SpawnData, priority_t>& get_chain();
+    void save(StateWriter& out) const;
+    void load(StateReader& in);
+
+    bool enter(const Transaction& transaction, Block* ret); // true: some op accepted priority_t; false: there are no free ops. ret is where the transaction resumes once it is let in
+    bool enter_now(const Transaction& transaction); // false: no free place, the caller decides how to wait
+    void wait(const Transaction& transaction, Block* ret, uint32_t ticket); // joins the delay chain holding ticket (or no_ticket)
+    SpawnData withdraw(uint32_t node); // a reneging transaction leaves the delay chain
+    void leave(const Transaction& transaction); // a transaction let in takes over its perturbation
+    uint64_t admit(uint64_t n);  // flows: takes up to n free places unless transactions wait; returns how many
+    void release(uint64_t n);    // flows: frees n places, waiting transactions first
+    void join(StorageGroup* group, size_t member); // a storage is in one group at most
+};
 
-    bool enter(const Transaction& transaction, EnterBlock* ret); // true: some op accepted priority_t; false: there are no free ops
-    void leave();
-};
\ No newline at end of file
+#include "coroutine.h"
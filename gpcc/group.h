@@ -0,0 +1,125 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <bit>
+#include <utility>
+
+using namespace std;
+
+// Storages of a SELECT group (SimBuilder::add_group), indexed by the policies its SELECT blocks use. Storage reports
+// every change of a member's content, so choosing never looks at all members:
+//   FIRST_AVAILABLE: two-level bitmap of the members with a free place (a bit per member, a summary bit per word of
+//                    64 members); the first one takes one countr_zero per level for up to 4096 members
+//   MIN_LOAD:        indexed binary heap by load relative to capacity: content plus transactions waiting in the delay
+//                    chain, per place; a member with a free place is always below 1, so it is never passed over
+//   MAX_FREE:        indexed binary heap by free places less waiting transactions
+// Waiting transactions count so that, once every member is full, both go to the shortest delay chain
+// (relative to capacity for MIN_LOAD).
+// Ties go to the lower member. An update costs O(1) for the bitmap and O(log n) for a heap
+class StorageGroup {
+public:
+    enum policy_t: int {FIRST_AVAILABLE, MIN_LOAD, MAX_FREE};
+    static constexpr size_t none = -1;
+
+private:
+    struct Heap {
+        bool on = false;
+        vector<uint32_t> heap; // members
+        vector<uint32_t> pos;  // of every member in heap
+    };
+
+    vector<size_t> storages; // index in Simulation::storages of every member
+    vector<size_t> capacity, content, waiting;
+    bool bitmap_on = false;
+    vector<uint64_t> words, summary;
+    Heap load, vacancy;
+
+    size_t used(size_t m) const { return content[m] + waiting[m]; }
+    int64_t spare(size_t m) const { return int64_t(capacity[m]) - int64_t(used(m)); }
+    bool before(const Heap& h, uint32_t a, uint32_t b) const { // a is nearer the top of h
+        if (&h == &load) { // used(a) / capacity[a] < used(b) / capacity[b], exact below 2^53
+            double x = double(used(a)) * capacity[b], y = double(used(b)) * capacity[a];
+            if (x != y) return x < y;
+        }
+        else if (spare(a) != spare(b)) return spare(a) > spare(b);
+        return a < b;
+    }
+    void place(Heap& h, size_t i, uint32_t m) { h.heap[i] = m; h.pos[m] = i; }
+    void sift_down(Heap& h, size_t i, uint32_t m) { // m goes to slot i or below
+        while (true) {
+            size_t c = 2 * i + 1;
+            if (c >= h.heap.size()) break;
+            if (c + 1 < h.heap.size() && before(h, h.heap[c + 1], h.heap[c])) ++c;
+            if (!before(h, h.heap[c], m)) break;
+            place(h, i, h.heap[c]);
+            i = c;
+        }
+        place(h, i, m);
+    }
+    void fix(Heap& h, uint32_t m) {
+        size_t i = h.pos[m];
+        while (i > 0 && before(h, m, h.heap[(i - 1) / 2])) { place(h, i, h.heap[(i - 1) / 2]); i = (i - 1) / 2; }
+        sift_down(h, i, m);
+    }
+    void mark(size_t m) { // bitmap bit of m from its content
+        uint64_t bit = uint64_t(1) << (m % 64);
+        uint64_t& word = words[m / 64];
+        if (content[m] < capacity[m]) word |= bit;
+        else word &= ~bit;
+        uint64_t sbit = uint64_t(1) << (m / 64 % 64);
+        if (word != 0) summary[m / 4096] |= sbit;
+        else summary[m / 4096] &= ~sbit;
+    }
+
+public:
+    StorageGroup(vector<size_t> storages, vector<size_t> capacity): storages(move(storages)), capacity(move(capacity)) {
+        content.assign(this->storages.size(), 0);
+        waiting.assign(this->storages.size(), 0);
+    }
+
+    size_t size() const { return storages.size(); }
+    size_t storage(size_t member) const { return storages[member]; }
+    bool available(size_t member) const { return content[member] < capacity[member]; }
+
+    void enable(policy_t policy) { // builds the index of policy from the current contents
+        size_t n = storages.size();
+        if (policy == FIRST_AVAILABLE && !bitmap_on) {
+            bitmap_on = true;
+            words.assign((n + 63) / 64, 0);
+            summary.assign((words.size() + 63) / 64, 0);
+            for (size_t m = 0; m < n; ++m) mark(m);
+        }
+        Heap* h = policy == MIN_LOAD ? &load : policy == MAX_FREE ? &vacancy : nullptr;
+        if (h != nullptr && !h->on) {
+            h->on = true;
+            h->heap.resize(n);
+            h->pos.resize(n);
+            for (size_t m = 0; m < n; ++m) place(*h, m, m);
+            for (size_t i = n / 2; i-- > 0;) sift_down(*h, i, h->heap[i]); // bottom-up: both subtrees are heaps already
+        }
+    }
+
+    void update(size_t member, size_t content, size_t waiting) {
+        this->content[member] = content;
+        this->waiting[member] = waiting;
+        if (bitmap_on) mark(member);
+        if (load.on) fix(load, member);
+        if (vacancy.on) fix(vacancy, member);
+    }
+
+    // the best member; FIRST_AVAILABLE gives none if no member has a free place
+    size_t select(policy_t policy) const {
+        switch (policy) {
+            case FIRST_AVAILABLE:
+                for (size_t s = 0; s < summary.size(); ++s) if (summary[s] != 0) {
+                    size_t w = s * 64 + countr_zero(summary[s]);
+                    return w * 64 + countr_zero(words[w]);
+                }
+                return none;
+            case MIN_LOAD: return load.heap[0];
+            case MAX_FREE: return vacancy.heap[0];
+        }
+        return none;
+    }
+};
@@ -0,0 +1,135 @@
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "live.h"
+
+using namespace std;
+
+// offsets of the parts of a segment with n entities. Every part is a multiple of 8 bytes
+static size_t entities_offset() { return sizeof(LiveHeader); }
+static size_t stats_offset(size_t n) { return entities_offset() + n * sizeof(LiveEntity); }
+static size_t segment_size(size_t n) { return stats_offset(n) + sizeof(LiveStats) + n * sizeof(LiveLevel); }
+
+static constexpr size_t stats_words = sizeof(LiveStats) / sizeof(uint64_t);
+static constexpr size_t level_words = sizeof(LiveLevel) / sizeof(uint64_t);
+
+LiveSegment::LiveSegment(const string& name, double interval, const vector<string>& queues, const vector<pair<string, size_t>>& storages):
+    name(name), entities(queues.size() + storages.size()), start(chrono::steady_clock::now()), last(start),
+    interval(chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(interval))) {
+    size = segment_size(entities);
+    shm_unlink(name.c_str()); // a segment left by an earlier run: readers still attached to it keep the old one
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) throw runtime_error("can not create shared memory " + name);
+    if (ftruncate(fd, size) != 0) { close(fd); shm_unlink(name.c_str()); throw runtime_error("can not size shared memory " + name); }
+    data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) { data = nullptr; shm_unlink(name.c_str()); throw runtime_error("can not map shared memory " + name); }
+
+    LiveHeader& h = header();
+    h.magic.store(0, memory_order_relaxed);
+    h.version = LiveHeader::expected_version;
+    h.queues = queues.size();
+    h.storages = storages.size();
+    h.pid = getpid();
+    h.seq.store(0, memory_order_relaxed);
+    auto entity = reinterpret_cast<LiveEntity*>(static_cast<char*>(data) + entities_offset());
+    auto set = [](LiveEntity& e, const string& name, size_t capacity) {
+        memset(e.name, 0, sizeof(e.name));
+        memcpy(e.name, name.data(), min(name.size(), sizeof(e.name) - 1));
+        e.capacity = capacity;
+    };
+    for (size_t i = 0; i < queues.size(); ++i) set(entity[i], queues[i], 0);
+    for (size_t i = 0; i < storages.size(); ++i) set(entity[queues.size() + i], storages[i].first, storages[i].second);
+    memset(words(), 0, sizeof(LiveStats) + entities * sizeof(LiveLevel));
+    h.magic.store(LiveHeader::expected_magic, memory_order_release);
+}
+
+LiveSegment::~LiveSegment() {
+    munmap(data, size);
+    shm_unlink(name.c_str());
+}
+
+uint64_t* LiveSegment::words() const { return reinterpret_cast<uint64_t*>(static_cast<char*>(data) + stats_offset(entities)); }
+
+void LiveSegment::publish(LiveStats stats, const vector<LiveLevel>& levels) {
+    auto now = chrono::steady_clock::now();
+    double elapsed = chrono::duration<double>(now - last).count();
+    stats.wall = chrono::duration<double>(now - start).count();
+    stats.rate = elapsed > 0 ? (stats.events - last_events) / elapsed : 0;
+    last = now;
+    last_events = stats.events;
+
+    // the words are stored as relaxed atomics: a reader may copy them while they change, and throws the copy away
+    atomic<uint64_t>& seq = header().seq;
+    uint64_t s = seq.load(memory_order_relaxed);
+    seq.store(s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    uint64_t* out = words();
+    auto put = [&](const void* from, size_t n) {
+        const uint64_t* in = static_cast<const uint64_t*>(from);
+        for (size_t i = 0; i < n; ++i) atomic_ref<uint64_t>(*out++).store(in[i], memory_order_relaxed);
+    };
+    put(&stats, stats_words);
+    for (size_t i = 0; i < entities; ++i) put(&levels[i], level_words);
+    seq.store(s + 2, memory_order_release);
+}
+
+LiveView::LiveView(const string& name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) throw runtime_error("no shared memory " + name);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(LiveHeader)) { close(fd); throw runtime_error(name + " is not ready"); }
+    size = st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) throw runtime_error("can not map shared memory " + name);
+    data = map;
+    const LiveHeader& h = header();
+    if (h.magic.load(memory_order_acquire) != LiveHeader::expected_magic || h.version != LiveHeader::expected_version
+        || segment_size(size_t(h.queues) + h.storages) > size) {
+        munmap(map, size);
+        throw runtime_error(name + " is not a live statistics segment");
+    }
+}
+
+LiveView::~LiveView() { munmap(const_cast<void*>(data), size); }
+
+const LiveEntity& LiveView::entity(size_t index) const {
+    return reinterpret_cast<const LiveEntity*>(static_cast<const char*>(data) + entities_offset())[index];
+}
+
+LiveView::Snapshot LiveView::read() const {
+    size_t n = queues() + storages();
+    Snapshot snapshot;
+    snapshot.levels.resize(n);
+    auto in = reinterpret_cast<uint64_t*>(const_cast<char*>(static_cast<const char*>(data) + stats_offset(n)));
+    const atomic<uint64_t>& seq = header().seq;
+    for (size_t attempt = 0; attempt < attempts; ++attempt) {
+        if (attempt > 0) this_thread::yield();
+        uint64_t s = seq.load(memory_order_acquire);
+        if (s & 1) continue; // being written
+        uint64_t* p = in;
+        auto get = [&](void* to, size_t words) {
+            uint64_t* out = static_cast<uint64_t*>(to);
+            for (size_t i = 0; i < words; ++i) out[i] = atomic_ref<uint64_t>(*p++).load(memory_order_relaxed);
+        };
+        get(&snapshot.stats, stats_words);
+        for (auto& level : snapshot.levels) get(&level, level_words);
+        atomic_thread_fence(memory_order_acquire);
+        if (seq.load(memory_order_relaxed) == s) {
+            last_stats = snapshot.stats;
+            last_levels = snapshot.levels;
+            return snapshot;
+        }
+    }
+    snapshot.stats = last_stats;
+    snapshot.levels = last_levels;
+    snapshot.levels.resize(n);
+    snapshot.stale = true;
+    return snapshot;
+}
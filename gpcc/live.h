@@ -0,0 +1,113 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// Live statistics of a running simulation in a POSIX shared-memory segment (SimBuilder::set_live_stats), read by
+// tools/live_view or any process that maps it. The segment is
+//   LiveHeader | LiveEntity x entities | LiveStats | LiveLevel x entities
+// Header and entities are written once, before magic is set. LiveStats and the levels are rewritten by every
+// publication under a seqlock: the writer makes seq odd, stores the words and makes it even again; a reader copies
+// them and retries if seq was odd or changed meanwhile, up to LiveView::attempts times: a writer that died
+// mid-update leaves seq odd forever. Neither side ever waits for the other, and the event loop only reads the clock
+// every few thousand events
+struct LiveHeader {
+    static constexpr uint64_t expected_magic = 0x3176696c63637067; // "gpccliv1"
+    static constexpr uint32_t expected_version = 1;
+
+    atomic<uint64_t> magic;
+    uint32_t version;
+    uint32_t queues;   // entities: queues first, then storages
+    uint32_t storages;
+    uint32_t pid;      // of the writer
+    alignas(64) atomic<uint64_t> seq;
+};
+
+struct LiveEntity {
+    char name[56];     // truncated, zero-terminated
+    uint64_t capacity; // 0 for queues
+};
+
+struct LiveStats {
+    double time;       // model time
+    double end_time;
+    double stat_start; // time of the last statistics reset
+    double wall;       // seconds since the segment was created
+    double rate;       // events per second of wall time since the previous publication
+    uint64_t events;
+    uint64_t finished; // 1 once launch() has reached end_time
+};
+
+struct LiveLevel { // over [stat_start; time]
+    uint64_t current;
+    uint64_t max;
+    double mean;
+    double empty;      // P(0)
+    double full;       // P(full); 0 for queues
+};
+
+// writer side: creates the segment and unlinks it on destruction (mapped readers keep their view)
+class LiveSegment {
+private:
+    string name;
+    void* data = nullptr;
+    size_t size = 0;
+    size_t entities = 0;
+    chrono::steady_clock::time_point start, last;
+    chrono::steady_clock::duration interval;
+    uint64_t last_events = 0;
+
+    LiveHeader& header() const { return *static_cast<LiveHeader*>(data); }
+    uint64_t* words() const; // LiveStats and the levels
+
+public:
+    static constexpr uint64_t stride = 4096; // events between checks of the clock
+
+    // name as for shm_open ("/gpcc"). Throws runtime_error if the segment can't be created
+    LiveSegment(const string& name, double interval, const vector<string>& queues, const vector<pair<string, size_t>>& storages);
+    LiveSegment(const LiveSegment&) = delete;
+    LiveSegment& operator=(const LiveSegment&) = delete;
+    ~LiveSegment();
+
+    bool due() const { return chrono::steady_clock::now() - last >= interval; }
+
+    // stats.wall and stats.rate are filled here
+    void publish(LiveStats stats, const vector<LiveLevel>& levels);
+};
+
+// reader side
+class LiveView {
+private:
+    const void* data = nullptr;
+    size_t size = 0;
+
+    mutable LiveStats last_stats{};
+    mutable vector<LiveLevel> last_levels; // of the last consistent copy
+
+    const LiveHeader& header() const { return *static_cast<const LiveHeader*>(data); }
+
+public:
+    struct Snapshot {
+        LiveStats stats;
+        vector<LiveLevel> levels;
+        bool stale = false; // no consistent copy within attempts: the last one read (zeros if none)
+    };
+    static constexpr size_t attempts = 1000; // reads of seq before read() gives up, yielding between them
+
+    LiveView(const string& name); // throws runtime_error if there is no segment or it is not a live statistics one
+    LiveView(const LiveView&) = delete;
+    LiveView& operator=(const LiveView&) = delete;
+    ~LiveView();
+
+    size_t queues() const { return header().queues; }
+    size_t storages() const { return header().storages; }
+    uint32_t pid() const { return header().pid; }
+    const LiveEntity& entity(size_t index) const; // queues first, then storages
+
+    Snapshot read() const; // consistent copy of the last publication, or the previous one marked stale
+};
@@ -0,0 +1,33 @@
+#include <new>
+#include "pool.h"
+
+using namespace std;
+
+FramePool::~FramePool() { for (void* slab : slabs) ::operator delete(slab); }
+
+void* FramePool::allocate(size_t size) {
+    size_t cls = (size + granularity - 1) / granularity;
+    if (cls >= free_lists.size()) free_lists.resize(cls + 1, nullptr);
+
+    if (free_lists[cls] == nullptr) {
+        size_t block = cls * granularity;
+        char* slab = static_cast<char*>(::operator new(block * slab_blocks));
+        slabs.push_back(slab);
+        for (size_t i = slab_blocks; i-- > 0;) {
+            FreeNode* node = reinterpret_cast<FreeNode*>(slab + i * block);
+            node->next = free_lists[cls];
+            free_lists[cls] = node;
+        }
+    }
+
+    FreeNode* node = free_lists[cls];
+    free_lists[cls] = node->next;
+    return node;
+}
+
+void FramePool::deallocate(void* ptr, size_t size) {
+    size_t cls = (size + granularity - 1) / granularity;
+    FreeNode* node = static_cast<FreeNode*>(ptr);
+    node->next = free_lists[cls];
+    free_lists[cls] = node;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+// Free-list allocator for coroutine frames. Sizes are rounded up to a size class; freed blocks are kept for reuse
+// and memory is given back only when the pool dies, so after warm-up allocation does not reach malloc
+class FramePool {
+private:
+    static constexpr size_t granularity = 64; // size class step
+    static constexpr size_t slab_blocks = 64; // blocks carved from one allocation
+
+    struct FreeNode { FreeNode* next; };
+    vector<FreeNode*> free_lists; // by size class
+    vector<void*> slabs;
+
+public:
+    FramePool() = default;
+    FramePool(const FramePool&) = delete;
+    ~FramePool();
+
+    void* allocate(size_t size);
+    void deallocate(void* ptr, size_t size);
+};
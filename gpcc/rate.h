@@ -0,0 +1,91 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+// Arrival rate that changes with model time, for non-homogeneous Poisson arrivals (SimBuilder::add_generate):
+//
+//     RateTable day({0, 7, 9, 17, 19}, {2, 40, 25, 60, 5}, RateTable::LINEAR, 24); // hours; repeats every day
+//
+// Points (time, rate) with increasing times from 0. STEPS keeps rate[i] until time[i + 1]; LINEAR interpolates between
+// the points. After the last point the rate wraps around to the first one at time period (LINEAR interpolates there)
+// or, without a period, stays at the last rate.
+// The cumulative rate is integrated once per segment, so an arrival is drawn exactly by inversion:
+// the next one comes at L^-1(L(now) + E), E ~ Exp(1), which costs a binary search over the segments and no rejections
+class RateTable {
+public:
+    enum shape_t: int {STEPS, LINEAR};
+
+private:
+    vector<double> time, rate;
+    vector<double> area; // cumulative rate at every point, the end of the period last
+    shape_t shape;
+    double period;       // 0: none
+
+    double tail_rate() const { return period > 0 && shape == LINEAR ? rate[0] : rate.back(); } // towards the period
+    // integral of the rate over [time[i], time[i] + d], d within segment i
+    double integral(size_t i, double d) const {
+        if (shape == STEPS) return rate[i] * d;
+        double to = i + 1 < time.size() ? time[i + 1] : period;
+        double slope = to > time[i] ? ((i + 1 < rate.size() ? rate[i + 1] : tail_rate()) - rate[i]) / (to - time[i]) : 0;
+        return d * (rate[i] + slope * d / 2);
+    }
+    // d such that integral(i, d) = a
+    double inverse(size_t i, double a) const {
+        if (a <= 0) return 0;
+        if (shape == STEPS) return a / rate[i];
+        double to = i + 1 < time.size() ? time[i + 1] : period;
+        double slope = ((i + 1 < rate.size() ? rate[i + 1] : tail_rate()) - rate[i]) / (to - time[i]);
+        return 2 * a / (rate[i] + sqrt(max(rate[i] * rate[i] + 2 * slope * a, 0.0))); // stable for any slope
+    }
+
+public:
+    RateTable(vector<double> time, vector<double> rate, shape_t shape = STEPS, double period = 0):
+            time(move(time)), rate(move(rate)), shape(shape), period(period) {
+        size_t n = this->time.size();
+        if (n == 0 || n != this->rate.size()) throw invalid_argument("rate table needs as many rates as times, at least one");
+        if (this->time[0] != 0) throw invalid_argument("rate table must start at time 0");
+        for (size_t i = 1; i < n; ++i) if (!(this->time[i] > this->time[i - 1])) throw invalid_argument("rate table times must increase");
+        for (double r : this->rate) if (!(r >= 0) || isinf(r)) throw invalid_argument("rates must be finite and non-negative");
+        if (period != 0 && !(period > this->time.back())) throw invalid_argument("rate table period must be after the last point");
+        area.assign(n + 1, 0);
+        for (size_t i = 0; i + 1 < n; ++i) area[i + 1] = area[i] + integral(i, this->time[i + 1] - this->time[i]);
+        area[n] = area[n - 1] + (period > 0 ? integral(n - 1, period - this->time.back()) : 0);
+        if (period > 0 && !(area[n] > 0)) throw invalid_argument("periodic rate table has no arrivals");
+    }
+
+    // cumulative rate L(t) from time 0
+    double cumulative(double t) const {
+        double base = 0;
+        if (period > 0) {
+            double k = floor(t / period);
+            base = k * area.back();
+            t -= k * period;
+        }
+        size_t i = upper_bound(time.begin(), time.end(), t) - time.begin() - 1;
+        return base + area[i] + (period == 0 && i + 1 == time.size() ? rate.back() * (t - time.back()) : integral(i, t - time[i]));
+    }
+
+    // time from now to the arrival E units of cumulative rate later; infinity if the rate never gives that much
+    double gap(double now, double e) const {
+        double target = cumulative(now) + e, base = 0;
+        if (period > 0) {
+            double k = floor(target / area.back());
+            base = k * period;
+            target -= k * area.back();
+        }
+        else if (target >= area.back()) { // after the last point
+            if (rate.back() == 0) return numeric_limits<double>::infinity();
+            return max(time.back() + (target - area.back()) / rate.back() - now, 0.0);
+        }
+        // the segment where the cumulative rate reaches target; empty segments are never chosen
+        size_t i = upper_bound(area.begin(), area.end() - 1, target) - area.begin() - 1;
+        double to = i + 1 < time.size() ? time[i + 1] : period;
+        double t = base + time[i] + min(inverse(i, target - area[i]), to - time[i]);
+        return max(t - now, 0.0);
+    }
+};
@@ -1,8 +1,12 @@
 #include "gpcc.h"
+#include "checkpoint.h"
+#include "live.h"
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <cmath>
 
-Simulation::Transaction::Transaction(priority_t priority, uint64_t id, bool just_generated): priority(priority), id(id), just_generated(just_generated) {}
+Simulation::Transaction::Transaction(priority_t priority, uint64_t id, bool just_generated): priority(priority), id(id), family(id), just_generated(just_generated) {}
 
 Simulation::SpawnData::SpawnData(const Transaction& transaction, Block* block): transaction(transaction), block(block) {}
 
@@ -12,6 +16,11 @@ bool Simulation::Transaction::operator<(const Transaction& rhs) const { return p
 bool Simulation::SpawnData::operator<(const SpawnData& rhs) const { return transaction < rhs.transaction; }
 bool Simulation::TimedSpawn::operator<(const TimedSpawn& rhs) const { return time > rhs.time ? true : time < rhs.time ? false : spawn_data < rhs.spawn_data; }
 
+Simulation::RemoteSpawn::RemoteSpawn(): block(0), transaction(0, 0), time(0) {}
+Simulation::RemoteSpawn::RemoteSpawn(size_t block, const Transaction& transaction, double time): block(block), transaction(transaction), time(time) {}
+
+Simulation::Monitor::Monitor(bool storage, size_t index, double precision): storage(storage), index(index), precision(precision) {}
+
 
 
 bool Simulation::is_q_empty(size_t index) { return queues[index].data == 0; }
@@ -22,6 +31,7 @@ bool Simulation::is_storage_full(size_t index) { return storages[index].data->fu
 void Simulation::serve(SpawnData& spawn_data) {
     Transaction& transaction = spawn_data.transaction;
     Block* current = spawn_data.block;
+    active = &transaction;
     while (current != nullptr) { 
             
         #ifndef NDEBUG
@@ -40,33 +50,239 @@ bool Simulation::refresh_gates() {
     cout << "refreshing gates\n";
     #endif
     for (auto& gate : gates) if (gate->refresh()) return true;
-    return false;
+    // one pass: every waiter whose condition holds now is resumed, in the order they started waiting
+    size_t before = cond_waits.size();
+    erase_if(cond_waits, [this](CondWait& wait) {
+        if (!wait.check(wait.cond)) return false;
+        priority_spawn_schedule.push(wait.spawn_data);
+        return true;
+    });
+    return cond_waits.size() < before;
+}
+
+double Simulation::get_time() { return g_time; }
+uint64_t Simulation::get_events() { return events; }
+bool Simulation::is_stopped() { return stopped; }
+size_t Simulation::get_q_number() { return queues.size(); }
+size_t Simulation::get_storage_number() { return storages.size(); }
+
+size_t Simulation::get_q_index(const string& name) {
+    for (size_t i = 0; i < queues.size(); ++i) if (queues[i].name == name) return i;
+    throw SimulationException("no queue named \"" + name + "\"");
+}
+
+size_t Simulation::get_storage_index(const string& name) {
+    for (size_t i = 0; i < storages.size(); ++i) if (storages[i].name == name) return i;
+    throw SimulationException("no storage named \"" + name + "\"");
+}
+
+Simulation::QStats Simulation::get_q_stats(size_t index) {
+    const Stat& stat = q_stat[index];
+    double elapsed = g_time - stat_start;
+    if (elapsed <= 0) elapsed = numeric_limits<double>::infinity(); // nothing was observed yet: means are 0
+    return QStats{
+        queues[index].data, stat.max,
+        stat.m / elapsed, stat.m_bm.half_width(confidence),
+        stat.empty / elapsed, stat.empty_bm.half_width(confidence)
+    };
+}
+
+Simulation::StorageStats Simulation::get_storage_stats(size_t index) {
+    const Stat& stat = storage_stat[index];
+    Storage& storage = *storages[index].data;
+    double elapsed = g_time - stat_start;
+    if (elapsed <= 0) elapsed = numeric_limits<double>::infinity();
+    return StorageStats{
+        storage.get_capacity(), storage.get_current(), stat.max,
+        stat.m / elapsed, stat.m_bm.half_width(confidence),
+        stat.m / elapsed / storage.get_capacity(),
+        stat.empty / elapsed, stat.empty_bm.half_width(confidence),
+        stat.full / elapsed, stat.full_bm.half_width(confidence)
+    };
+}
+
+size_t Simulation::get_gate_number() { return gates.size(); }
+const Simulation::GraphReport& Simulation::get_graph_report() { return graph_report; }
+size_t Simulation::get_table_number() { return tables.size(); }
+const Histogram& Simulation::get_table(size_t index) { return tables[index].data; }
+const Histogram& Simulation::get_q_histogram(size_t index) { return q_stat[index].length; }
+const Histogram& Simulation::get_storage_histogram(size_t index) { return storage_stat[index].length; }
+
+// d/dθ of (integral / elapsed) with the period fixed. Transactions still inside subtracted their entry and are
+// counted up to the current time, whose derivative is 0
+double Simulation::get_q_gradient(size_t index) {
+    double elapsed = g_time - stat_start;
+    return elapsed > 0 ? q_stat[index].dm / elapsed : 0;
 }
 
+double Simulation::get_storage_gradient(size_t index) {
+    double elapsed = g_time - stat_start;
+    return elapsed > 0 ? storage_stat[index].dm / elapsed : 0;
+}
+
+size_t Simulation::get_table_index(const string& name) {
+    for (size_t i = 0; i < tables.size(); ++i) if (tables[i].name == name) return i;
+    throw SimulationException("no table named \"" + name + "\"");
+}
+
+template <typename T>
+static Simulation::ChainStats chain_stats(const WaitChain<T, unsigned long>& chain, double now) {
+    return Simulation::ChainStats{chain.size(), chain.get_max(), chain.get_mean_length(now), chain.get_entries(), chain.get_mean_wait(), chain.get_removed()};
+}
+
+Simulation::ChainStats Simulation::get_storage_chain_stats(size_t index) { return chain_stats(storages[index].data->get_chain(), g_time); }
+Simulation::ChainStats Simulation::get_gate_chain_stats(size_t index) { return chain_stats(gates[index]->get_chain(), g_time); }
+
 void Simulation::report() {
+    Report report;
+    report.time = g_time;
+    report.stat_start = stat_start;
+    report.stopped = stopped;
+    report.confidence = confidence;
+    report.graph = graph_report;
+    report.gradient = gradient;
+    for (size_t i = 0; i < queues.size(); ++i)
+        report.queues.push_back(Report::QueueRow{queues[i].name, get_q_stats(i), &q_stat[i].length, ipa ? get_q_gradient(i) : 0});
+    for (size_t i = 0; i < storages.size(); ++i)
+        report.storages.push_back(Report::StorageRow{storages[i].name, get_storage_stats(i), &storage_stat[i].length, get_storage_chain_stats(i),
+                                                     ipa ? get_storage_gradient(i) : 0});
+    for (auto& table : tables) report.tables.push_back(Report::TableRow{table.name, &table.data});
+    for (size_t i = 0; i < gates.size(); ++i) report.gates.push_back(get_gate_chain_stats(i));
+    for (auto flow : flows) report.flows.push_back(flow->row());
+    print_report(report);
+}
+
+void Simulation::print_report(const Report& report) {
     cout << fixed << showpoint;
     cout << setprecision(4);
 
+    const GraphReport& graph_report = report.graph;
+    if (report.stat_start > 0) cout << "Statistics reset at " << report.stat_start << '\n';
+    if (report.stopped) cout << "Stopped at " << report.time << ": target precision reached\n";
+    if (graph_report.bypassed + graph_report.fused + graph_report.dropped > 0)
+        cout << "Graph: " << graph_report.bypassed << " transfers bypassed, " << graph_report.fused << " superblocks of " << graph_report.fused_blocks
+        << " blocks, " << graph_report.dropped << " unreachable blocks dropped\n";
+
+    // CI half-widths from batch means; "-" until there are enough batches
+    auto hw = [](double res) {
+        if (isinf(res)) return string("-");
+        ostringstream out;
+        out << fixed << setprecision(4) << res;
+        return out.str();
+    };
+
     cout << "QUEUES:\n";
-    cout << "\tqueue\t\tCurrent\t\tMax\t\tM\t\tP(0)\n";
-    for (size_t i = 0; i < queues.size(); ++i) cout << "\t" 
-    << queues[i].name << "\t\t"
-    << queues[i].data << "\t\t"
-    << q_stat[i].max << "\t\t"
-    << q_stat[i].m << "\t\t"
-    << q_stat[i].empty << "\n";
+    cout << "\tqueue\t\tCurrent\t\tMax\t\tM\t\t\u00b1M\t\tP(0)\t\t\u00b1P(0)\n";
+    for (auto& [name, stat, length, dm] : report.queues) {
+        cout << "\t"
+        << name << "\t\t"
+        << stat.current << "\t\t"
+        << stat.max << "\t\t"
+        << stat.m << "\t\t"
+        << hw(stat.m_hw) << "\t\t"
+        << stat.empty << "\t\t"
+        << hw(stat.empty_hw) << "\n";
+    }
 
     cout << "STORAGES:\n";
-    cout << "\tstorage\t\tCap\t\tCurrent\t\tMax\t\tM\t\tK\t\tP(0)\t\tP(full)\n";
-    for (size_t i = 0; i < storages.size(); ++i) cout << "\t" 
-    << storages[i].name << "\t\t"
-    << storages[i].data->get_capacity() << "\t\t"
-    << storages[i].data->get_current() << "\t\t"
-    << storage_stat[i].max << "\t\t"
-    << storage_stat[i].m << "\t\t"
-    << storage_stat[i].m / storages[i].data->get_capacity() << "\t\t"
-    << storage_stat[i].empty << "\t\t"
-    << storage_stat[i].full << '\n';
+    cout << "\tstorage\t\tCap\t\tCurrent\t\tMax\t\tM\t\t\u00b1M\t\tK\t\tP(0)\t\t\u00b1P(0)\t\tP(full)\t\t\u00b1P(full)\n";
+    for (auto& [name, stat, content, chain, dm] : report.storages) {
+        cout << "\t"
+        << name << "\t\t"
+        << stat.capacity << "\t\t"
+        << stat.current << "\t\t"
+        << stat.max << "\t\t"
+        << stat.m << "\t\t"
+        << hw(stat.m_hw) << "\t\t"
+        << stat.k << "\t\t"
+        << stat.empty << "\t\t"
+        << hw(stat.empty_hw) << "\t\t"
+        << stat.full << "\t\t"
+        << hw(stat.full_hw) << '\n';
+    }
+
+    // quantiles of integer metrics: the value whose bucket holds the quantile
+    cout << "DISTRIBUTIONS (time-weighted):\n";
+    cout << "\tentity\t\tp50\t\tp95\t\tp99\n";
+    auto print_length = [](const string& name, const Histogram& hist) {
+        cout << "\t" << name << "\t\t"
+        << size_t(hist.quantile(0.5)) << "\t\t"
+        << size_t(hist.quantile(0.95)) << "\t\t"
+        << size_t(hist.quantile(0.99)) << '\n';
+    };
+    for (auto& row : report.queues) print_length(row.name, *row.length);
+    for (auto& row : report.storages) print_length(row.name, *row.content);
+
+    if (!report.tables.empty()) {
+        cout << "TABLES:\n";
+        cout << "\ttable\t\tEntries\t\tMean\t\tp50\t\tp95\t\tp99\t\tMax\n";
+        for (auto& [name, table] : report.tables) {
+            cout << "\t"
+            << name << "\t\t"
+            << uint64_t(table->weight()) << "\t\t"
+            << table->mean() << "\t\t"
+            << table->quantile(0.5) << "\t\t"
+            << table->quantile(0.95) << "\t\t"
+            << table->quantile(0.99) << "\t\t"
+            << table->max() << '\n';
+        }
+    }
+
+    cout << "CHAINS:\n";
+    cout << "\tchain\t\tCurrent\t\tMax\t\tM\t\tEntries\t\tWait\n";
+    auto print_chain = [](const string& name, const ChainStats& stat) {
+        cout << "\t"
+        << name << "\t\t"
+        << stat.current << "\t\t"
+        << stat.max << "\t\t"
+        << stat.m << "\t\t"
+        << stat.entries << "\t\t"
+        << stat.wait << '\n';
+    };
+    for (auto& row : report.storages) print_chain(row.name, row.chain);
+    for (size_t i = 0; i < report.gates.size(); ++i) print_chain("gate " + to_string(i), report.gates[i]);
+
+    // transactions that left a chain by their renege label: patience ran out or INTERRUPT
+    bool reneging = false;
+    for (auto& row : report.storages) reneging |= row.chain.reneged > 0;
+    for (auto& gate : report.gates) reneging |= gate.reneged > 0;
+    if (reneging) {
+        cout << "RENEGING:\n";
+        cout << "\tchain\t\tReneged\t\tShare\n";
+        auto print_reneged = [](const string& name, const ChainStats& stat) {
+            if (stat.reneged == 0) return;
+            cout << "\t"
+            << name << "\t\t"
+            << stat.reneged << "\t\t"
+            << double(stat.reneged) / stat.entries << '\n';
+        };
+        for (auto& row : report.storages) print_reneged(row.name, row.chain);
+        for (size_t i = 0; i < report.gates.size(); ++i) print_reneged("gate " + to_string(i), report.gates[i]);
+    }
+
+    if (!report.flows.empty()) {
+        cout << "FLOWS:\n";
+        cout << "\tstorage\t\tRate\t\tStep\t\tInside\t\tBacklog\t\tArrivals\t\tAdmitted\n";
+        for (auto& [storage, rate, step, inside, backlog, arrivals, admitted] : report.flows) {
+            cout << "\t"
+            << storage << "\t\t"
+            << rate << "\t\t"
+            << step << "\t\t"
+            << inside << "\t\t"
+            << backlog << "\t\t"
+            << arrivals << "\t\t"
+            << admitted << '\n';
+        }
+    }
+
+    if (!report.gradient.empty()) {
+        cout << "GRADIENT (d/d " << report.gradient << ", IPA):\n";
+        cout << "\tentity\t\tdM\t\tdK\n";
+        for (auto& row : report.queues) cout << "\t" << row.name << "\t\t" << row.dm << "\t\t-\n";
+        for (auto& row : report.storages) cout << "\t" << row.name << "\t\t" << row.dm << "\t\t" << row.dm / row.stats.capacity << '\n';
+    }
+
+    cout << "Confidence level: " << setprecision(2) << report.confidence << '\n';
 }
 
 void Simulation::save_stat(double delta) {
@@ -74,52 +290,262 @@ void Simulation::save_stat(double delta) {
         q_stat[i].max = max(q_stat[i].max, queues[i].data);
         q_stat[i].m += queues[i].data * delta;
         if (queues[i].data == 0) q_stat[i].empty += delta;
+        if (q_stat[i].m_bm.add(queues[i].data, delta)) check_pending = true;
+        q_stat[i].empty_bm.add(queues[i].data == 0, delta);
+        if (delta > 0) q_stat[i].length.add(queues[i].data, delta);
     }
 
     for (size_t i = 0; i < storages.size(); ++i) { // storages
-        storage_stat[i].max = max(storage_stat[i].max, storages[i].data->get_current());
-        storage_stat[i].m += storages[i].data->get_current() * delta;
+        size_t current = storages[i].data->get_current();
+        storage_stat[i].max = max(storage_stat[i].max, current);
+        storage_stat[i].m += current * delta;
         if (storages[i].data->empty()) storage_stat[i].empty += delta;
         else if (storages[i].data->full()) storage_stat[i].full += delta;
+        if (storage_stat[i].m_bm.add(current, delta)) check_pending = true;
+        storage_stat[i].empty_bm.add(storages[i].data->empty(), delta);
+        storage_stat[i].full_bm.add(!storages[i].data->empty() && storages[i].data->full(), delta);
+        if (delta > 0) storage_stat[i].length.add(current, delta);
     }
+
+    if (!warmup_done) for (auto& monitor : monitors) if (monitor.mser.add(monitor_value(monitor), delta)) check_pending = true;
 }
 
-void Simulation::finalize_stat() {
-    for (size_t i = 0; i < queues.size(); ++i) { q_stat[i].m /= g_time; q_stat[i].empty /= g_time; }
-    for (size_t i = 0; i < storages.size(); ++i) {
-        storage_stat[i].m /= g_time;
-        storage_stat[i].empty /= g_time;
-        storage_stat[i].full /= g_time;
+double Simulation::monitor_value(const Monitor& monitor) {
+    if (monitor.storage) return storages[monitor.index].data->get_current();
+    return queues[monitor.index].data;
+}
+
+const BatchMeans& Simulation::monitor_bm(const Monitor& monitor) {
+    if (monitor.storage) return storage_stat[monitor.index].m_bm;
+    return q_stat[monitor.index].m_bm;
+}
+
+// RESET: transient statistics are discarded, max restarts from the current content
+void Simulation::reset_stat() {
+    auto fresh = [this](size_t level) {
+        Stat stat;
+        stat.max = level;
+        stat.m_bm = stat.empty_bm = stat.full_bm = BatchMeans(batch_length);
+        return stat;
+    };
+    for (size_t i = 0; i < queues.size(); ++i) q_stat[i] = fresh(queues[i].data);
+    for (size_t i = 0; i < storages.size(); ++i) storage_stat[i] = fresh(storages[i].data->get_current());
+    for (auto& storage : storages) storage.data->get_chain().reset_stat(g_time);
+    for (auto& gate : gates) gate->get_chain().reset_stat(g_time);
+    for (auto flow : flows) flow->reset_stat();
+    for (auto& table : tables) table.data.reset();
+    stat_start = g_time;
+}
+
+void Simulation::check_monitors() {
+    check_pending = false;
+
+    if (!warmup_done) {
+        // MSER-5 is rerun each time the series doubles. Statistics are reset at the moment of detection,
+        // which is never earlier than the truncation point, so the deletion is conservative
+        size_t n = monitors.front().mser.batches();
+        if (n < mser_check) return;
+        mser_check *= 2;
+        for (auto& monitor : monitors) if (monitor.mser.truncation() * 2 >= n) return;
+        for (auto& monitor : monitors) monitor.mser.clear();
+        warmup_done = true;
+        reset_stat();
+        return;
     }
+
+    bool any = false;
+    for (auto& monitor : monitors) {
+        if (monitor.precision <= 0) continue;
+        const BatchMeans& bm = monitor_bm(monitor);
+        // a metric that has stayed at 0 has no relative precision yet, however narrow its interval
+        if (bm.mean() == 0 || bm.half_width(confidence) > monitor.precision * abs(bm.mean())) return;
+        any = true;
+    }
+    stopped = any;
 }
 
-void Simulation::launch() {
-    while (g_time < end_time && !spawn_schedule.empty()) {
-        #ifndef NDEBUG
-        cout << "entering main section\n";
-        #endif
-        TimedSpawn spawn = spawn_schedule.top();
-        spawn_schedule.pop();
-        
-        #ifndef NDEBUG
-        cout << "advancing " << spawn.time - g_time << '\n';
-        #endif
+void Simulation::post(size_t lp, size_t block, const Transaction& transaction, double time) {
+    outbox[lp]->push(RemoteSpawn(block, transaction, time));
+}
 
-        save_stat(spawn.time - g_time);
+void Simulation::receive() {
+    RemoteSpawn remote;
+    for (auto& channel : inbox) while (channel->pop(remote))
+        spawn_schedule.emplace(SpawnData(remote.transaction, blocks[remote.block].get()), remote.time);
+}
 
-        g_time = spawn.time;
-        serve(spawn.spawn_data);
+void Simulation::advance_clock(double time) {
+    if (time > reset_time) {
+        save_stat(reset_time - g_time);
+        g_time = reset_time;
+        reset_time = numeric_limits<double>::infinity();
+        reset_stat();
+    }
 
-        #ifndef NDEBUG
-        cout << "entering refresh section\n";
-        #endif
-        while (!priority_spawn_schedule.empty() || refresh_gates()) {
-            SpawnData data = priority_spawn_schedule.front();
-            priority_spawn_schedule.pop();
-            serve(data);
-        }
+    save_stat(time - g_time);
+    g_time = time;
+}
+
+bool Simulation::serve_next() {
+    #ifndef NDEBUG
+    cout << "entering main section\n";
+    cout << "advancing " << spawn_schedule.top().time - g_time << '\n';
+    #endif
+
+    advance_clock(spawn_schedule.top().time);
+    if (check_pending) check_monitors();
+    if (stopped) return false;
+
+    TimedSpawn spawn = spawn_schedule.top();
+    spawn_schedule.pop();
+    ++events;
+    serve(spawn.spawn_data);
+
+    #ifndef NDEBUG
+    cout << "entering refresh section\n";
+    #endif
+    while (!priority_spawn_schedule.empty() || refresh_gates()) {
+        SpawnData data = priority_spawn_schedule.front();
+        priority_spawn_schedule.pop();
+        serve(data);
+    }
+
+    if (g_time >= next_checkpoint) {
+        try { checkpoint_file->post(image()); }
+        catch (const SimulationException&) { throw; }
+        catch (const runtime_error& e) { throw SimulationException(e.what()); } // an earlier write failed
+        while (next_checkpoint <= g_time) next_checkpoint += checkpoint_interval;
+    }
+    if (events >= next_publish) {
+        next_publish = events + LiveSegment::stride;
+        if (live->due()) publish_live(false);
+    }
+    return true;
+}
+
+bool Simulation::process(double until) {
+    while (pending() && spawn_schedule.top().time < until) {
+        if (pause_requested.load(memory_order_relaxed)) { pause_requested = false; return false; }
+        if (!serve_next()) return false;
+    }
+    return !stopped;
+}
+
+void Simulation::run_until(double time) {
+    if (time < g_time) throw SimulationException("run_until: time is in the past");
+    pause_requested = false; // a pause() while idle must not cut this run short
+    if (process(nextafter(time, numeric_limits<double>::infinity()))) advance_clock(time);
+    if (live != nullptr && live->due()) publish_live(false);
+}
+
+size_t Simulation::step(size_t n_events) {
+    size_t served = 0;
+    pause_requested = false;
+    while (served < n_events && pending()) {
+        if (pause_requested.load(memory_order_relaxed)) { pause_requested = false; break; }
+        if (!serve_next()) break;
+        ++served;
+    }
+    return served;
+}
+
+void Simulation::pause() { pause_requested = true; }
+
+uint32_t Simulation::take_ticket(GateBlock* gate, size_t storage, Block* renege) {
+    uint32_t ticket = free_ticket;
+    if (ticket != no_ticket) free_ticket = tickets[ticket].node;
+    else {
+        if (tickets.size() == no_ticket) throw SimulationException("too many reneging transactions");
+        ticket = tickets.size();
+        tickets.emplace_back();
+    }
+    Ticket& t = tickets[ticket];
+    t.timed = false;
+    t.gate = gate;
+    t.storage = storage;
+    t.renege = renege;
+    return ticket;
+}
+
+void Simulation::release_ticket(uint32_t ticket) {
+    Ticket& t = tickets[ticket];
+    ++t.generation;
+    if (t.timed) ++stale_timers;
+    t.timed = false;
+    t.node = free_ticket;
+    free_ticket = ticket;
 
+    // heavy reneging: without the dead timers the schedule is at most half as deep
+    if (stale_timers > 256 && stale_timers * 2 > spawn_schedule.size()) {
+        vector<TimedSpawn> live;
+        live.reserve(spawn_schedule.size() - stale_timers);
+        for (; !spawn_schedule.empty(); spawn_schedule.pop()) if (!is_stale(spawn_schedule.top())) live.push_back(spawn_schedule.top());
+        spawn_schedule = priority_queue<TimedSpawn>(less<TimedSpawn>(), move(live));
+        stale_timers = 0;
     }
-    finalize_stat();
+}
+
+void Simulation::start_timer(uint32_t ticket, const Transaction& transaction, Block* owner, double patience) {
+    if (!(patience >= 0)) throw SimulationException("patience must be non-negative");
+    if (isinf(patience)) return; // waits until it gets through or is interrupted
+    Transaction timer(transaction.priority, uint64_t(tickets[ticket].generation) << 32 | ticket);
+    timer.timer = true;
+    tickets[ticket].timed = true;
+    spawn_schedule.emplace(SpawnData(timer, owner), g_time + patience);
+}
+
+bool Simulation::is_stale(const TimedSpawn& spawn) const {
+    const Transaction& transaction = spawn.spawn_data.transaction;
+    return transaction.timer && tickets[uint32_t(transaction.id)].generation != uint32_t(transaction.id >> 32);
+}
+
+bool Simulation::pending() {
+    for (; stale_timers > 0 && !spawn_schedule.empty() && is_stale(spawn_schedule.top()); --stale_timers) spawn_schedule.pop();
+    return !spawn_schedule.empty();
+}
+
+void Simulation::expire(const Transaction& timer) {
+    uint32_t ticket = uint32_t(timer.id);
+    if (tickets[ticket].generation != uint32_t(timer.id >> 32)) { --stale_timers; return; } // pending() let it through
+    tickets[ticket].timed = false;
+    renege(ticket);
+}
+
+void Simulation::renege(uint32_t ticket) {
+    Ticket& t = tickets[ticket];
+    Transaction transaction = t.gate != nullptr ? t.gate->get_chain().remove(t.node, g_time) : storages[t.storage].data->withdraw(t.node).transaction;
+    Block* to = t.renege;
+    release_ticket(ticket);
+    priority_spawn_schedule.push(SpawnData(transaction, to));
+}
+
+void Simulation::interrupt(GateBlock* gate, size_t storage) {
+    vector<uint32_t> waiting; // renege() changes the chain
+    auto collect = [&](uint32_t, uint32_t ticket) { if (ticket != no_ticket) waiting.push_back(ticket); };
+    if (gate != nullptr) gate->get_chain().visit(collect);
+    else storages[storage].data->get_chain().visit(collect);
+    for (uint32_t ticket : waiting) renege(ticket);
+}
+
+void Simulation::launch() {
+    pause_requested = false;
+    if (process(end_time)) advance_clock(end_time); // the model is idle between the last event and end_time
+    if (live != nullptr) publish_live(true);
     report();
-} 
\ No newline at end of file
+}
+
+void Simulation::publish_live(bool finished) {
+    double elapsed = g_time - stat_start;
+    if (elapsed <= 0) elapsed = numeric_limits<double>::infinity();
+    vector<LiveLevel> levels;
+    levels.reserve(queues.size() + storages.size());
+    for (size_t i = 0; i < queues.size(); ++i) {
+        const Stat& stat = q_stat[i];
+        levels.push_back(LiveLevel{queues[i].data, stat.max, stat.m / elapsed, stat.empty / elapsed, 0});
+    }
+    for (size_t i = 0; i < storages.size(); ++i) {
+        const Stat& stat = storage_stat[i];
+        levels.push_back(LiveLevel{storages[i].data->get_current(), stat.max, stat.m / elapsed, stat.empty / elapsed, stat.full / elapsed});
+    }
+    live->publish(LiveStats{g_time, end_time, stat_start, 0, 0, events, finished}, levels);
+}
\ No newline at end of file
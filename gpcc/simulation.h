@@ -3,6 +3,14 @@
 #include <queue>
 #include <memory>
 #include <stdexcept>
+#include <limits>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include "stats.h"
+#include "channel.h"
+#include "pool.h"
+#include "group.h"
 
 using namespace std;
 
@@ -12,6 +20,9 @@ public:
     SimulationException(const string& msg): runtime_error(msg) {}
 };
 
+class CheckpointFile; // see gpcc/checkpoint.h
+class LiveSegment;    // see gpcc/live.h
+
 class Simulation {
 public:
 private:
@@ -26,6 +37,9 @@ private:
         double m = 0;
         double empty = 0;
         double full = 0;
+        BatchMeans m_bm, empty_bm, full_bm; // interval estimates of m, empty and full
+        Histogram length;                   // time-weighted distribution of the length or content
+        double dm = 0;                      // IPA: derivative of the integral behind m by the parameter (see SimBuilder::set_gradient)
     };
 
     template <typename T>
@@ -43,7 +57,13 @@ private:
     struct Transaction {
         priority_t priority;
         uint64_t id;
+        uint64_t family; // assembly set: id of the transaction the family started from (see SPLIT)
         bool just_generated;
+        bool scaled = false; // IPA: comes from a GENERATE whose rate is the parameter
+        bool timer = false;  // not a transaction: the patience timer of the ticket in id (see Ticket)
+        uint32_t selected = 0; // storage chosen by the last SELECT (see SimBuilder::add_leave_selected)
+        double mark = 0; // M1 is measured from here: time of generation or of the last MARK
+        double perturbation = 0; // IPA: derivative of the time the transaction is at by the parameter
 
         Transaction(priority_t priority, uint64_t id, bool just_generateed = false);
         bool operator<(const Transaction& rhs) const; // higher prioriry -> better
@@ -78,8 +98,44 @@ private:
     class TransferBlock_prob;
     class DebugBlock;
     class TerminateBlock;
+    class CoroutineBlock;
+    class FusedBlock;
+    class MarkBlock;
+    class TabulateBlock;
+    class SplitBlock;
+    class AssembleBlock;
+    class GatherBlock;
+    class MatchBlock;
+    class FlowBlock;
+    class SelectBlock;
+    class EnterBlock_renege;
+    class GateBlock_renege;
+    class InterruptBlock;
     class Storage;
 
+    // every live coroutine frame is linked here, so that the simulation can destroy the suspended ones
+    struct CoroutineLink {
+        CoroutineLink* prev = nullptr;
+        CoroutineLink* next = nullptr;
+    };
+
+    // coroutine waiting for a condition (see Context::wait_until). cond lives in the suspended frame
+    struct CondWait {
+        bool (*check)(void* cond);
+        void* cond;
+        SpawnData spawn_data;
+    };
+
+    // transaction handed over to another logical process (parallel execution). block is an index in blocks
+    struct RemoteSpawn {
+        size_t block;
+        Transaction transaction;
+        double time;
+
+        RemoteSpawn();
+        RemoteSpawn(size_t block, const Transaction& transaction, double time);
+    };
+
     double g_time = 0;
     double end_time;
     vector<unique_ptr<Block>> blocks;
@@ -87,31 +143,252 @@ private:
     vector<NamedVar<size_t>> queues;
     vector<NamedVar<unique_ptr<Storage>>> storages;
     vector<GateBlock*> gates;
+    vector<FlowBlock*> flows;
+    vector<NamedVar<unique_ptr<StorageGroup>>> groups; // of SELECT
+    vector<NamedVar<Histogram>> tables;
     priority_queue<TimedSpawn> spawn_schedule; // spawn_shedule is the main schedule with time as priority parameter
     queue<SpawnData> priority_spawn_schedule;  // priority_spawn_schedule is a special queue that holds tranasctions that just became able to move after being suspended (e.g. gate, enter etc.)
 
+    vector<SpscQueue<RemoteSpawn>*> outbox; // indexed by logical process; empty in sequential mode
+    vector<SpscQueue<RemoteSpawn>*> inbox;
+
+    void post(size_t lp, size_t block, const Transaction& transaction, double time);
+    void receive(); // moves remote spawns to spawn_schedule
+
+    FramePool frames;                    // coroutine frames of CoroutineBlock
+    vector<CondWait> cond_waits;
+    CoroutineLink* live_coroutines = nullptr;
+
+    uint64_t events = 0; // timed events served so far
+    const Transaction* active = nullptr; // transaction being served, read by expressions (PR)
+    atomic<bool> pause_requested = false;
+
+    // reneging: a transaction that waits in a delay chain with a renege label holds a ticket. Its patience timer is an
+    // ordinary event carrying the ticket and its generation; if the transaction leaves the chain first, the ticket is
+    // released and its generation moves on, which cancels the timer. Stale timers are dropped when they reach the top
+    // of the schedule, and all at once when they make up half of it, so cancelled timers cost O(log n) amortized
+    struct Ticket {
+        uint32_t generation = 0;
+        uint32_t node;           // in the chain; next free ticket once released
+        bool timed = false;      // its timer is in the schedule
+        GateBlock* gate;         // chain of the gate; nullptr: of storages[storage]
+        size_t storage;
+        Block* renege;
+    };
+    static constexpr uint32_t no_ticket = UINT32_MAX;
+    vector<Ticket> tickets;
+    uint32_t free_ticket = no_ticket;
+    uint64_t stale_timers = 0;
+
+    uint32_t take_ticket(GateBlock* gate, size_t storage, Block* renege);
+    void release_ticket(uint32_t ticket);
+    void start_timer(uint32_t ticket, const Transaction& transaction, Block* owner, double patience); // owner gets the timer back
+    void expire(const Transaction& timer);
+    void renege(uint32_t ticket);     // the transaction leaves its chain for the renege label now
+    void interrupt(GateBlock* gate, size_t storage); // every ticket of a chain reneges
+    bool is_stale(const TimedSpawn& spawn) const;
+    bool pending();                   // drops stale timers from the top of the schedule. false: it is empty
+
     void serve(SpawnData& data); // serves a transaction until it dies
+    bool serve_next();           // serves the earliest timed event and everything it wakes up. false: stopping rule fired
+    bool process(double until);  // serves every event scheduled strictly before until. false: paused or stopped
+    void advance_clock(double time); // integrates statistics up to time, applying a pending RESET
     bool refresh_gates();
-    void report();
 
     void save_stat(double delta);
-    void finalize_stat();
 
     struct Stat;
 
     vector<Stat> q_stat, storage_stat;
 
+    // output analysis: metrics watched for warm-up detection and for the stopping rule
+    struct Monitor {
+        bool storage;     // false: queue length; true: storage content
+        size_t index;
+        double precision; // target relative CI half-width; 0: not a part of the stopping rule
+        Mser mser;
+
+        Monitor(bool storage, size_t index, double precision);
+    };
+
+    vector<Monitor> monitors;
+    double stat_start = 0;                                  // time of the last statistics reset
+    double reset_time = numeric_limits<double>::infinity(); // RESET at this time
+    double warmup_interval = 0;                             // MSER-5 observation length; 0: no automatic warm-up detection
+    double batch_length = 0;                                // initial batch length of batch means
+    double confidence = 0.95;
+    bool warmup_done = true;
+    size_t mser_check = Mser::min_batches; // series length at which MSER is rerun next
+    bool check_pending = false; // some monitor completed a batch since the last check
+    bool stopped = false;       // stopping rule was satisfied
+
+    double monitor_value(const Monitor& monitor);
+    const BatchMeans& monitor_bm(const Monitor& monitor);
+    void reset_stat();
+    void check_monitors();
+
+    // checkpoints: the state is serialized by the event loop and written by CheckpointFile on its own thread
+    unique_ptr<CheckpointFile> checkpoint_file; // nullptr: no periodic checkpoints
+    double checkpoint_interval = 0;
+    double next_checkpoint = numeric_limits<double>::infinity();
+    unordered_map<const Block*, size_t> block_ids; // filled while the state is saved
+
+    // live statistics in shared memory, for monitors of a running simulation
+    unique_ptr<LiveSegment> live; // nullptr: not exported
+    uint64_t next_publish = numeric_limits<uint64_t>::max(); // event count at which the wall clock is checked next
+    void publish_live(bool finished);
+
+    // infinitesimal perturbation analysis: every transaction carries the derivative of its clock by one rate
+    // (SimBuilder::set_gradient); a queue or storage adds it when the transaction leaves and subtracts it when it comes,
+    // which sums the derivatives of the times spent there.
+    // The clock of an arrival drifts by -t / rate, so a transaction still inside at the end would add a term that grows
+    // with the run. Scaled transactions are measured from the clock of their generator instead, which drops that term,
+    // and every unit of time they spend inside adds 1 / rate for the arrivals a higher rate brings in
+    bool ipa = false;
+    string gradient;        // name of the parameter
+    double ipa_scale = 0;   // 1 / rate if it is the rate of a GENERATE
+    double ipa_clock(const Transaction& transaction) const { return transaction.perturbation + (transaction.scaled ? ipa_scale * g_time : 0); }
+    void ipa_arrive(Stat& stat, const Transaction& transaction) { if (ipa) stat.dm -= ipa_clock(transaction); }
+    void ipa_depart(Stat& stat, const Transaction& transaction) { if (ipa) stat.dm += ipa_clock(transaction); }
+
+    uint64_t fingerprint(); // of the block graph and entities: a checkpoint is loaded only into the same model
+    void load_image(const vector<char>& data); // throws runtime_error
+    void save_state(StateWriter& out);
+    void load_state(StateReader& in);
+    void save_spawn(StateWriter& out, const SpawnData& spawn);
+    SpawnData load_spawn(StateReader& in);
+    static void save_transaction(StateWriter& out, const Transaction& transaction);
+    static Transaction load_transaction(StateReader& in);
+
     friend class SimBuilder;
+    friend class ParallelSimulation;
+    friend class LaneSimulation;
 
 public:
+    class Coroutine; // return type of coroutines used as blocks (see SimBuilder::add_coroutine)
+    class Context;   // what such a coroutine gets: the transaction, the clock and awaitable actions
+    class Expr;      // numeric expression over queues, storages, the clock and the transaction (see gpcc/expr.h)
+
+    // current statistics over [time of the last reset; current time]. Nothing is finalized, so they can be queried at any moment
+    struct QStats {
+        size_t current;
+        size_t max;
+        double m, m_hw;         // mean length and its CI half-width (infinity until there are enough batches)
+        double empty, empty_hw; // P(0)
+    };
+    struct StorageStats {
+        size_t capacity;
+        size_t current;
+        size_t max;
+        double m, m_hw;
+        double k;               // utilization
+        double empty, empty_hw;
+        double full, full_hw;
+    };
+
+    struct ChainStats {
+        size_t current;
+        size_t max;
+        double m;         // time-weighted mean length
+        uint64_t entries;
+        double wait;      // mean time in the chain of transactions that left it
+        uint64_t reneged = 0;
+    };
+
+    // what SimBuilder::build() changed in the block graph
+    struct GraphReport {
+        size_t bypassed = 0;     // edges to TRANSFER(imm) redirected to its label
+        size_t fused = 0;        // superblocks made of QUEUE, DEPART, ENTER and LEAVE runs
+        size_t fused_blocks = 0; // blocks covered by them
+        size_t dropped = 0;      // unreachable blocks removed
+        vector<string> cycles;   // zero-time cycles that may loop depending on conditions
+    };
+
+    // everything report() prints. Engines that keep their own state (dsl/dsl.h) fill one to print the same report
+    struct Report {
+        struct QueueRow {
+            string name;
+            QStats stats;
+            const Histogram* length;
+            double dm = 0; // of the gradient
+        };
+        struct StorageRow {
+            string name;
+            StorageStats stats;
+            const Histogram* content;
+            ChainStats chain;
+            double dm = 0;
+        };
+        struct TableRow {
+            string name;
+            const Histogram* table;
+        };
+        struct FlowRow {
+            string storage;
+            double rate, step;
+            size_t inside, backlog;      // current
+            uint64_t arrivals, admitted; // since the last reset
+        };
+
+        double time = 0;
+        double stat_start = 0;
+        bool stopped = false;
+        double confidence = 0.95;
+        GraphReport graph;
+        string gradient; // parameter of dm; empty: no gradient
+        vector<QueueRow> queues;
+        vector<StorageRow> storages;
+        vector<TableRow> tables;
+        vector<ChainStats> gates;
+        vector<FlowRow> flows;
+    };
+    static void print_report(const Report& report);
+
+    double get_time();
+    uint64_t get_events();
+    bool is_stopped();
+    size_t get_q_number();
+    size_t get_storage_number();
+    size_t get_q_index(const string& name); // throws if there is no such queue
+    size_t get_storage_index(const string& name);
+    QStats get_q_stats(size_t index);
+    StorageStats get_storage_stats(size_t index);
+    size_t get_gate_number();
+    ChainStats get_storage_chain_stats(size_t index); // delay chain of a storage
+    ChainStats get_gate_chain_stats(size_t index);    // gates are numbered in the order they were added
+    const GraphReport& get_graph_report();
+    size_t get_table_number();
+    size_t get_table_index(const string& name);
+    const Histogram& get_table(size_t index);
+    const Histogram& get_q_histogram(size_t index);       // time-weighted queue length since the last reset
+    const Histogram& get_storage_histogram(size_t index); // time-weighted storage content
+    double get_q_gradient(size_t index);       // IPA estimate of d(mean length) / d(parameter of SimBuilder::set_gradient)
+    double get_storage_gradient(size_t index); // of d(mean content) / d(parameter); divided by the capacity for utilization
 
     bool is_q_empty(size_t index);
     bool is_storage_empty(size_t index);
     bool is_storage_avail(size_t index);
     bool is_storage_full(size_t index);
 
-    void launch();
+    void run_until(double time);        // serves every event up to time (inclusive), then moves the clock to time
+    size_t step(size_t n_events = 1);   // serves at most n_events timed events, returns how many were served
+    void pause();                       // may be called from another thread: run_until or step returns after the current event.
+                                        // Each run_until, step or launch starts unpaused: a pause() while none runs is dropped
+    void report();
+    void launch();                      // runs until end_time and prints the report
+    // full state: schedule, chains, entities, statistics, generators, transaction ids. Configuration such as
+    // end_time is not a part of it. restore() takes a checkpoint of a simulation built by the same recipe;
+    // the run then continues exactly as the saved one would have. Suspended coroutines can not be saved
+    void save_checkpoint(const string& path);
+    void restore(const string& path);
+    vector<char> image();                          // the state as save_checkpoint writes it, in memory
+    void restore_image(const vector<char>& image); // as restore(), e.g. to run many continuations of one state
+    void reseed(uint64_t seed); // moves every generator to a stream of its own for this seed, so that clones of a state diverge
 
+private:
+    GraphReport graph_report; // filled by SimBuilder::build()
+
+public:
     Simulation(Simulation&) = delete; // TODO: implement deep copy and move semantics for sim
     Simulation();
     ~Simulation();
@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+using namespace std;
+
+// Binary image of simulation state, used by checkpoints. Values are stored as raw bytes, so an image is
+// read back only by the same build on the same platform
+class StateWriter {
+private:
+    vector<char> data;
+
+public:
+    template <typename T>
+    void put(const T& value) {
+        static_assert(is_trivially_copyable_v<T>);
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        data.insert(data.end(), bytes, bytes + sizeof(T));
+    }
+    template <typename T>
+    void put_vector(const vector<T>& values) {
+        static_assert(is_trivially_copyable_v<T>);
+        put(uint64_t(values.size()));
+        const char* bytes = reinterpret_cast<const char*>(values.data());
+        data.insert(data.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+    void put_string(const string& value) {
+        put(uint64_t(value.size()));
+        data.insert(data.end(), value.begin(), value.end());
+    }
+
+    vector<char>& bytes() { return data; }
+};
+
+class StateReader {
+private:
+    const char* data;
+    size_t size;
+    size_t pos = 0;
+
+    const char* take(size_t n) {
+        if (n > size - pos) throw runtime_error("state image is truncated");
+        pos += n;
+        return data + pos - n;
+    }
+
+public:
+    StateReader(const vector<char>& data): data(data.data()), size(data.size()) {}
+
+    template <typename T>
+    T get() {
+        static_assert(is_trivially_copyable_v<T>);
+        T value;
+        memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+    template <typename T>
+    void get(T& value) { value = get<T>(); }
+    template <typename T>
+    void get_vector(vector<T>& values) {
+        uint64_t n = get<uint64_t>();
+        if (n > (size - pos) / sizeof(T)) throw runtime_error("state image is truncated");
+        values.resize(n);
+        memcpy(values.data(), take(n * sizeof(T)), n * sizeof(T));
+    }
+    string get_string() {
+        uint64_t n = get<uint64_t>();
+        const char* bytes = take(n);
+        return string(bytes, n);
+    }
+
+    bool done() const { return pos == size; }
+};
@@ -0,0 +1,250 @@
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <stdexcept>
+#include <algorithm>
+#include "stats.h"
+
+using namespace std;
+
+// Acklam's rational approximation of the standard normal quantile (relative error < 1.2e-9)
+static double normal_quantile(double p) {
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00, -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00, 3.754408661907416e+00};
+    const double low = 0.02425;
+
+    if (p < low) {
+        double q = sqrt(-2 * log(p));
+        return (((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) / ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1);
+    }
+    if (p > 1 - low) {
+        double q = sqrt(-2 * log(1 - p));
+        return -(((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) / ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1);
+    }
+    double q = p - 0.5, r = q * q;
+    return (((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5])*q / (((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1);
+}
+
+double t_quantile(double p, size_t df) {
+    if (df == 0) return numeric_limits<double>::infinity();
+    if (df == 1) return tan(numbers::pi * (p - 0.5));                 // Cauchy
+    if (df == 2) return (2 * p - 1) / sqrt(2 * p * (1 - p));
+    // Cornish-Fisher expansion around the normal quantile
+    double z = normal_quantile(p), v = df;
+    double z2 = z * z, z3 = z2 * z, z5 = z3 * z2, z7 = z5 * z2, z9 = z7 * z2;
+    return z
+        + (z3 + z) / (4 * v)
+        + (5*z5 + 16*z3 + 3*z) / (96 * v*v)
+        + (3*z7 + 19*z5 + 17*z3 - 15*z) / (384 * v*v*v)
+        + (79*z9 + 776*z7 + 1482*z5 - 1920*z3 - 945*z) / (92160 * v*v*v*v);
+}
+
+BatchMeans::BatchMeans(double length): length(length) {}
+
+void BatchMeans::push(double mean) {
+    if (batch.empty()) batch.reserve(slots);
+    batch.push_back(mean);
+    if (batch.size() < slots) return;
+    for (size_t i = 0; i < slots / 2; ++i) batch[i] = (batch[2*i] + batch[2*i + 1]) / 2; // collapse pairs
+    batch.resize(slots / 2);
+    length *= 2;
+}
+
+bool BatchMeans::add(double value, double delta) {
+    bool completed = false;
+    while (filled + delta >= length) { // metric is constant over delta, so it can be split at batch bounds
+        double part = length - filled;
+        push((acc + value * part) / length);
+        delta -= part;
+        acc = filled = 0;
+        completed = true;
+    }
+    acc += value * delta;
+    filled += delta;
+    return completed;
+}
+
+void BatchMeans::reset(double length) {
+    this->length = length;
+    batch.clear();
+    acc = filled = 0;
+}
+
+size_t BatchMeans::batches() const { return batch.size(); }
+
+double BatchMeans::mean() const {
+    if (batch.empty()) return 0;
+    double sum = 0;
+    for (double b : batch) sum += b;
+    return sum / batch.size();
+}
+
+double BatchMeans::half_width(double confidence) const {
+    size_t n = batch.size();
+    if (n < min_batches) return numeric_limits<double>::infinity();
+    double m = mean(), s2 = 0;
+    for (double b : batch) s2 += (b - m) * (b - m);
+    s2 /= n - 1;
+    return t_quantile((1 + confidence) / 2, n - 1) * sqrt(s2 / n);
+}
+
+void BatchMeans::save(StateWriter& out) const {
+    out.put_vector(batch);
+    out.put(length);
+    out.put(acc);
+    out.put(filled);
+}
+
+void BatchMeans::load(StateReader& in) {
+    in.get_vector(batch);
+    if (batch.size() >= slots) throw runtime_error("state image is corrupted");
+    in.get(length);
+    in.get(acc);
+    in.get(filled);
+}
+
+Mser::Mser(double interval): length(5 * interval) {}
+
+bool Mser::add(double value, double delta) {
+    bool completed = false;
+    while (filled + delta >= length) {
+        double part = length - filled;
+        batch.push_back((acc + value * part) / length);
+        delta -= part;
+        acc = filled = 0;
+        completed = true;
+    }
+    acc += value * delta;
+    filled += delta;
+    return completed;
+}
+
+void Mser::clear() {
+    batch.clear();
+    batch.shrink_to_fit();
+    acc = filled = 0;
+}
+
+size_t Mser::batches() const { return batch.size(); }
+
+size_t Mser::truncation() const {
+    // MSER(d) = sum_{i > d} (Z_i - Z_d)^2 / (n - d)^2, minimized over d <= n / 2. Suffix sums make it O(n)
+    size_t n = batch.size(), best = 0;
+    double s1 = 0, s2 = 0, best_val = numeric_limits<double>::infinity();
+    vector<double> mser(n / 2 + 1);
+    for (size_t i = n; i-- > 0;) {
+        s1 += batch[i];
+        s2 += batch[i] * batch[i];
+        if (i > n / 2) continue;
+        double k = n - i;
+        mser[i] = (s2 - s1 * s1 / k) / (k * k);
+    }
+    for (size_t d = 0; d <= n / 2 && d < n; ++d) if (mser[d] < best_val) { best_val = mser[d]; best = d; }
+    return best;
+}
+
+void Mser::save(StateWriter& out) const {
+    out.put_vector(batch);
+    out.put(length);
+    out.put(acc);
+    out.put(filled);
+}
+
+void Mser::load(StateReader& in) {
+    in.get_vector(batch);
+    in.get(length);
+    in.get(acc);
+    in.get(filled);
+}
+
+Histogram::Histogram(): Histogram(LINEAR, 0, 1) {}
+
+Histogram::Histogram(scale_t scale, double low, double step, size_t count): scale(scale), low(low), step(step), growing(count == 0) {
+    if (scale == LINEAR) {
+        if (step <= 0) throw invalid_argument("histogram bucket width must be positive");
+        inv = 1 / step;
+    }
+    else {
+        if (low <= 0 || step <= 1) throw invalid_argument("log histogram needs low > 0 and ratio > 1");
+        if (growing) throw invalid_argument("log histogram needs a bucket count");
+        inv = 1 / log(step);
+    }
+    bucket.assign(growing ? 0 : count + 2, 0);
+}
+
+size_t Histogram::index(double value) const {
+    if (!(value >= low)) return 0;
+    double position = scale == LINEAR ? (value - low) * inv : log(value / low) * inv;
+    if (growing) return size_t(position) + 1;
+    size_t last = bucket.size() - 1;
+    return position < last - 1 ? size_t(position) + 1 : last;
+}
+
+void Histogram::merge(const Histogram& other) {
+    if (scale != other.scale || low != other.low || step != other.step || growing != other.growing || (!growing && bucket.size() != other.bucket.size()))
+        throw invalid_argument("merge of histograms with different buckets");
+    if (other.bucket.size() > bucket.size()) bucket.resize(other.bucket.size(), 0);
+    for (size_t i = 0; i < other.bucket.size(); ++i) bucket[i] += other.bucket[i];
+    total += other.total;
+    sum += other.sum;
+    max_value = std::max(max_value, other.max_value);
+}
+
+void Histogram::reset() {
+    fill(bucket.begin(), bucket.end(), 0);
+    total = sum = 0;
+    max_value = -numeric_limits<double>::infinity();
+}
+
+size_t Histogram::buckets() const { return bucket.size(); }
+double Histogram::bucket_weight(size_t i) const { return bucket[i]; }
+double Histogram::weight() const { return total; }
+double Histogram::mean() const { return total > 0 ? sum / total : 0; }
+double Histogram::max() const { return total > 0 ? max_value : 0; }
+
+double Histogram::bucket_low(size_t i) const {
+    if (i == 0) return -numeric_limits<double>::infinity();
+    return scale == LINEAR ? low + (i - 1) * step : low * pow(step, double(i - 1));
+}
+
+double Histogram::quantile(double p) const {
+    if (total <= 0) return 0;
+    double target = p * total, acc = 0;
+    for (size_t i = 0; i < bucket.size(); ++i) {
+        if (acc + bucket[i] < target || bucket[i] == 0) { acc += bucket[i]; continue; }
+        if (i == 0) return low; // below the first bound: nothing better is known
+        double from = bucket_low(i);
+        double to = i + 1 < bucket.size() ? bucket_low(i + 1) : max_value;
+        if (!growing && i == bucket.size() - 1) to = max_value; // overflow bucket ends at the largest value seen
+        return from + (to - from) * (target - acc) / bucket[i];
+    }
+    return max_value;
+}
+
+// the layout is saved too: a table restored into a model with different buckets takes the saved ones
+void Histogram::save(StateWriter& out) const {
+    out.put(scale);
+    out.put(low);
+    out.put(step);
+    out.put(inv);
+    out.put(growing);
+    out.put_vector(bucket);
+    out.put(total);
+    out.put(sum);
+    out.put(max_value);
+}
+
+void Histogram::load(StateReader& in) {
+    in.get(scale);
+    in.get(low);
+    in.get(step);
+    in.get(inv);
+    in.get(growing);
+    in.get_vector(bucket);
+    if (!growing && bucket.size() < 2) throw runtime_error("state image is corrupted");
+    in.get(total);
+    in.get(sum);
+    in.get(max_value);
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include "state.h"
+
+using namespace std;
+
+// quantile of Student's t distribution with df degrees of freedom (p in (0; 1))
+double t_quantile(double p, size_t df);
+
+// Streaming batch means of a time-weighted metric. Memory is O(1): when all batch slots are filled
+// neighbouring batches are merged and the batch length doubles
+class BatchMeans {
+private:
+    static constexpr size_t slots = 64;
+    vector<double> batch;       // means of completed batches; allocated with the first one, so idle entities cost little
+    double length;              // current batch length (sim time)
+    double acc = 0;             // integral over the incomplete batch
+    double filled = 0;          // time covered by the incomplete batch
+
+    void push(double mean);
+
+public:
+    static constexpr size_t min_batches = 20; // fewer batches are not trusted for a CI
+
+    BatchMeans(double length = 1);
+    bool add(double value, double delta); // true: at least one batch was completed
+    void reset(double length);
+
+    size_t batches() const;
+    double mean() const;
+    double half_width(double confidence) const; // infinity until there are enough batches
+
+    void save(StateWriter& out) const;
+    void load(StateReader& in);
+};
+
+// MSER-5 warm-up detection. Observations are time averages over `interval`, five of them form a batch
+class Mser {
+private:
+    vector<double> batch; // batch means since the start of the run
+    double length;        // 5 * interval
+    double acc = 0;
+    double filled = 0;
+
+public:
+    static constexpr size_t min_batches = 10;
+
+    Mser(double interval = 1);
+    bool add(double value, double delta); // true: at least one batch was completed
+    void clear();                         // release the series once the warm-up is over
+
+    size_t batches() const;
+    size_t truncation() const; // d* in batches; d* < batches() / 2 means the transient is over
+
+    void save(StateWriter& out) const;
+    void load(StateReader& in);
+};
+
+// Histogram with fixed-width or log-spaced buckets in one contiguous array. Values are weighted: by 1 per entry
+// (TABULATE) or by time (queue length, storage content). Bucket 0 holds values below low, the last one values
+// past the last regular bucket. Histograms with the same layout can be merged, e.g. over replications
+class Histogram {
+public:
+    enum scale_t: int {LINEAR, LOG};
+
+private:
+    scale_t scale;
+    double low;
+    double step;          // LINEAR: bucket width; LOG: ratio of neighbouring bounds
+    double inv;           // 1 / width or 1 / log(ratio)
+    bool growing;         // LINEAR without a bucket count: buckets are added as values grow (from none), there is no overflow
+    vector<double> bucket;
+    double total = 0;     // sum of weights
+    double sum = 0;       // sum of weighted values
+    double max_value = -numeric_limits<double>::infinity();
+
+    size_t index(double value) const;
+
+public:
+    Histogram(); // LINEAR from 0 with width 1, growing: exact for integer metrics such as queue length
+    Histogram(scale_t scale, double low, double step, size_t count = 0); // count 0 is allowed only for LINEAR
+
+    void add(double value, double weight = 1) {
+        size_t i = index(value);
+        if (i >= bucket.size()) bucket.resize(i + 1, 0); // only when growing
+        bucket[i] += weight;
+        total += weight;
+        sum += value * weight;
+        if (value > max_value) max_value = value;
+    }
+    void merge(const Histogram& other); // throws invalid_argument if the layouts differ
+    void reset();
+
+    size_t buckets() const;
+    double bucket_low(size_t i) const;   // bound of bucket i; -infinity for bucket 0
+    double bucket_weight(size_t i) const;
+    double weight() const;
+    double mean() const;
+    double max() const;
+    double quantile(double p) const;     // linear within a bucket; 0 if empty
+
+    void save(StateWriter& out) const;
+    void load(StateReader& in);
+};
@@ -0,0 +1,145 @@
+#include <cmath>
+#include <cstring>
+#include <charconv>
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+using namespace std;
+
+TraceReader::TraceReader(const string& path, TraceOptions options): path(path), options(options), last(options.origin) {
+    if (!(options.scale > 0)) throw runtime_error("trace time scale must be positive");
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw runtime_error("can not open trace " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); throw runtime_error("can not read trace " + path); }
+    size = st.st_size;
+    if (size == 0) { close(fd); throw runtime_error("trace " + path + " is empty"); }
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) throw runtime_error("can not map trace " + path);
+    data = static_cast<const char*>(map);
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    // the first record is checked now, so that a broken trace fails the build and not the run
+    try {
+        size_t bytes = sizeof(double) + (options.with_priority ? sizeof(uint64_t) : 0);
+        if (options.format == TraceOptions::BINARY && size % bytes != 0) throw runtime_error("trace " + path + " has a partial record");
+        double value;
+        uint64_t priority;
+        bool has_priority;
+        if (!parse(value, priority, has_priority, true)) throw runtime_error("trace " + path + " has no records");
+        pos = first = record;
+    }
+    catch (...) {
+        munmap(map, size);
+        throw;
+    }
+}
+
+TraceReader::~TraceReader() { munmap(const_cast<char*>(data), size); }
+
+bool TraceReader::parse(double& value, uint64_t& priority, bool& has_priority, bool header) {
+    record = pos;
+    if (options.format == TraceOptions::BINARY) {
+        if (pos == size) return false;
+        memcpy(&value, data + pos, sizeof(double));
+        pos += sizeof(double);
+        has_priority = options.with_priority;
+        if (has_priority) {
+            memcpy(&priority, data + pos, sizeof(uint64_t));
+            pos += sizeof(uint64_t);
+        }
+        return true;
+    }
+
+    auto blank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+    const char* end = data + size;
+    while (pos < size) {
+        size_t start = pos;
+        const char* p = data + pos;
+        const char* eol = static_cast<const char*>(memchr(p, '\n', size - pos));
+        if (eol == nullptr) eol = end;
+        pos = eol - data + (eol < end);
+
+        while (p < eol && blank(*p)) ++p;
+        if (p == eol || *p == '#') continue;
+        auto [q, ec] = from_chars(p, eol, value);
+        if (ec != errc()) {
+            if (header) { header = false; continue; }
+            throw runtime_error("trace " + path + ": bad record at byte " + to_string(start));
+        }
+        while (q < eol && blank(*q)) ++q;
+        has_priority = q < eol && *q == ',';
+        if (has_priority) {
+            ++q;
+            while (q < eol && blank(*q)) ++q;
+            auto [r, ec] = from_chars(q, eol, priority);
+            if (ec != errc()) throw runtime_error("trace " + path + ": bad priority at byte " + to_string(start));
+            q = r;
+            while (q < eol && blank(*q)) ++q;
+        }
+        if (q != eol) throw runtime_error("trace " + path + ": bad record at byte " + to_string(start));
+        record = start;
+        return true;
+    }
+    return false;
+}
+
+void TraceReader::follow() {
+    if (pos + window > advised && advised < size) {
+        madvise(const_cast<char*>(data) + advised, min(window, size - advised), MADV_WILLNEED);
+        advised += window;
+    }
+    if (pos >= released + 2 * window) {
+        madvise(const_cast<char*>(data) + released, window, MADV_DONTNEED);
+        released += window;
+    }
+}
+
+bool TraceReader::next(double& interval, uint64_t& priority) {
+    double value;
+    uint64_t record_priority;
+    bool has_priority;
+    if (!parse(value, record_priority, has_priority)) {
+        if (!options.loop) return false;
+        madvise(const_cast<char*>(data) + released, size - released, MADV_DONTNEED);
+        pos = first;
+        advised = released = 0;
+        last = options.origin;
+        parse(value, record_priority, has_priority); // the trace has a record: checked by the constructor
+    }
+    follow();
+
+    if (!isfinite(value)) throw runtime_error("trace " + path + ": value is not finite before byte " + to_string(pos));
+    if (options.values == TraceOptions::TIMESTAMPS) {
+        if (value < last) throw runtime_error("trace " + path + ": timestamp goes back before byte " + to_string(pos));
+        interval = (value - last) * options.scale;
+        last = value;
+    }
+    else {
+        if (value < 0) throw runtime_error("trace " + path + ": negative interval before byte " + to_string(pos));
+        interval = value * options.scale;
+    }
+    if (has_priority) priority = record_priority;
+    return true;
+}
+
+void TraceReader::save(StateWriter& out) const {
+    out.put(uint64_t(size));
+    out.put(uint64_t(pos));
+    out.put(last);
+}
+
+void TraceReader::load(StateReader& in) {
+    if (in.get<uint64_t>() != size) throw runtime_error("trace " + path + " differs from the one of the saved run");
+    pos = in.get<uint64_t>();
+    if (pos > size) throw runtime_error("state image is corrupted");
+    in.get(last);
+    released = advised = pos / window * window;
+}
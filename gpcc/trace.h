@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "state.h"
+
+using namespace std;
+
+// Arrivals replayed from a file instead of drawn from a distribution (SimBuilder::add_generate_trace).
+//   CSV:    one record per line, "value" or "value,priority". Blank lines, lines starting with '#' and a header
+//           line that is not a number, before the first record, are skipped
+//   BINARY: packed native-endian records: double value, followed by uint64_t priority if with_priority is set
+// Values are arrival timestamps (nondecreasing) or times between arrivals
+struct TraceOptions {
+    enum format_t: int {CSV, BINARY};
+    enum values_t: int {TIMESTAMPS, INTERVALS};
+
+    format_t format = CSV;
+    values_t values = TIMESTAMPS;
+    bool with_priority = false; // BINARY only: a CSV record has a priority if it has a second column
+    double scale = 1;           // model time per unit of trace time
+    double origin = 0;          // TIMESTAMPS: trace time that is model time 0
+    bool loop = false;          // start over after the last record (the first one comes after the usual interval);
+                                // otherwise the GENERATE stops
+};
+
+// Forward reader of a trace. The file is memory-mapped and never loaded as a whole: pages are requested a window
+// ahead of the reader and released a window behind it, so memory use does not depend on the length of the trace
+class TraceReader {
+private:
+    static constexpr size_t window = 8 << 20; // bytes; at most three windows are resident
+
+    string path;
+    TraceOptions options;
+    const char* data = nullptr;
+    size_t size = 0;
+    size_t pos = 0;
+    size_t first = 0;    // offset of the first record: the header and comments before it are read once
+    size_t record = 0;   // offset of the record parse() read last
+    size_t advised = 0;  // pages before this offset were requested
+    size_t released = 0; // pages before this offset were released
+    double last = 0;     // TIMESTAMPS: value of the previous record
+
+    // false at the end of the file. header: one line that is not a number may come before the record
+    bool parse(double& value, uint64_t& priority, bool& has_priority, bool header = false);
+    void follow();                                                     // moves the window
+
+public:
+    TraceReader(const string& path, TraceOptions options); // throws runtime_error if the file can't be read or is empty
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+    ~TraceReader();
+
+    // time to the next arrival; priority is set if the record has one. False once a trace without looping is over
+    bool next(double& interval, uint64_t& priority);
+
+    void save(StateWriter& out) const;
+    void load(StateReader& in); // the file must be the same as in the saved run
+};
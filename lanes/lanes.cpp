@@ -0,0 +1,326 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "lanes.h"
+
+using namespace std;
+
+bool LaneSimulation::Event::operator<(const Event& rhs) const {
+    if (time != rhs.time) return time > rhs.time;
+    if (priority != rhs.priority) return priority < rhs.priority;
+    return seq > rhs.seq;
+}
+
+LaneSimulation::LaneSimulation(SimBuilder::recipe_t recipe, double end_time, size_t lanes): lanes(lanes), end_time(end_time) {
+    if (lanes == 0) throw SimulationException("at least one lane is needed");
+    SimBuilder builder(end_time);
+    recipe(builder);
+    Simulation& sim = *builder.sim;
+    auto index = builder.block_index();
+    auto target = [&](Simulation::Block* block) { return block == nullptr ? none : uint32_t(index[block]); };
+    auto label = [&](size_t i) {
+        if (sim.labels[i].data == nullptr) throw SimulationException("label \"" + sim.labels[i].name + "\" is not defined");
+        return target(sim.labels[i].data);
+    };
+
+    using Info = SimBuilder::BlockInfo;
+    for (size_t i = 0; i < builder.info.size(); ++i) {
+        const Info& info = builder.info[i];
+        Block block{info.kind, uint32_t(info.arg), target(sim.blocks[i]->next), none, none, info.param};
+        switch (info.kind) {
+            case Info::QUEUE: case Info::DEPART: case Info::ENTER: case Info::LEAVE: case Info::MARK: case Info::TERMINATE: break;
+            case Info::GENERATE: case Info::ADVANCE:
+                if (info.expr == nullptr) throw SimulationException("block " + to_string(i) + " is not supported by lanes");
+                block.rand = sources.size();
+                sources.push_back(make_source("block " + to_string(i), info.expr));
+                break;
+            case Info::TRANSFER_IMM: block.alt = label(info.arg); break;
+            case Info::TRANSFER_PROB:
+                block.alt = label(info.arg);
+                block.rand = sources.size();
+                sources.push_back(make_source("block " + to_string(i), nullptr));
+                break;
+            default: throw SimulationException("block " + to_string(i) + " is not supported by lanes");
+        }
+        blocks.push_back(block);
+    }
+
+    for (auto& q : sim.queues) q_names.push_back(q.name);
+    for (auto& storage : sim.storages) {
+        storage_names.push_back(storage.name);
+        capacity.push_back(storage.data->get_capacity());
+    }
+
+    time.assign(lanes, 0);
+    schedule.resize(lanes);
+    immediate.resize(lanes);
+    seq.assign(lanes, 0);
+    done.assign(lanes, 0);
+    delta.assign(lanes, 0);
+    q_len.assign(q_names.size() * lanes, 0);
+    q_max.assign(q_names.size() * lanes, 0);
+    q_area.assign(q_names.size() * lanes, 0);
+    q_empty.assign(q_names.size() * lanes, 0);
+    s_content.assign(capacity.size() * lanes, 0);
+    s_max.assign(capacity.size() * lanes, 0);
+    s_area.assign(capacity.size() * lanes, 0);
+    s_empty.assign(capacity.size() * lanes, 0);
+    s_full.assign(capacity.size() * lanes, 0);
+    chains.resize(capacity.size() * lanes);
+
+    // first arrivals: every lane draws its own
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        if (blocks[b].kind != Info::GENERATE) continue;
+        for (size_t l = 0; l < lanes; ++l) push(l, Event{draw(blocks[b].rand, l), 0, b, priority_t(blocks[b].param), true});
+    }
+}
+
+LaneSimulation::Source LaneSimulation::make_source(const string& name, const Expr* expr) {
+    Source source;
+    if (expr == nullptr) source.type = Source::UNIFORM;
+    else if (expr->constant()) {
+        source.type = Source::CONSTANT;
+        source.value = expr->code[0].value;
+        return source;
+    }
+    else {
+        if (expr->code.size() != 1 || expr->code[0].op != Expr::RAND) throw SimulationException("lanes support only constant or random times");
+        source.dist = expr->rngs[expr->code[0].index].get_distribution();
+        if (!source.dist->has_quantile()) throw SimulationException("lanes need distributions with a quantile function");
+        source.type = Source::INVERSE;
+    }
+    for (size_t l = 0; l < lanes; ++l) source.state.push_back(stream_seed(name, l));
+    source.buffer.resize(batch * lanes);
+    source.fresh.resize(batch * lanes);
+    source.used.assign(lanes, batch); // empty: filled on the first draw
+    return source;
+}
+
+// splitmix64 over all lanes, then the inverse CDF over the new uniforms; both loops have no dependencies between lanes.
+// A lane that has used c variates gets c new ones behind the 64 - c it still has
+void LaneSimulation::refill(Source& source) {
+    const uint32_t* used = source.used.data();
+    uint32_t rows = *max_element(source.used.begin(), source.used.end());
+    uint64_t* state = source.state.data();
+    double* u = source.fresh.data();
+    for (size_t k = 0; k < rows; ++k) {
+        for (size_t l = 0; l < lanes; ++l) {
+            uint64_t z = state[l] += k < used[l] ? 0x9e3779b97f4a7c15ull : 0; // lanes that need no more keep their state
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            u[k * lanes + l] = double((z ^ (z >> 31)) >> 11) * 0x1.0p-53;
+        }
+    }
+    if (source.type == Source::INVERSE) source.dist->quantiles(u, u, rows * lanes);
+
+    double* buffer = source.buffer.data();
+    for (size_t l = 0; l < lanes; ++l) {
+        size_t c = used[l];
+        for (size_t k = c; k < batch; ++k) buffer[(k - c) * lanes + l] = buffer[k * lanes + l];
+        for (size_t k = 0; k < c; ++k) buffer[(batch - c + k) * lanes + l] = u[k * lanes + l];
+    }
+    fill(source.used.begin(), source.used.end(), 0);
+}
+
+double LaneSimulation::draw(uint32_t index, size_t lane) {
+    Source& source = sources[index];
+    if (source.type == Source::CONSTANT) return source.value;
+    if (source.used[lane] == batch) refill(source);
+    return source.buffer[source.used[lane]++ * lanes + lane];
+}
+
+void LaneSimulation::push(size_t lane, const Event& event) {
+    if (event.time < time[lane]) throw SimulationException("negative time");
+    schedule[lane].push_back(event);
+    schedule[lane].back().seq = seq[lane]++;
+    push_heap(schedule[lane].begin(), schedule[lane].end());
+}
+
+void LaneSimulation::serve(size_t lane, uint32_t b, priority_t priority, bool fresh) {
+    using Info = SimBuilder::BlockInfo;
+    double now = time[lane];
+    while (b != none) {
+        const Block& block = blocks[b];
+        size_t at = block.arg * lanes + lane;
+        switch (block.kind) {
+            case Info::QUEUE: ++q_len[at]; break;
+            case Info::DEPART:
+                if (q_len[at] == 0) throw SimulationException("Attempted to leave empty queue");
+                --q_len[at];
+                break;
+            case Info::ENTER:
+                if (s_content[at] >= int64_t(capacity[block.arg])) { chains[at].push(priority, Waiter{block.next, priority}, now); return; }
+                ++s_content[at];
+                break;
+            case Info::LEAVE:
+                if (s_content[at] == 0) throw SimulationException("Attempted to leave empty storage");
+                if (!chains[at].empty()) immediate[lane].push_back(chains[at].pop(now)); // the place is handed over
+                else --s_content[at];
+                break;
+            case Info::GENERATE:
+                if (fresh) push(lane, Event{now + draw(block.rand, lane), 0, b, priority_t(block.param), true});
+                fresh = false;
+                break;
+            case Info::ADVANCE:
+                push(lane, Event{now + draw(block.rand, lane), 0, block.next, priority, false});
+                return;
+            case Info::TRANSFER_IMM: b = block.alt; continue;
+            case Info::TRANSFER_PROB:
+                if (draw(block.rand, lane) < block.param) { b = block.alt; continue; }
+                break;
+            case Info::TERMINATE: return;
+            default: break; // MARK: there are no tables
+        }
+        b = block.next;
+    }
+}
+
+void LaneSimulation::accumulate() {
+    const double* d = delta.data();
+    for (size_t q = 0; q < q_names.size(); ++q) {
+        const int64_t* len = &q_len[q * lanes];
+        double* area = &q_area[q * lanes];
+        double* empty = &q_empty[q * lanes];
+        int64_t* mx = &q_max[q * lanes];
+        for (size_t l = 0; l < lanes; ++l) {
+            area[l] += len[l] * d[l];
+            empty[l] += len[l] == 0 ? d[l] : 0;
+            mx[l] = max(mx[l], len[l]);
+        }
+    }
+    for (size_t s = 0; s < capacity.size(); ++s) {
+        const int64_t* content = &s_content[s * lanes];
+        double* area = &s_area[s * lanes];
+        double* empty = &s_empty[s * lanes];
+        double* full = &s_full[s * lanes];
+        int64_t* mx = &s_max[s * lanes];
+        int64_t cap = capacity[s];
+        for (size_t l = 0; l < lanes; ++l) {
+            area[l] += content[l] * d[l];
+            empty[l] += content[l] == 0 ? d[l] : 0;
+            full[l] += content[l] != 0 && content[l] >= cap ? d[l] : 0;
+            mx[l] = max(mx[l], content[l]);
+        }
+    }
+}
+
+void LaneSimulation::run() {
+    size_t running = count(done.begin(), done.end(), 0);
+    while (running > 0) {
+        // clocks: a lane without events before end_time makes its last step to end_time
+        for (size_t l = 0; l < lanes; ++l) {
+            if (done[l]) { delta[l] = 0; continue; }
+            double next = end_time;
+            if (!schedule[l].empty() && schedule[l].front().time < end_time) next = schedule[l].front().time;
+            else { done[l] = 1; --running; }
+            delta[l] = next - time[l];
+            time[l] = next;
+        }
+        accumulate();
+
+        for (size_t l = 0; l < lanes; ++l) {
+            if (done[l]) continue;
+            pop_heap(schedule[l].begin(), schedule[l].end());
+            Event event = schedule[l].back();
+            schedule[l].pop_back();
+            ++events;
+            serve(l, event.block, event.priority, event.fresh);
+            for (size_t i = 0; i < immediate[l].size(); ++i) serve(l, immediate[l][i].block, immediate[l][i].priority, false);
+            immediate[l].clear();
+        }
+    }
+}
+
+LaneSimulation& LaneSimulation::set_confidence(double level) {
+    if (level <= 0 || level >= 1) throw SimulationException("confidence level must be in (0; 1)");
+    confidence = level;
+
+    return *this;
+}
+
+uint64_t LaneSimulation::get_events() { return events; }
+
+double LaneSimulation::get_q_mean(size_t queue, size_t lane) {
+    return end_time > 0 ? q_area[queue * lanes + lane] / end_time : 0;
+}
+
+void LaneSimulation::report() {
+    cout << fixed << showpoint;
+    cout << setprecision(4);
+
+    // mean over lanes and the CI half-width of the replication means
+    auto estimate = [this](const vector<double>& values, size_t entity, double scale) {
+        double sum = 0, s2 = 0;
+        for (size_t l = 0; l < lanes; ++l) sum += values[entity * lanes + l] * scale;
+        double m = sum / lanes;
+        for (size_t l = 0; l < lanes; ++l) s2 += (values[entity * lanes + l] * scale - m) * (values[entity * lanes + l] * scale - m);
+        double hw = lanes > 1 ? t_quantile((1 + confidence) / 2, lanes - 1) * sqrt(s2 / (lanes - 1) / lanes) : numeric_limits<double>::infinity();
+        return pair(m, hw);
+    };
+    auto hw = [](double res) {
+        if (isinf(res)) return string("-");
+        ostringstream out;
+        out << fixed << setprecision(4) << res;
+        return out.str();
+    };
+    auto max_over = [this](const vector<int64_t>& values, size_t entity) {
+        return *max_element(values.begin() + entity * lanes, values.begin() + (entity + 1) * lanes);
+    };
+    double inv = end_time > 0 ? 1 / end_time : 0;
+
+    cout << "Lanes: " << lanes << ", " << events << " events\n";
+    cout << "QUEUES:\n";
+    cout << "\tqueue\t\tMax\t\tM\t\t±M\t\tP(0)\t\t±P(0)\n";
+    for (size_t q = 0; q < q_names.size(); ++q) {
+        auto [m, m_hw] = estimate(q_area, q, inv);
+        auto [empty, empty_hw] = estimate(q_empty, q, inv);
+        cout << "\t" << q_names[q] << "\t\t" << max_over(q_max, q) << "\t\t" << m << "\t\t" << hw(m_hw) << "\t\t" << empty << "\t\t" << hw(empty_hw) << '\n';
+    }
+
+    cout << "STORAGES:\n";
+    cout << "\tstorage\t\tCap\t\tMax\t\tM\t\t±M\t\tK\t\tP(0)\t\t±P(0)\t\tP(full)\t\t±P(full)\n";
+    for (size_t s = 0; s < capacity.size(); ++s) {
+        auto [m, m_hw] = estimate(s_area, s, inv);
+        auto [empty, empty_hw] = estimate(s_empty, s, inv);
+        auto [full, full_hw] = estimate(s_full, s, inv);
+        cout << "\t" << storage_names[s] << "\t\t" << capacity[s] << "\t\t" << max_over(s_max, s) << "\t\t" << m << "\t\t" << hw(m_hw) << "\t\t"
+        << m / capacity[s] << "\t\t" << empty << "\t\t" << hw(empty_hw) << "\t\t" << full << "\t\t" << hw(full_hw) << '\n';
+    }
+    cout << "Confidence level: " << setprecision(2) << confidence << '\n';
+}
+
+void LaneSimulation::launch() {
+    run();
+    report();
+}
+
+void LaneSimulation::benchmark(SimBuilder::recipe_t recipe, double end_time, size_t lanes) {
+    using clock = chrono::steady_clock;
+
+    auto start = clock::now();
+    uint64_t scalar_events = 0;
+    for (size_t l = 0; l < lanes; ++l) {
+        SimBuilder builder(end_time);
+        builder.set_streams(l);
+        recipe(builder);
+        auto sim = builder.build();
+        sim->run_until(end_time);
+        scalar_events += sim->get_events();
+    }
+    double scalar = chrono::duration<double>(clock::now() - start).count();
+
+    start = clock::now();
+    LaneSimulation sim(recipe, end_time, lanes);
+    sim.run();
+    double lane = chrono::duration<double>(clock::now() - start).count();
+
+    cout << fixed << setprecision(4);
+    cout << "BENCHMARK (" << lanes << " replications):\n";
+    cout << "\tengine\t\tSeconds\t\tEvents\t\tEvents/s\n";
+    cout << "\tscalar\t\t" << scalar << "\t\t" << scalar_events << "\t\t" << uint64_t(scalar_events / scalar) << '\n';
+    cout << "\tlanes\t\t" << lane << "\t\t" << sim.get_events() << "\t\t" << uint64_t(sim.get_events() / lane) << '\n';
+    cout << "Speedup: " << setprecision(2) << (sim.get_events() / lane) / (scalar_events / scalar) << '\n';
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "gpcc/gpcc.h"
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+// Experimental engine that runs K replications of one model in lockstep lanes.
+// Every step serves the earliest event of each lane, so the lanes move through their event lists together and the
+// time-weighted statistics of a step are accumulated by loops over lanes. Queue lengths, storage contents, statistics and
+// random number states are laid out as struct-of-arrays with the lane as the inner index. Variates of every
+// random block are drawn in batches for all lanes at once: a splitmix64 uniform per lane, then the inverse CDF
+// of the distribution over the whole batch.
+//
+// Supported blocks: GENERATE, QUEUE, DEPART, ENTER, LEAVE, ADVANCE, TRANSFER (immediate and probability), MARK,
+// TERMINATE. RESET, warm-up detection and stopping rules are ignored. Times must be a constant or a single RandomGenerator whose distribution has a quantile.
+// Replication l uses its own streams, so results match Simulation statistically, not number by number.
+class LaneSimulation {
+private:
+    using priority_t = SimBuilder::priority_t;
+
+    struct Block {
+        SimBuilder::BlockInfo::kind_t kind;
+        uint32_t arg;  // queue or storage
+        uint32_t next; // none: the transaction leaves
+        uint32_t alt;  // TRANSFER: label target
+        uint32_t rand; // GENERATE, ADVANCE, TRANSFER(prob): random source
+        double param;  // GENERATE: priority; TRANSFER(prob): probability
+    };
+    struct Event {
+        double time;
+        uint64_t seq;     // FIFO among equal times and priorities
+        uint32_t block;
+        priority_t priority;
+        bool fresh;       // GENERATE: the transaction has just arrived
+        bool operator<(const Event& rhs) const; // for a max-heap: the earliest event on top
+    };
+    struct Waiter {
+        uint32_t block; // where to go once in the storage
+        priority_t priority;
+    };
+    // source of variates for one block. batch variates per lane are drawn ahead; when a lane runs out
+    // all lanes are topped up at once: each keeps what it has left and gets as many new variates as it used,
+    // so the numbers a lane sees do not depend on the other lanes
+    struct Source {
+        enum type_t: int {CONSTANT, UNIFORM, INVERSE} type;
+        double value;                  // CONSTANT
+        shared_ptr<distribution> dist; // INVERSE: sampled by its quantile function
+        vector<uint64_t> state;        // splitmix64, per lane
+        vector<double> buffer;         // [k * lanes + lane]
+        vector<double> fresh;          // refill scratch, same layout
+        vector<uint32_t> used;         // per lane
+    };
+    static constexpr uint32_t none = UINT32_MAX;
+    static constexpr uint32_t batch = 64;
+
+    size_t lanes;
+    double end_time;
+    double confidence = 0.95;
+    vector<Block> blocks;
+    vector<Source> sources;
+    vector<string> q_names, storage_names;
+    vector<size_t> capacity;
+
+    // per lane
+    vector<double> time;
+    vector<vector<Event>> schedule;   // heaps
+    vector<vector<Waiter>> immediate; // let into a storage during the current step
+    vector<uint64_t> seq;
+    vector<uint8_t> done;
+    vector<double> delta;             // of the current step
+    uint64_t events = 0;
+
+    // [entity * lanes + lane]
+    vector<int64_t> q_len, q_max;
+    vector<double> q_area, q_empty;
+    vector<int64_t> s_content, s_max;
+    vector<double> s_area, s_empty, s_full;
+    vector<WaitChain<Waiter, priority_t>> chains; // delay chains
+
+    Source make_source(const string& name, const Expr* expr); // nullptr: uniform on [0; 1)
+    void refill(Source& source);
+    double draw(uint32_t source, size_t lane);
+    void push(size_t lane, const Event& event);
+    void serve(size_t lane, uint32_t block, priority_t priority, bool fresh);
+    void accumulate(); // statistics over delta, vectorized over lanes
+
+public:
+    LaneSimulation(SimBuilder::recipe_t recipe, double end_time, size_t lanes);
+
+    LaneSimulation& set_confidence(double level);
+
+    void run();
+    void report();  // means over lanes with confidence intervals
+    void launch();  // run and report
+    uint64_t get_events();
+    double get_q_mean(size_t queue, size_t lane); // time-average length in one replication
+
+    // runs lanes replications as independent Simulation::run_until calls and in lanes, prints both throughputs
+    static void benchmark(SimBuilder::recipe_t recipe, double end_time, size_t lanes);
+};
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <limits>
+#include "parallel.h"
+
+using namespace std;
+
+ParallelSimulation::ParallelSimulation(SimBuilder::recipe_t recipe, double end_time, size_t threads): end_time(end_time) {
+    SimBuilder probe(end_time);
+    recipe(probe);
+    partition = probe.partition(max<size_t>(threads, 1));
+    if (partition.lookahead <= 0) throw SimulationException("parallel execution needs a positive lookahead");
+
+    size_t n = partition.count;
+    for (size_t lp = 0; lp < n; ++lp) {
+        SimBuilder builder(end_time);
+        recipe(builder);
+        lps.push_back(builder.build(partition, lp));
+        if (!lps.back()->monitors.empty()) throw SimulationException("stopping rules and warm-up detection are not supported in parallel mode");
+    }
+
+    channels.resize(n * n);
+    for (size_t from = 0; from < n; ++from) for (size_t to = 0; to < n; ++to) {
+        if (from == to) continue;
+        channels[from * n + to] = make_unique<SpscQueue<RemoteSpawn>>();
+    }
+    for (size_t lp = 0; lp < n; ++lp) {
+        lps[lp]->outbox.assign(n, nullptr);
+        for (size_t other = 0; other < n; ++other) {
+            if (other == lp) continue;
+            lps[lp]->outbox[other] = channels[lp * n + other].get();
+            lps[lp]->inbox.push_back(channels[other * n + lp].get());
+        }
+    }
+}
+
+size_t ParallelSimulation::processes() { return partition.count; }
+double ParallelSimulation::lookahead() { return partition.lookahead; }
+
+void ParallelSimulation::run_lp(size_t lp, barrier<>& sync, vector<double>& next) {
+    Simulation& sim = *lps[lp];
+    while (true) {
+        sim.receive();
+        next[lp] = sim.spawn_schedule.empty() ? numeric_limits<double>::infinity() : sim.spawn_schedule.top().time;
+        sync.arrive_and_wait();
+
+        double t = *min_element(next.begin(), next.end()); // every LP gets the same value
+        if (t >= end_time) break;
+        sim.process(min(t + partition.lookahead, end_time)); // no pause or stopping rule here, so the window is served entirely
+        sync.arrive_and_wait(); // everything posted in the window is in the channels
+    }
+    sim.advance_clock(end_time);
+}
+
+void ParallelSimulation::merge() {
+    Simulation& primary = *lps[0];
+    for (size_t i = 0; i < primary.queues.size(); ++i) {
+        Simulation& owner = *lps[partition.queue_lp[i]];
+        primary.queues[i].data = owner.queues[i].data;
+        primary.q_stat[i] = owner.q_stat[i];
+    }
+    for (size_t i = 0; i < primary.storages.size(); ++i) {
+        Simulation& owner = *lps[partition.storage_lp[i]];
+        if (&owner != &primary) swap(primary.storages[i].data, owner.storages[i].data); // only read by report()
+        primary.storage_stat[i] = owner.storage_stat[i];
+    }
+    for (size_t i = 0; i < primary.gates.size(); ++i) { // delay chains of gates, for the report
+        size_t block = find_if(primary.blocks.begin(), primary.blocks.end(), [&](auto& b) { return b.get() == primary.gates[i]; }) - primary.blocks.begin();
+        Simulation& owner = *lps[partition.lp[block]];
+        if (&owner != &primary) swap(primary.gates[i]->get_chain(), owner.gates[i]->get_chain());
+    }
+    for (auto& lp : lps) if (lp != lps[0]) for (size_t i = 0; i < primary.tables.size(); ++i) primary.tables[i].data.merge(lp->tables[i].data); // every LP may tabulate
+    for (auto& lp : lps) primary.stat_start = max(primary.stat_start, lp->stat_start);
+}
+
+void ParallelSimulation::launch() {
+    size_t n = partition.count;
+    vector<double> next(n);
+    barrier sync(n);
+
+    vector<thread> workers;
+    for (size_t lp = 1; lp < n; ++lp) workers.emplace_back(&ParallelSimulation::run_lp, this, lp, ref(sync), ref(next));
+    run_lp(0, sync, next);
+    for (auto& worker : workers) worker.join();
+
+    merge();
+    lps[0]->report();
+}
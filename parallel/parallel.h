@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <thread>
+#include <barrier>
+#include "gpcc/gpcc.h"
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+// Conservative parallel execution of one model. The block graph is split into logical processes (LPs),
+// each LP is a full copy of the model built from the same recipe that serves only its own blocks with its
+// own event list and storages. Transactions cross LPs only at ADVANCE blocks with a positive minimal delay,
+// and are exchanged over lock-free channels.
+// Synchronization is YAWNS-style: all LPs agree on the earliest pending event T and serve events before
+// T + lookahead, where lookahead is the smallest minimal delay over crossing ADVANCE blocks. A transaction
+// posted during a window can not arrive before its end, so the results match the sequential run
+// (up to the summation order of time integrals). Transaction ids are unique only within an LP.
+// Stopping rules and warm-up detection are not supported; RESET at a fixed time is.
+class ParallelSimulation {
+private:
+    using RemoteSpawn = Simulation::RemoteSpawn;
+
+    double end_time;
+    SimBuilder::Partition partition;
+    vector<unique_ptr<Simulation>> lps;
+    vector<unique_ptr<SpscQueue<RemoteSpawn>>> channels; // channel from LP i to LP j is at i * count + j
+
+    void run_lp(size_t lp, barrier<>& sync, vector<double>& next);
+    void merge(); // collects every entity from its owner into lps[0]
+
+public:
+    ParallelSimulation(SimBuilder::recipe_t recipe, double end_time, size_t threads = thread::hardware_concurrency());
+
+    size_t processes();
+    double lookahead();
+    void launch();
+};
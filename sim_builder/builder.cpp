@@ -1,8 +1,13 @@
 #include "builder.h"
+#include "gpcc/checkpoint.h"
+#include "gpcc/live.h"
 #include <stdexcept>
 #include <string.h>
 #include <iostream>
 #include <format>
+#include <algorithm>
+#include <array>
+#include <bit>
 
 using namespace std;
 
@@ -29,7 +34,31 @@ SimBuilder& SimBuilder::add_label(const string& label) {
 SimBuilder& SimBuilder::add_storage(const string& label, size_t capacity) {
     if (storage_map.contains(label)) throw SimBuilderException(format("redeclaration of storage \"{}\"", label));
     storage_map[label] = sim->storages.size();
-    sim->storages.emplace_back(label, make_unique<Simulation::Storage>(*sim, capacity));
+    sim->storages.emplace_back(label, make_unique<Simulation::Storage>(*sim, capacity, sim->storages.size()));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_flow(const string& storage, double rate, double holding, FlowOptions options) {
+    if (!storage_map.contains(storage)) throw SimBuilderException(format("flow into undeclared storage \"{}\"", storage));
+    if (!(rate > 0) || !(holding > 0)) throw SimBuilderException("flow rate and holding time must be positive");
+    double step = options.step == 0 ? holding / 20 : options.step;
+    if (!(step > 0) || step > holding) throw SimBuilderException("flow step must be positive and at most the holding time");
+    size_t q_index = Simulation::FlowBlock::none;
+    if (!options.queue.empty()) {
+        if (!q_map.contains(options.queue)) {
+            q_map[options.queue] = sim->queues.size();
+            sim->queues.emplace_back(options.queue, 0);
+        }
+        q_index = q_map[options.queue];
+    }
+
+    auto block = make_unique<Simulation::FlowBlock>(*sim, storage_map[storage], q_index, rate, holding, step, options.fluid);
+    block->gen.seed(uint32_t(streams ? stream(options.stream, "FLOW") : stream_seed(format("FLOW {}", sim->flows.size()), 0)));
+    info.emplace_back(BlockInfo::FLOW, storage_map[storage]);
+    sim->flows.push_back(block.get());
+    sim->spawn_schedule.emplace(Simulation::SpawnData(Simulation::Transaction(0, sim->g_transaction_id++), block.get()), step);
+    sim->blocks.emplace_back(move(block));
 
     return *this;
 }
@@ -41,6 +70,7 @@ SimBuilder& SimBuilder::add_queue(const string& label) {
     }
 
     auto block = make_unique<Simulation::QueueBlock>(*sim, nullptr, q_map[label]);
+    info.emplace_back(BlockInfo::QUEUE, q_map[label]);
     if (hold != nullptr) hold->next = block.get();
     hold = block.get();
     sim->blocks.emplace_back(move(block));
@@ -52,6 +82,7 @@ SimBuilder& SimBuilder::add_depart(const string& label) {
     if (!q_map.contains(label)) throw SimBuilderException(format("depart from undeclared queue \"{}\"", label));
     
     auto block = make_unique<Simulation::DepartBlock>(*sim, nullptr, q_map[label]);
+    info.emplace_back(BlockInfo::DEPART, q_map[label]);
     if (hold != nullptr) hold->next = block.get();
     hold = block.get();
     sim->blocks.emplace_back(move(block));
@@ -63,6 +94,27 @@ SimBuilder& SimBuilder::add_enter(const string& label) {
     if (!storage_map.contains(label)) throw SimBuilderException(format("enter to undeclared storage \"{}\"", label));
 
     auto block = make_unique<Simulation::EnterBlock>(*sim, nullptr, storage_map[label]);
+    info.emplace_back(BlockInfo::ENTER, storage_map[label]);
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_enter(const string& label, Expr patience, const string& renege_label, const string& stream_name) {
+    if (!storage_map.contains(label)) throw SimBuilderException(format("enter to undeclared storage \"{}\"", label));
+    if (!label_map.contains(renege_label)) {
+        label_map[renege_label] = sim->labels.size();
+        sim->labels.emplace_back(renege_label, nullptr);
+    }
+    if (streams) assign_streams(patience, stream_name, "PATIENCE");
+
+    take_expr_refs(patience);
+    auto block = make_unique<Simulation::EnterBlock_renege>(*sim, nullptr, storage_map[label], move(patience), label_map[renege_label]);
+    info.emplace_back(BlockInfo::ENTER_RENEGE, storage_map[label]);
+    info.back().param = label_map[renege_label];
+    take_cond_refs();
     if (hold != nullptr) hold->next = block.get();
     hold = block.get();
     sim->blocks.emplace_back(move(block));
@@ -74,6 +126,7 @@ SimBuilder& SimBuilder::add_leave(const string& label) {
     if (!storage_map.contains(label)) throw SimBuilderException(format("leave from undeclared storage \"{}\"", label));
 
     auto block = make_unique<Simulation::LeaveBlock>(*sim, nullptr, storage_map[label]);
+    info.emplace_back(BlockInfo::LEAVE, storage_map[label]);
     if (hold != nullptr) hold->next = block.get();
     hold = block.get();
     sim->blocks.emplace_back(move(block));
@@ -81,9 +134,20 @@ SimBuilder& SimBuilder::add_leave(const string& label) {
     return *this;
 }
 
-SimBuilder& SimBuilder::add_generate(RandomGenerator rng, priority_t priority) {
-    double first_time = rng();
-    auto block = make_unique<Simulation::GenBlock>(*sim, nullptr, priority, rng);
+SimBuilder& SimBuilder::add_generate(RandomGenerator rng, priority_t priority, const string& stream_name) {
+    return add_generate(Expr(move(rng)), priority, stream_name);
+}
+
+SimBuilder& SimBuilder::add_generate(Expr interval, priority_t priority, const string& stream_name) {
+    if (streams) assign_streams(interval, stream_name, "GENERATE");
+    double first_time = interval.eval(*sim);
+    if (first_time < 0) throw SimBuilderException("negative time between arrivals");
+    auto block = make_unique<Simulation::GenBlock>(*sim, nullptr, priority, move(interval));
+    info.emplace_back(BlockInfo::GENERATE, 0);
+    info.back().param = priority;
+    info.back().expr = &block->interval;
+    take_expr_refs(block->interval);
+    take_cond_refs();
     if (hold != nullptr) {
         hold->next = block.get();
     }
@@ -96,8 +160,57 @@ SimBuilder& SimBuilder::add_generate(RandomGenerator rng, priority_t priority) {
     return *this;
 }
 
-SimBuilder& SimBuilder::add_advance(RandomGenerator rng) {
-    auto block = make_unique<Simulation::AdvanceBlock>(*sim, nullptr, rng);
+SimBuilder& SimBuilder::add_generate(RateTable rates, priority_t priority, const string& stream_name) {
+    Expr unit(RandomGenerator(minstd_rand(), make_shared<exponential_distribution_wrapper>(1.0)));
+    if (streams) assign_streams(unit, stream_name, "GENERATE");
+    else unit.rngs[0].seed(stream_seed(format("RATES {}", sim->blocks.size()), 0));
+    double first_time = rates.gap(sim->g_time, unit.eval(*sim));
+    auto block = make_unique<Simulation::GenBlock>(*sim, nullptr, priority, move(unit), move(rates));
+    info.emplace_back(BlockInfo::GENERATE, 0);
+    info.back().param = priority; // no expr: the time is not a sample of its own, for lanes and add_parameter
+    take_cond_refs();
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+
+    if (isfinite(first_time)) sim->spawn_schedule.emplace(Simulation::SpawnData(Simulation::Transaction(priority, sim->g_transaction_id++, true), block.get()), first_time);
+
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_generate_trace(const string& path, TraceOptions options, priority_t priority) {
+    auto trace = make_unique<TraceReader>(path, options);
+    double first_time;
+    uint64_t first_priority = priority;
+    trace->next(first_time, first_priority);
+    auto block = make_unique<Simulation::GenBlock>(*sim, nullptr, priority, move(trace));
+    info.emplace_back(BlockInfo::GENERATE, 0);
+    info.back().param = priority;
+    take_cond_refs();
+    if (hold != nullptr) {
+        hold->next = block.get();
+    }
+    hold = block.get();
+
+    sim->spawn_schedule.emplace(Simulation::SpawnData(Simulation::Transaction(first_priority, sim->g_transaction_id++, true), block.get()), first_time);
+
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_advance(RandomGenerator rng, const string& stream_name) {
+    return add_advance(Expr(move(rng)), stream_name);
+}
+
+SimBuilder& SimBuilder::add_advance(Expr delay, const string& stream_name) {
+    if (streams) assign_streams(delay, stream_name, "ADVANCE");
+    auto block = make_unique<Simulation::AdvanceBlock>(*sim, nullptr, move(delay));
+    info.emplace_back(BlockInfo::ADVANCE, 0, block->delay.lower_bound());
+    info.back().expr = &block->delay;
+    take_expr_refs(block->delay);
+    take_cond_refs();
     if (hold != nullptr) hold->next = block.get();
     hold = block.get();
     sim->blocks.emplace_back(move(block));
@@ -107,6 +220,27 @@ SimBuilder& SimBuilder::add_advance(RandomGenerator rng) {
 
 SimBuilder& SimBuilder::add_gate(LogicNode expr) {
     auto block = make_unique<Simulation::GateBlock>(*sim, nullptr, move(expr));
+    info.emplace_back(BlockInfo::GATE, 0);
+    take_cond_refs();
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->gates.push_back(block.get());
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_gate(LogicNode expr, Expr patience, const string& renege_label, const string& stream_name) {
+    if (!label_map.contains(renege_label)) {
+        label_map[renege_label] = sim->labels.size();
+        sim->labels.emplace_back(renege_label, nullptr);
+    }
+    if (streams) assign_streams(patience, stream_name, "PATIENCE");
+
+    take_expr_refs(patience);
+    auto block = make_unique<Simulation::GateBlock_renege>(*sim, nullptr, move(expr), move(patience), label_map[renege_label]);
+    info.emplace_back(BlockInfo::GATE_RENEGE, label_map[renege_label]);
+    take_cond_refs();
     if (hold != nullptr) hold->next = block.get();
     hold = block.get();
     sim->gates.push_back(block.get());
@@ -115,6 +249,35 @@ SimBuilder& SimBuilder::add_gate(LogicNode expr) {
     return *this;
 }
 
+SimBuilder& SimBuilder::add_interrupt(const string& storage) {
+    if (!storage_map.contains(storage)) throw SimBuilderException(format("interrupt of undeclared storage \"{}\"", storage));
+
+    auto block = make_unique<Simulation::InterruptBlock>(*sim, nullptr, storage_map[storage]);
+    info.emplace_back(BlockInfo::INTERRUPT, storage_map[storage]);
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_interrupt_gate(const string& gate_label) {
+    if (!label_map.contains(gate_label)) {
+        label_map[gate_label] = sim->labels.size();
+        sim->labels.emplace_back(gate_label, nullptr);
+    }
+
+    auto block = make_unique<Simulation::InterruptBlock>(*sim, nullptr, 0);
+    block->on_gate = true;
+    info.emplace_back(BlockInfo::INTERRUPT, label_map[gate_label]);
+    info.back().param = 1;
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
 SimBuilder& SimBuilder::add_transfer_expr(const string& alt_label, LogicNode expr) {
     if (!label_map.contains(alt_label)) {
         label_map[alt_label] = sim->labels.size();
@@ -122,6 +285,8 @@ SimBuilder& SimBuilder::add_transfer_expr(const string& alt_label, LogicNode exp
     }
 
     auto block = make_unique<Simulation::TransferBlock_expr>(*sim, nullptr, label_map[alt_label], move(expr));
+    info.emplace_back(BlockInfo::TRANSFER_EXPR, label_map[alt_label]);
+    take_cond_refs();
     if (hold != nullptr) hold->next = block.get();
     hold = block.get();
     sim->blocks.emplace_back(move(block));
@@ -129,13 +294,16 @@ SimBuilder& SimBuilder::add_transfer_expr(const string& alt_label, LogicNode exp
     return *this;
 }
 
-SimBuilder& SimBuilder::add_transfer_prob(const string& alt_label, double prob, int seed) {
+SimBuilder& SimBuilder::add_transfer_prob(const string& alt_label, double prob, int seed, const string& stream_name) {
     if (!label_map.contains(alt_label)) {
         label_map[alt_label] = sim->labels.size();
         sim->labels.emplace_back(alt_label, nullptr);
     }
     
     auto block = make_unique<Simulation::TransferBlock_prob>(*sim, nullptr, label_map[alt_label], prob, seed);
+    if (streams) { block->gen.seed(uint32_t(stream(stream_name, "TRANSFER"))); block->antithetic = antithetic; }
+    info.emplace_back(BlockInfo::TRANSFER_PROB, label_map[alt_label]);
+    info.back().param = prob;
     if (hold != nullptr) hold->next = block.get();
     hold = block.get();
     sim->blocks.emplace_back(move(block));
@@ -150,6 +318,7 @@ SimBuilder& SimBuilder::add_transfer_imm(const string& label) {
     }
 
     auto block = make_unique<Simulation::TransferBlock_imm>(*sim, nullptr, label_map[label]);
+    info.emplace_back(BlockInfo::TRANSFER_IMM, label_map[label]);
     
     if (hold != nullptr) hold->next = block.get();
     hold = nullptr;
@@ -161,6 +330,7 @@ SimBuilder& SimBuilder::add_transfer_imm(const string& label) {
 
 SimBuilder& SimBuilder::add_debug(const string debug_msg) {
     auto block = make_unique<Simulation::DebugBlock>(*sim, nullptr, debug_msg);
+    info.emplace_back(BlockInfo::DEBUG, 0);
 
     if (hold != nullptr) hold->next = block.get();
     hold = nullptr;
@@ -172,6 +342,7 @@ SimBuilder& SimBuilder::add_debug(const string debug_msg) {
 
 SimBuilder& SimBuilder::add_terminate() {
     auto block = make_unique<Simulation::TerminateBlock>(*sim);
+    info.emplace_back(BlockInfo::TERMINATE, 0);
 
     if (hold != nullptr) hold->next = block.get();
     hold = nullptr;
@@ -181,36 +352,908 @@ SimBuilder& SimBuilder::add_terminate() {
     return *this;
 }
 
+SimBuilder& SimBuilder::set_reset_time(double time) {
+    if (time < 0) throw SimBuilderException("reset time must be non-negative");
+    sim->reset_time = time;
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::set_warmup_detection(double interval) {
+    if (interval <= 0) throw SimBuilderException("warm-up observation interval must be positive");
+    sim->warmup_interval = interval;
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_stop_rule_queue(const string& label, double precision) {
+    if (!q_map.contains(label)) throw SimBuilderException(format("stop rule on undeclared queue \"{}\"", label));
+    if (precision <= 0) throw SimBuilderException("stop rule precision must be positive");
+    sim->monitors.emplace_back(false, q_map[label], precision);
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_stop_rule_storage(const string& label, double precision) {
+    if (!storage_map.contains(label)) throw SimBuilderException(format("stop rule on undeclared storage \"{}\"", label));
+    if (precision <= 0) throw SimBuilderException("stop rule precision must be positive");
+    sim->monitors.emplace_back(true, storage_map[label], precision);
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::set_confidence(double level) {
+    if (level <= 0 || level >= 1) throw SimBuilderException("confidence level must be in (0; 1)");
+    sim->confidence = level;
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::set_batch_length(double length) {
+    if (length <= 0) throw SimBuilderException("batch length must be positive");
+    sim->batch_length = length;
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_table(const string& label, Histogram buckets) {
+    if (table_map.contains(label)) throw SimBuilderException(format("redeclaration of table \"{}\"", label));
+    table_map[label] = sim->tables.size();
+    sim->tables.emplace_back(label, move(buckets));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_mark() {
+    auto block = make_unique<Simulation::MarkBlock>(*sim, nullptr);
+    info.emplace_back(BlockInfo::MARK, 0);
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_tabulate(const string& table, function<double()> value) {
+    if (!table_map.contains(table)) throw SimBuilderException(format("tabulate to undeclared table \"{}\"", table));
+
+    auto block = make_unique<Simulation::TabulateBlock>(*sim, nullptr, table_map[table], move(value));
+    info.emplace_back(BlockInfo::TABULATE, table_map[table]);
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_coroutine(function<Simulation::Coroutine(Simulation::Context)> body) {
+    if (!body) throw SimBuilderException("empty coroutine body");
+    auto block = make_unique<Simulation::CoroutineBlock>(*sim, nullptr, move(body));
+    info.emplace_back(BlockInfo::COROUTINE, 0);
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_split(size_t count, const string& label) {
+    if (!label_map.contains(label)) {
+        label_map[label] = sim->labels.size();
+        sim->labels.emplace_back(label, nullptr);
+    }
+
+    auto block = make_unique<Simulation::SplitBlock>(*sim, nullptr, count, label_map[label]);
+    info.emplace_back(BlockInfo::SPLIT, label_map[label]);
+    info.back().param = count;
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_assemble(size_t count) {
+    if (count == 0) throw SimBuilderException("ASSEMBLE count must be positive");
+
+    auto block = make_unique<Simulation::AssembleBlock>(*sim, nullptr, count);
+    info.emplace_back(BlockInfo::ASSEMBLE, 0);
+    info.back().param = count;
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_gather(size_t count) {
+    if (count == 0) throw SimBuilderException("GATHER count must be positive");
+
+    auto block = make_unique<Simulation::GatherBlock>(*sim, nullptr, count);
+    info.emplace_back(BlockInfo::GATHER, 0);
+    info.back().param = count;
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_match(const string& conjugate_label) {
+    if (!label_map.contains(conjugate_label)) {
+        label_map[conjugate_label] = sim->labels.size();
+        sim->labels.emplace_back(conjugate_label, nullptr);
+    }
+
+    auto block = make_unique<Simulation::MatchBlock>(*sim, nullptr, label_map[conjugate_label]);
+    info.emplace_back(BlockInfo::MATCH, label_map[conjugate_label]);
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_group(const string& name, const vector<string>& storages) {
+    if (group_map.contains(name)) throw SimBuilderException(format("redeclaration of group \"{}\"", name));
+    if (storages.empty()) throw SimBuilderException(format("group \"{}\" has no storages", name));
+    if (storages.size() > numeric_limits<uint32_t>::max()) throw SimBuilderException(format("group \"{}\" is too large", name));
+    vector<size_t> members, capacity;
+    for (auto& storage : storages) {
+        if (!storage_map.contains(storage)) throw SimBuilderException(format("undeclared storage \"{}\" in group \"{}\"", storage, name));
+        members.push_back(storage_map[storage]);
+        capacity.push_back(sim->storages[members.back()].data->get_capacity());
+    }
+    for (auto& group : sim->groups) for (size_t m = 0; m < group.data->size(); ++m)
+        if (find(members.begin(), members.end(), group.data->storage(m)) != members.end())
+            throw SimBuilderException(format("storage \"{}\" is already in group \"{}\"", sim->storages[group.data->storage(m)].name, group.name));
+    for (size_t m = 0; m < members.size(); ++m)
+        if (find(members.begin(), members.begin() + m, members[m]) != members.begin() + m)
+            throw SimBuilderException(format("storage \"{}\" is twice in group \"{}\"", storages[m], name));
+
+    group_map[name] = sim->groups.size();
+    sim->groups.emplace_back(name, make_unique<StorageGroup>(members, move(capacity)));
+    for (size_t m = 0; m < members.size(); ++m) sim->storages[members[m]].data->join(sim->groups.back().data.get(), m);
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_select(const string& group, StorageGroup::policy_t policy, const string& alt_label) {
+    if (!group_map.contains(group)) throw SimBuilderException(format("select from undeclared group \"{}\"", group));
+    size_t alt_index = Simulation::SelectBlock::none;
+    if (!alt_label.empty()) {
+        if (!label_map.contains(alt_label)) {
+            label_map[alt_label] = sim->labels.size();
+            sim->labels.emplace_back(alt_label, nullptr);
+        }
+        alt_index = label_map[alt_label];
+    }
+    StorageGroup& members = *sim->groups[group_map[group]].data;
+    members.enable(policy);
+    if (policy == StorageGroup::FIRST_AVAILABLE && alt_index == Simulation::SelectBlock::none) members.enable(StorageGroup::MIN_LOAD); // where to wait
+
+    auto block = make_unique<Simulation::SelectBlock>(*sim, nullptr, group_map[group], policy, alt_index);
+    info.emplace_back(BlockInfo::SELECT, alt_index);
+    info.back().param = group_map[group];
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_leave_selected() {
+    auto block = make_unique<Simulation::LeaveBlock>(*sim, nullptr, Simulation::LeaveBlock::selected);
+    info.emplace_back(BlockInfo::LEAVE_SELECTED, 0);
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->blocks.emplace_back(move(block));
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_instances(const Template& subnetwork, size_t count, size_t first) {
+    using Step = Template::Step;
+    // entity of every step: local ones are numbered among the template's own, global ones are looked up now
+    auto local = [](const auto& names, const string& name, auto key) {
+        for (size_t i = 0; i < names.size(); ++i) if (key(names[i]) == name) return i;
+        return names.size();
+    };
+    vector<size_t> entity(subnetwork.steps.size());
+    vector<bool> is_local(subnetwork.steps.size(), false);
+    for (size_t j = 0; j < subnetwork.steps.size(); ++j) {
+        const Step& step = subnetwork.steps[j];
+        size_t k;
+        switch (step.kind) {
+            case BlockInfo::QUEUE: case BlockInfo::DEPART:
+                k = local(subnetwork.queues, step.name, [](const string& q) -> const string& { return q; });
+                if (k < subnetwork.queues.size()) { entity[j] = k; is_local[j] = true; break; }
+                if (!q_map.contains(step.name)) throw SimBuilderException(format("depart from undeclared queue \"{}\"", step.name));
+                entity[j] = q_map[step.name];
+                break;
+            case BlockInfo::ENTER: case BlockInfo::LEAVE:
+                k = local(subnetwork.storages, step.name, [](const Template::LocalStorage& s) -> const string& { return s.name; });
+                if (k < subnetwork.storages.size()) { entity[j] = k; is_local[j] = true; break; }
+                if (!storage_map.contains(step.name)) throw SimBuilderException(format("undeclared storage \"{}\"", step.name));
+                entity[j] = storage_map[step.name];
+                break;
+            case BlockInfo::TABULATE:
+                if (!table_map.contains(step.name)) throw SimBuilderException(format("tabulate to undeclared table \"{}\"", step.name));
+                entity[j] = table_map[step.name];
+                break;
+            default: break;
+        }
+    }
+
+    size_t blocks = count * subnetwork.steps.size();
+    sim->blocks.reserve(sim->blocks.size() + blocks);
+    info.reserve(info.size() + blocks);
+    sim->queues.reserve(sim->queues.size() + count * subnetwork.queues.size());
+    sim->storages.reserve(sim->storages.size() + count * subnetwork.storages.size());
+    q_map.reserve(q_map.size() + count * subnetwork.queues.size());
+    storage_map.reserve(storage_map.size() + count * subnetwork.storages.size());
+
+    for (size_t i = first; i < first + count; ++i) {
+        string suffix = format("[{}]", i);
+        size_t q0 = sim->queues.size(), s0 = sim->storages.size();
+        for (auto& q : subnetwork.queues) {
+            string name = q + suffix;
+            if (!q_map.try_emplace(name, sim->queues.size()).second) throw SimBuilderException(format("redeclaration of queue \"{}\"", name));
+            sim->queues.emplace_back(name, 0);
+        }
+        for (auto& storage : subnetwork.storages) {
+            string name = storage.name + suffix;
+            if (!storage_map.try_emplace(name, sim->storages.size()).second) throw SimBuilderException(format("redeclaration of storage \"{}\"", name));
+            sim->storages.emplace_back(name, make_unique<Simulation::Storage>(*sim, storage.capacity(i), sim->storages.size()));
+        }
+
+        for (size_t j = 0; j < subnetwork.steps.size(); ++j) {
+            const Step& step = subnetwork.steps[j];
+            size_t queue = entity[j] + (is_local[j] ? q0 : 0), storage = entity[j] + (is_local[j] ? s0 : 0);
+            switch (step.kind) {
+                case BlockInfo::QUEUE: append(make_unique<Simulation::QueueBlock>(*sim, nullptr, queue), step.kind, queue); break;
+                case BlockInfo::DEPART: append(make_unique<Simulation::DepartBlock>(*sim, nullptr, queue), step.kind, queue); break;
+                case BlockInfo::ENTER: append(make_unique<Simulation::EnterBlock>(*sim, nullptr, storage), step.kind, storage); break;
+                case BlockInfo::LEAVE: append(make_unique<Simulation::LeaveBlock>(*sim, nullptr, storage), step.kind, storage); break;
+                case BlockInfo::MARK: append(make_unique<Simulation::MarkBlock>(*sim, nullptr), step.kind, 0); break;
+                case BlockInfo::TABULATE: append(make_unique<Simulation::TabulateBlock>(*sim, nullptr, entity[j], nullptr), step.kind, entity[j]); break;
+                case BlockInfo::ADVANCE: {
+                    Expr delay = step.time(i);
+                    if (step.reseed && !streams) for (size_t r = 0; r < delay.rngs.size(); ++r) delay.rngs[r].seed(stream_seed("template", sim->blocks.size()) + r);
+                    add_advance(move(delay), step.stream.empty() ? "" : step.stream + suffix);
+                    break;
+                }
+                default: break;
+            }
+        }
+    }
+
+    return *this;
+}
+
+void SimBuilder::append(unique_ptr<Simulation::Block> block, BlockInfo::kind_t kind, size_t arg) {
+    info.emplace_back(kind, arg);
+    if (hold != nullptr) hold->next = block.get();
+    hold = block.get();
+    sim->blocks.emplace_back(move(block));
+}
+
+SimBuilder::Template& SimBuilder::Template::add_storage(const string& name, size_t capacity) {
+    return add_storage(name, [capacity](size_t) { return capacity; });
+}
+
+SimBuilder::Template& SimBuilder::Template::add_storage(const string& name, function<size_t(size_t)> capacity) {
+    for (auto& storage : storages) if (storage.name == name) throw SimBuilderException(format("redeclaration of storage \"{}\"", name));
+    storages.push_back(LocalStorage{name, move(capacity)});
+
+    return *this;
+}
+
+SimBuilder::Template& SimBuilder::Template::add_queue(const string& name) {
+    if (find(queues.begin(), queues.end(), name) == queues.end()) queues.push_back(name);
+    steps.push_back(Step{BlockInfo::QUEUE, name});
+
+    return *this;
+}
+
+SimBuilder::Template& SimBuilder::Template::add_depart(const string& name) {
+    steps.push_back(Step{BlockInfo::DEPART, name});
+
+    return *this;
+}
+
+SimBuilder::Template& SimBuilder::Template::add_enter(const string& name) {
+    steps.push_back(Step{BlockInfo::ENTER, name});
+
+    return *this;
+}
+
+SimBuilder::Template& SimBuilder::Template::add_leave(const string& name) {
+    steps.push_back(Step{BlockInfo::LEAVE, name});
+
+    return *this;
+}
+
+SimBuilder::Template& SimBuilder::Template::add_advance(Expr delay, const string& stream) {
+    steps.push_back(Step{BlockInfo::ADVANCE, "", [delay = move(delay)](size_t) { return delay; }, true, stream});
+
+    return *this;
+}
+
+SimBuilder::Template& SimBuilder::Template::add_advance(function<Expr(size_t)> delay, const string& stream) {
+    if (!delay) throw SimBuilderException("empty ADVANCE time");
+    steps.push_back(Step{BlockInfo::ADVANCE, "", move(delay), false, stream});
+
+    return *this;
+}
+
+SimBuilder::Template& SimBuilder::Template::add_mark() {
+    steps.push_back(Step{BlockInfo::MARK, ""});
+
+    return *this;
+}
+
+SimBuilder::Template& SimBuilder::Template::add_tabulate(const string& table) {
+    steps.push_back(Step{BlockInfo::TABULATE, table});
+
+    return *this;
+}
 
 LogicNode::func_t SimBuilder::is_q_empty(const string& label) {
     size_t index = q_map[label];
+    pending_refs.push_back(EntityRef{0, false, index});
     Simulation* sim_ptr = sim.get();
     return [sim_ptr, index](){ return sim_ptr->is_q_empty(index); };
 }
 
 LogicNode::func_t SimBuilder::is_storage_empty(const string& label) {
     size_t index = storage_map[label];
+    pending_refs.push_back(EntityRef{0, true, index});
     Simulation* sim_ptr = sim.get();
     return [sim_ptr, index](){ return sim_ptr->is_storage_empty(index); };
 }
 
 LogicNode::func_t SimBuilder::is_storage_avail(const string& label) {
     size_t index = storage_map[label];
+    pending_refs.push_back(EntityRef{0, true, index});
     Simulation* sim_ptr = sim.get();
     return [sim_ptr, index](){ return sim_ptr->is_storage_avail(index); };
 }
 LogicNode::func_t SimBuilder::is_storage_full(const string& label) {
     size_t index = storage_map[label];
+    pending_refs.push_back(EntityRef{0, true, index});
     Simulation* sim_ptr = sim.get();
     return [sim_ptr, index](){ return sim_ptr->is_storage_full(index); };
 }
 
+LogicNode::func_t SimBuilder::test(Expr cond) {
+    take_expr_refs(cond);
+    Simulation* sim_ptr = sim.get();
+    return [sim_ptr, cond = move(cond)]() mutable { return cond.eval(*sim_ptr) != 0; };
+}
+
+Expr SimBuilder::q_length(const string& label) {
+    if (!q_map.contains(label)) throw SimBuilderException(format("undeclared queue \"{}\" in expression", label));
+    return Expr::q_length(q_map[label]);
+}
+
+Expr SimBuilder::storage_content(const string& label) {
+    if (!storage_map.contains(label)) throw SimBuilderException(format("undeclared storage \"{}\" in expression", label));
+    return Expr::storage_content(storage_map[label]);
+}
+
+Expr SimBuilder::storage_capacity(const string& label) {
+    if (!storage_map.contains(label)) throw SimBuilderException(format("undeclared storage \"{}\" in expression", label));
+    return Expr(double(sim->storages[storage_map[label]].data->get_capacity()));
+}
+
+Expr SimBuilder::clock() { return Expr::clock(); }
+Expr SimBuilder::priority() { return Expr::priority(); }
+
+void SimBuilder::assign_streams(Expr& expr, const string& name, const string& kind) {
+    for (size_t i = 0; i < expr.rngs.size(); ++i) {
+        string sub = name.empty() || i == 0 ? name : format("{}/{}", name, i);
+        expr.rngs[i].seed(stream(sub, kind));
+        expr.rngs[i].set_antithetic(antithetic);
+    }
+}
+
+// test() leaves wait in pending_refs for their GATE or TRANSFER; GENERATE and ADVANCE take theirs at once
+void SimBuilder::take_expr_refs(const Expr& expr) {
+    for (auto& instr : expr.code) {
+        if (instr.op == Expr::Q) pending_refs.push_back(EntityRef{0, false, instr.index});
+        if (instr.op == Expr::S) pending_refs.push_back(EntityRef{0, true, instr.index});
+    }
+}
+
+void SimBuilder::take_cond_refs() {
+    for (auto& ref : pending_refs) { ref.block = info.size() - 1; cond_refs.push_back(ref); }
+    pending_refs.clear();
+}
+
+SimBuilder::BlockIndex::BlockIndex(const vector<unique_ptr<Simulation::Block>>& blocks) {
+    size_t capacity = bit_ceil(blocks.size() * 2 + 2); // load factor at most 1/2
+    mask = capacity - 1;
+    slots.assign(capacity, {nullptr, 0});
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        size_t s = slot(blocks[i].get());
+        while (slots[s].first != nullptr) s = (s + 1) & mask;
+        slots[s] = {blocks[i].get(), i};
+    }
+}
+
+size_t SimBuilder::BlockIndex::operator[](const Simulation::Block* block) const {
+    for (size_t s = slot(block); slots[s].first != nullptr; s = (s + 1) & mask) if (slots[s].first == block) return slots[s].second;
+    throw out_of_range("block is not in the model");
+}
+
+SimBuilder::BlockIndex SimBuilder::block_index() { return BlockIndex(sim->blocks); }
+
+SimBuilder::Partition SimBuilder::partition(size_t parts) {
+    if (parts == 0) throw SimBuilderException("partition into 0 processes");
+    for (auto& el : sim->labels) if (el.data == nullptr) throw SimBuilderException(format("Usage of undefined label \"{}\"", el.name));
+
+    size_t n = sim->blocks.size();
+    auto index = block_index();
+
+    // union-find over blocks
+    vector<size_t> parent(n);
+    for (size_t i = 0; i < n; ++i) parent[i] = i;
+    auto find = [&parent](size_t x) {
+        while (parent[x] != x) x = parent[x] = parent[parent[x]];
+        return x;
+    };
+    auto unite = [&](size_t a, size_t b) { parent[find(a)] = find(b); };
+
+    vector<pair<size_t, size_t>> cut; // ADVANCE -> next edges that may cross processes
+    vector<size_t> family, generators;  // ASSEMBLE, GATHER and MATCH blocks; GENERATE blocks
+    vector<size_t> q_first(sim->queues.size(), n), storage_first(sim->storages.size(), n); // first block touching an entity
+    auto touch = [&](size_t block, bool storage, size_t entity) {
+        size_t& first = storage ? storage_first[entity] : q_first[entity];
+        if (first == n) first = block;
+        else unite(block, first);
+    };
+
+    for (size_t i = 0; i < n; ++i) {
+        Simulation::Block* next = sim->blocks[i]->next;
+        if (next != nullptr) {
+            if (info[i].kind == BlockInfo::ADVANCE && info[i].min_delay > 0) cut.emplace_back(i, index[next]);
+            else unite(i, index[next]);
+        }
+        switch (info[i].kind) {
+            case BlockInfo::QUEUE: case BlockInfo::DEPART: touch(i, false, info[i].arg); break;
+            case BlockInfo::ENTER: case BlockInfo::LEAVE: touch(i, true, info[i].arg); break;
+            case BlockInfo::TRANSFER_IMM: case BlockInfo::TRANSFER_EXPR: case BlockInfo::TRANSFER_PROB: case BlockInfo::SPLIT:
+                unite(i, index[sim->labels[info[i].arg].data]); break;
+            case BlockInfo::MATCH: // the conjugate MATCH reads this one's waiting members
+                unite(i, index[sim->labels[info[i].arg].data]);
+                family.push_back(i);
+                break;
+            case BlockInfo::ASSEMBLE: case BlockInfo::GATHER: family.push_back(i); break;
+            case BlockInfo::GENERATE: generators.push_back(i); break;
+            case BlockInfo::SELECT: {
+                auto& group = *sim->groups[size_t(info[i].param)].data;
+                for (size_t m = 0; m < group.size(); ++m) touch(i, true, group.storage(m));
+                if (info[i].arg != Simulation::SelectBlock::none) unite(i, index[sim->labels[info[i].arg].data]);
+                break;
+            }
+            case BlockInfo::ENTER_RENEGE:
+                touch(i, true, info[i].arg);
+                unite(i, index[sim->labels[size_t(info[i].param)].data]);
+                break;
+            case BlockInfo::GATE_RENEGE: unite(i, index[sim->labels[info[i].arg].data]); break;
+            case BlockInfo::INTERRUPT:
+                if (info[i].param != 0) unite(i, index[sim->labels[info[i].arg].data]);
+                else touch(i, true, info[i].arg);
+                break;
+            case BlockInfo::LEAVE_SELECTED: // any storage a SELECT may have entered
+                for (auto& group : sim->groups) for (size_t m = 0; m < group.data->size(); ++m) touch(i, true, group.data->storage(m));
+                break;
+            case BlockInfo::COROUTINE: // may touch anything
+                for (size_t q = 0; q < sim->queues.size(); ++q) touch(i, false, q);
+                for (size_t st = 0; st < sim->storages.size(); ++st) touch(i, true, st);
+                break;
+            default: break;
+        }
+    }
+    for (auto& ref : cond_refs) touch(ref.block, ref.storage, ref.index);
+    // families are keyed by transaction ids, which are unique only within a process: they must all come from one
+    if (!family.empty()) for (size_t g : generators) unite(g, family[0]);
+    for (size_t f : family) unite(f, family[0]);
+
+    // largest components first, each to the least loaded process
+    unordered_map<size_t, size_t> size;
+    for (size_t i = 0; i < n; ++i) ++size[find(i)];
+    vector<pair<size_t, size_t>> components(size.begin(), size.end()); // (root, size)
+    sort(components.begin(), components.end(), [](auto& a, auto& b) { return a.second != b.second ? a.second > b.second : a.first < b.first; });
+
+    Partition res;
+    res.count = min(parts, components.size());
+    if (res.count == 0) res.count = 1;
+    vector<size_t> load(res.count, 0);
+    unordered_map<size_t, size_t> lp_of_root;
+    for (auto& [root, sz] : components) {
+        size_t lp = min_element(load.begin(), load.end()) - load.begin();
+        lp_of_root[root] = lp;
+        load[lp] += sz;
+    }
+
+    res.lp.resize(n);
+    for (size_t i = 0; i < n; ++i) res.lp[i] = lp_of_root[find(i)];
+    res.queue_lp.assign(sim->queues.size(), 0);
+    res.storage_lp.assign(sim->storages.size(), 0);
+    for (size_t i = 0; i < q_first.size(); ++i) if (q_first[i] != n) res.queue_lp[i] = res.lp[q_first[i]];
+    for (size_t i = 0; i < storage_first.size(); ++i) if (storage_first[i] != n) res.storage_lp[i] = res.lp[storage_first[i]];
+    for (auto& [from, to] : cut) if (res.lp[from] != res.lp[to]) res.lookahead = min(res.lookahead, info[from].min_delay);
+
+    return res;
+}
+
+unique_ptr<Simulation> SimBuilder::build(const Partition& partition, size_t lp) {
+    if (partition.lp.size() != sim->blocks.size()) throw SimBuilderException("partition was made for another model");
+    if (sim->checkpoint_file) throw SimBuilderException("checkpoints are not supported by parallel execution");
+    if (!live_name.empty()) throw SimBuilderException("live statistics are not supported by parallel execution");
+    if (sim->ipa) throw SimBuilderException("gradients are not supported by parallel execution");
+    if (!sim->flows.empty()) throw SimBuilderException("flows are not supported by parallel execution");
+    for (auto& bi : info) if (bi.kind == BlockInfo::ENTER_RENEGE || bi.kind == BlockInfo::GATE_RENEGE)
+        throw SimBuilderException("reneging is not supported by parallel execution");
+    auto index = block_index();
+
+    for (size_t i = 0; i < sim->blocks.size(); ++i) {
+        if (info[i].kind != BlockInfo::ADVANCE || partition.lp[i] != lp) continue;
+        auto block = static_cast<Simulation::AdvanceBlock*>(sim->blocks[i].get());
+        if (block->next == nullptr) continue;
+        size_t next = index[block->next];
+        if (partition.lp[next] == lp) continue;
+        block->remote_lp = partition.lp[next];
+        block->remote_block = next;
+    }
+
+    // generators of other processes must not start here
+    vector<Simulation::TimedSpawn> initial;
+    while (!sim->spawn_schedule.empty()) {
+        auto& spawn = sim->spawn_schedule.top();
+        if (partition.lp[index[spawn.spawn_data.block]] == lp) initial.push_back(spawn);
+        sim->spawn_schedule.pop();
+    }
+    for (auto& spawn : initial) sim->spawn_schedule.push(spawn);
+
+    if (hold != nullptr) cerr << "Warning: transactions may fall out of bounds\n";
+    return finish();
+}
+
 unique_ptr<Simulation> SimBuilder::build() {
     if (hold != nullptr) cerr << "Warning: transactions may fall out of bounds\n";
     for (auto& el : sim->labels) if (el.data == nullptr) throw SimBuilderException(format("Usage of undefined label \"{}\"", el.name));
+    if (sim->ipa) apply_gradient(); // before optimize() drops blocks
+    if (optimize_graph) optimize();
+    return finish();
+}
+
+unique_ptr<Simulation> SimBuilder::finish() {
+    for (size_t i = 0; i < sim->blocks.size(); ++i) {
+        if (info[i].kind != BlockInfo::MATCH) continue;
+        auto block = static_cast<Simulation::MatchBlock*>(sim->blocks[i].get());
+        auto& label = sim->labels[info[i].arg];
+        block->conjugate = dynamic_cast<Simulation::MatchBlock*>(label.data);
+        if (block->conjugate == nullptr) throw SimBuilderException(format("label \"{}\" of a MATCH is not at a MATCH block", label.name));
+    }
+    for (size_t i = 0; i < sim->blocks.size(); ++i) {
+        if (info[i].kind != BlockInfo::INTERRUPT || info[i].param == 0) continue;
+        auto block = static_cast<Simulation::InterruptBlock*>(sim->blocks[i].get());
+        auto& label = sim->labels[info[i].arg];
+        if (label.data == nullptr) continue; // the gate was unreachable: nobody waits there
+        block->gate = dynamic_cast<Simulation::GateBlock_renege*>(label.data);
+        if (block->gate == nullptr) throw SimBuilderException(format("label \"{}\" of an INTERRUPT is not at a reneging GATE", label.name));
+    }
+    check_cycles();
     sim->q_stat.resize(sim->queues.size());
-    sim->storage_stat.resize(sim->queues.size());
+    sim->storage_stat.resize(sim->storages.size());
+
+    if (sim->batch_length == 0) sim->batch_length = sim->end_time / 1024;
+    if (sim->warmup_interval > 0) {
+        if (sim->monitors.empty()) { // no metrics were chosen: the warm-up is over when every entity has settled
+            for (size_t i = 0; i < sim->queues.size(); ++i) sim->monitors.emplace_back(false, i, 0);
+            for (size_t i = 0; i < sim->storages.size(); ++i) sim->monitors.emplace_back(true, i, 0);
+        }
+        for (auto& monitor : sim->monitors) monitor.mser = Mser(sim->warmup_interval);
+        sim->warmup_done = sim->monitors.empty();
+    }
+    sim->reset_stat(); // sets up batch means
+
+    if (!live_name.empty()) {
+        vector<string> queues;
+        vector<pair<string, size_t>> storages;
+        for (auto& q : sim->queues) queues.push_back(q.name);
+        for (auto& storage : sim->storages) storages.emplace_back(storage.name, storage.data->get_capacity());
+        sim->live = make_unique<LiveSegment>(live_name, live_interval, queues, storages);
+        sim->next_publish = 0;
+        sim->publish_live(false);
+    }
 
     return move(sim);
 }
 
+SimBuilder& SimBuilder::set_streams(uint64_t replication, bool antithetic) {
+    streams = true;
+    this->replication = replication;
+    this->antithetic = antithetic;
+
+    return *this;
+}
+
+uint64_t SimBuilder::stream(const string& name, const string& kind) {
+    string key = name.empty() ? format("{} {}", kind, unnamed_streams[kind]++) : name;
+    if (!stream_names.insert(key).second) throw SimBuilderException(format("stream \"{}\" is used twice", key));
+    return stream_seed(key, replication);
+}
+
+SimBuilder& SimBuilder::set_checkpoint(const string& path, double interval) {
+    if (interval <= 0) throw SimBuilderException("checkpoint interval must be positive");
+    sim->checkpoint_file = make_unique<CheckpointFile>(path);
+    sim->checkpoint_interval = interval;
+    sim->next_checkpoint = interval;
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::add_parameter(const string& name) {
+    if (name.empty()) throw SimBuilderException("empty parameter name");
+    if (hold == nullptr || hold != sim->blocks.back().get()) throw SimBuilderException(format("parameter \"{}\" must follow its block", name));
+    auto& last = info.back();
+    if ((last.kind != BlockInfo::GENERATE && last.kind != BlockInfo::ADVANCE) || last.expr == nullptr)
+        throw SimBuilderException(format("parameter \"{}\" must follow a GENERATE or ADVANCE with a random time", name));
+    const Simulation::Expr& expr = *last.expr;
+    auto dist = expr.code.size() == 1 && expr.code[0].op == Simulation::Expr::RAND
+        ? dynamic_cast<exponential_distribution_wrapper*>(expr.rngs[0].get_distribution().get()) : nullptr;
+    if (dist == nullptr) throw SimBuilderException(format("parameter \"{}\": the time must be a single exponential sample", name));
+    for (auto& p : parameters) if (p.name == name && p.rate != dist->lambda())
+        throw SimBuilderException(format("parameter \"{}\" names rates {} and {}", name, p.rate, dist->lambda()));
+    parameters.push_back(Parameter{hold, last.kind == BlockInfo::GENERATE, dist->lambda(), name});
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::set_gradient(const string& parameter) {
+    if (parameter.empty()) throw SimBuilderException("empty parameter name");
+    sim->ipa = true;
+    sim->gradient = parameter;
+
+    return *this;
+}
+
+void SimBuilder::apply_gradient() {
+    bool found = false;
+    for (auto& p : parameters) {
+        if (p.name != sim->gradient) continue;
+        found = true;
+        // X = -ln(1 - U) / rate, so dX / d(rate) = -X / rate
+        if (p.generate) {
+            static_cast<Simulation::GenBlock*>(p.block)->sensitivity = -1 / p.rate;
+            sim->ipa_scale = 1 / p.rate;
+        } else static_cast<Simulation::AdvanceBlock*>(p.block)->sensitivity = -1 / p.rate;
+    }
+    if (!found) throw SimBuilderException(format("no rate is named \"{}\"", sim->gradient));
+
+    // first arrivals were drawn before the sensitivities were known
+    vector<Simulation::TimedSpawn> initial;
+    while (!sim->spawn_schedule.empty()) {
+        initial.push_back(sim->spawn_schedule.top());
+        sim->spawn_schedule.pop();
+    }
+    for (auto& spawn : initial) {
+        auto block = dynamic_cast<Simulation::GenBlock*>(spawn.spawn_data.block);
+        if (block != nullptr && block->sensitivity != 0 && spawn.spawn_data.transaction.just_generated) {
+            spawn.spawn_data.transaction.perturbation = spawn.time * block->sensitivity;
+            spawn.spawn_data.transaction.scaled = true;
+        }
+        sim->spawn_schedule.push(spawn);
+    }
+}
+
+SimBuilder& SimBuilder::set_live_stats(const string& name, double interval) {
+    if (name.empty()) throw SimBuilderException("empty name of live statistics");
+    if (!(interval > 0)) throw SimBuilderException("live statistics interval must be positive");
+    live_name = name;
+    live_interval = interval;
+
+    return *this;
+}
+
+SimBuilder& SimBuilder::set_graph_optimization(bool enable) {
+    optimize_graph = enable;
+
+    return *this;
+}
+
+void SimBuilder::optimize() {
+    // the passes work on positions in sim->blocks, so every edge is looked up once
+    static constexpr size_t none = -1;
+    size_t n = sim->blocks.size();
+    auto index = block_index();
+    auto position = [&](Simulation::Block* block) { return block == nullptr ? none : index[block]; };
+    vector<size_t> next(n), label_at(sim->labels.size());
+    for (size_t i = 0; i < n; ++i) next[i] = position(sim->blocks[i]->next);
+    for (size_t l = 0; l < sim->labels.size(); ++l) label_at[l] = position(sim->labels[l].data);
+
+    // 1. TRANSFER(imm) costs a dispatch only to return its label: edges to it go to the label instead.
+    // Labels never point to TRANSFER(imm), so one step is enough
+    for (size_t i = 0; i < n; ++i) {
+        if (next[i] == none || info[next[i]].kind != BlockInfo::TRANSFER_IMM) continue;
+        size_t label = info[next[i]].arg;
+        next[i] = label_at[label];
+        sim->blocks[i]->next = sim->labels[label].data;
+        ++sim->graph_report.bypassed;
+    }
+
+    // 2. runs of QUEUE, DEPART, ENTER and LEAVE become one superblock. A run starts where an edge enters it from outside;
+    // the original blocks stay as resume points of ENTER and are dropped below if nothing else leads to them
+    auto fusable = [&](size_t i) {
+        if (i >= n) return false;
+        auto k = info[i].kind;
+        return k == BlockInfo::QUEUE || k == BlockInfo::DEPART || k == BlockInfo::ENTER || k == BlockInfo::LEAVE;
+    };
+    vector<size_t> heads;
+    for (size_t i = 0; i < n; ++i) if (!fusable(i) && fusable(next[i]) && fusable(next[next[i]])) heads.push_back(next[i]);
+    for (size_t at : label_at) if (fusable(at) && fusable(next[at])) heads.push_back(at);
+
+    using Op = Simulation::FusedBlock::Op;
+    vector<size_t> fused(n, none); // by position of the head: position of its superblock
+    vector<size_t> resume;       // positions of op.resume of all superblocks in order
+    vector<size_t> first_op = {0};
+    for (size_t head : heads) {
+        if (fused[head] != none) continue;
+        vector<Op> ops;
+        size_t i = head;
+        do { // a run may close into a cycle
+            auto& bi = info[i];
+            Op::kind_t op = bi.kind == BlockInfo::QUEUE ? Op::QUEUE : bi.kind == BlockInfo::DEPART ? Op::DEPART : bi.kind == BlockInfo::ENTER ? Op::ENTER : Op::LEAVE;
+            ops.push_back(Op{op, bi.arg, sim->blocks[i]->next});
+            resume.push_back(next[i]);
+            i = next[i];
+        } while (fusable(i) && i != head && ops.size() < n);
+        sim->graph_report.fused_blocks += ops.size();
+        first_op.push_back(resume.size());
+        fused[head] = sim->blocks.size();
+        next.push_back(i);
+        sim->blocks.emplace_back(make_unique<Simulation::FusedBlock>(*sim, i == none ? nullptr : sim->blocks[i].get(), move(ops)));
+        info.emplace_back(BlockInfo::FUSED, 0);
+    }
+    size_t total = sim->blocks.size();
+    sim->graph_report.fused += total - n;
+
+    auto redirect = [&](size_t& to, Simulation::Block*& target) { // targets are original blocks at this point
+        if (to < n && fused[to] != none) { to = fused[to]; target = sim->blocks[to].get(); }
+    };
+    for (size_t i = 0; i < total; ++i) redirect(next[i], sim->blocks[i]->next);
+    for (size_t k = 0; k + n < total; ++k) {
+        auto& ops = static_cast<Simulation::FusedBlock*>(sim->blocks[n + k].get())->ops;
+        for (size_t j = 0; j < ops.size(); ++j) redirect(resume[first_op[k] + j], ops[j].resume);
+    }
+    for (size_t l = 0; l < sim->labels.size(); ++l) redirect(label_at[l], sim->labels[l].data);
+
+    // 3. drop blocks no transaction can reach. Transactions start at generators
+    vector<bool> reached(total, false);
+    vector<size_t> stack;
+    auto visit = [&](size_t i) {
+        if (i != none && !reached[i]) { reached[i] = true; stack.push_back(i); }
+    };
+    auto roots = sim->spawn_schedule;
+    for (; !roots.empty(); roots.pop()) visit(position(roots.top().spawn_data.block));
+    while (!stack.empty()) {
+        size_t i = stack.back();
+        stack.pop_back();
+        visit(next[i]);
+        switch (info[i].kind) {
+            case BlockInfo::TRANSFER_IMM: case BlockInfo::TRANSFER_EXPR: case BlockInfo::TRANSFER_PROB: case BlockInfo::SPLIT: case BlockInfo::MATCH:
+                visit(label_at[info[i].arg]); break;
+            case BlockInfo::SELECT: if (info[i].arg != Simulation::SelectBlock::none) visit(label_at[info[i].arg]); break;
+            case BlockInfo::ENTER_RENEGE: visit(label_at[size_t(info[i].param)]); break;
+            case BlockInfo::GATE_RENEGE: visit(label_at[info[i].arg]); break;
+            case BlockInfo::FUSED: {
+                auto& ops = static_cast<Simulation::FusedBlock*>(sim->blocks[i].get())->ops;
+                for (size_t j = 0; j < ops.size(); ++j) if (ops[j].kind == Op::ENTER) visit(resume[first_op[i - n] + j]);
+                break;
+            }
+            default: break;
+        }
+    }
+
+    erase_if(sim->gates, [&](Simulation::GateBlock* gate) { return !reached[index[gate]]; });
+    for (size_t l = 0; l < sim->labels.size(); ++l) if (label_at[l] != none && !reached[label_at[l]]) sim->labels[l].data = nullptr; // only unreachable transfers could use it
+    size_t kept = 0;
+    for (size_t i = 0; i < total; ++i) {
+        if (!reached[i]) continue;
+        sim->blocks[kept] = move(sim->blocks[i]);
+        info[kept++] = info[i];
+    }
+    sim->graph_report.dropped += total - kept;
+    sim->blocks.resize(kept);
+    info.resize(kept, BlockInfo(BlockInfo::TERMINATE, 0));
+    cond_refs.clear(); // block indices are no longer valid
+}
+
+void SimBuilder::check_cycles() {
+    // zero-time edges: the transaction moves on within the same event. Edges of unconditional blocks are always taken
+    size_t n = sim->blocks.size();
+    auto index = block_index();
+    vector<array<size_t, 2>> edges(n, {n, n});
+    vector<bool> conditional(n, false);
+    for (size_t i = 0; i < n; ++i) {
+        Simulation::Block* next = sim->blocks[i]->next;
+        size_t to = next != nullptr ? index[next] : n;
+        size_t label = n;
+        switch (info[i].kind) {
+            case BlockInfo::ADVANCE: case BlockInfo::COROUTINE: case BlockInfo::TERMINATE: case BlockInfo::FLOW: continue;
+            case BlockInfo::TRANSFER_IMM: to = index[sim->labels[info[i].arg].data]; break;
+            case BlockInfo::TRANSFER_EXPR: case BlockInfo::TRANSFER_PROB:
+                label = index[sim->labels[info[i].arg].data];
+                conditional[i] = true;
+                break;
+            case BlockInfo::SPLIT: label = index[sim->labels[info[i].arg].data]; break; // copies start at once
+            case BlockInfo::SELECT:
+                if (info[i].arg != Simulation::SelectBlock::none) label = index[sim->labels[info[i].arg].data];
+                conditional[i] = true;
+                break;
+            case BlockInfo::ENTER: case BlockInfo::GATE: case BlockInfo::ASSEMBLE: case BlockInfo::GATHER: case BlockInfo::MATCH:
+            case BlockInfo::ENTER_RENEGE: case BlockInfo::GATE_RENEGE:
+                conditional[i] = true;
+                break;
+            case BlockInfo::FUSED:
+                for (auto& op : static_cast<Simulation::FusedBlock*>(sim->blocks[i].get())->ops)
+                    if (op.kind == Simulation::FusedBlock::Op::ENTER) conditional[i] = true;
+                break;
+            default: break;
+        }
+        edges[i] = {to, label};
+    }
+
+    // Tarjan's strongly connected components, iterative
+    static constexpr size_t none = -1;
+    vector<size_t> order(n, none), low(n), stack;
+    vector<bool> on_stack(n, false);
+    vector<pair<size_t, size_t>> dfs; // (block, next edge)
+    vector<size_t> component;
+    size_t counter = 0;
+    static const char* kinds[] = {"QUEUE", "DEPART", "ENTER", "LEAVE", "GENERATE", "ADVANCE", "GATE", "TRANSFER(imm)", "TRANSFER(expr)", "TRANSFER(prob)", "DEBUG", "TERMINATE", "COROUTINE", "FUSED", "MARK", "TABULATE", "SPLIT", "ASSEMBLE", "GATHER", "MATCH", "FLOW", "SELECT", "LEAVE(selected)", "ENTER(renege)", "GATE(renege)", "INTERRUPT"};
+
+    for (size_t root = 0; root < n; ++root) {
+        if (order[root] != none) continue;
+        dfs.emplace_back(root, 0);
+        while (!dfs.empty()) {
+            auto& [v, e] = dfs.back();
+            if (e == 0 && order[v] == none) {
+                order[v] = low[v] = counter++;
+                stack.push_back(v);
+                on_stack[v] = true;
+            }
+            if (e < 2) {
+                size_t to = edges[v][e++];
+                if (to == n) continue;
+                if (order[to] == none) dfs.emplace_back(to, 0);
+                else if (on_stack[to]) low[v] = min(low[v], order[to]);
+                continue;
+            }
+
+            size_t u = v;
+            dfs.pop_back();
+            if (!dfs.empty()) low[dfs.back().first] = min(low[dfs.back().first], low[u]);
+            if (low[u] != order[u]) continue;
+
+            component.clear();
+            do { component.push_back(stack.back()); on_stack[stack.back()] = false; stack.pop_back(); } while (component.back() != u);
+            bool loop = component.size() > 1 || edges[u][0] == u || edges[u][1] == u;
+            if (!loop) continue;
+
+            bool certain = true;
+            string path;
+            for (auto it = component.rbegin(); it != component.rend(); ++it) {
+                certain = certain && !conditional[*it];
+                path += format("{}{} #{}", path.empty() ? "" : " -> ", kinds[info[*it].kind], *it);
+            }
+            if (certain) throw SimBuilderException(format("zero-time cycle {}: transactions would loop forever without advancing the clock", path));
+            cerr << format("Warning: zero-time cycle {} may loop forever depending on conditions\n", path);
+            sim->graph_report.cycles.push_back(path);
+        }
+    }
+}
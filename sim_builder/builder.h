@@ -1,41 +1,230 @@
 #pragma once
 #include <string>
 #include <stdexcept>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
 #include "gpcc/gpcc.h"
 
 class SimBuilder {
 private:
+    friend class LaneSimulation; // reads the block graph
+
     unique_ptr<Simulation> sim;
     Simulation::Block* hold = nullptr;
     unordered_map<string, size_t> q_map;
     unordered_map<string, size_t> storage_map;
     unordered_map<string, size_t> label_map;
+    unordered_map<string, size_t> table_map;
+    unordered_map<string, size_t> group_map;
+
+    // block graph as the builder sees it, one entry per block in sim->blocks. Used by graph passes
+    struct BlockInfo {
+        enum kind_t: int {QUEUE, DEPART, ENTER, LEAVE, GENERATE, ADVANCE, GATE, TRANSFER_IMM, TRANSFER_EXPR, TRANSFER_PROB, DEBUG, TERMINATE, COROUTINE, FUSED, MARK, TABULATE, SPLIT, ASSEMBLE, GATHER, MATCH, FLOW, SELECT, LEAVE_SELECTED, ENTER_RENEGE, GATE_RENEGE, INTERRUPT};
+        kind_t kind;
+        size_t arg;       // queue, storage or label index (SELECT: none without an alternative label; INTERRUPT: label of the gate if param)
+        double min_delay; // ADVANCE: lower bound of the delay
+        double param = 0; // GENERATE: priority; TRANSFER(prob): probability; SPLIT, ASSEMBLE, GATHER: count; SELECT: group; ENTER(renege): label
+        Expr* expr = nullptr; // GENERATE, ADVANCE: the time, owned by the block (none for a trace)
+
+        BlockInfo(kind_t kind, size_t arg, double min_delay = 0): kind(kind), arg(arg), min_delay(min_delay) {}
+    };
+    struct EntityRef {
+        size_t block;
+        bool storage; // false: queue
+        size_t index;
+    };
+    vector<BlockInfo> info;
+    vector<EntityRef> cond_refs;    // entities read by conditions of GATE and TRANSFER(expr)
+    vector<EntityRef> pending_refs; // collected by is_* until a conditional block takes them
+
+    void take_cond_refs();
+    void append(unique_ptr<Simulation::Block> block, BlockInfo::kind_t kind, size_t arg); // links the block after hold
+    // position of every block in sim->blocks. Open addressing over one array: graph passes rebuild it, so it has to be
+    // cheap for models with millions of blocks
+    class BlockIndex {
+    private:
+        vector<pair<const Simulation::Block*, size_t>> slots; // nullptr: free
+        size_t mask;
+        size_t slot(const Simulation::Block* block) const { return (reinterpret_cast<uintptr_t>(block) >> 4) * 0x9e3779b97f4a7c15ull >> 20 & mask; }
+    public:
+        BlockIndex(const vector<unique_ptr<Simulation::Block>>& blocks);
+        size_t operator[](const Simulation::Block* block) const; // throws out_of_range if the block is not in the model
+    };
+    BlockIndex block_index();
+
+    // variance reduction: random blocks draw from named streams seeded by (name, replication)
+    bool streams = false;
+    uint64_t replication = 0;
+    bool antithetic = false;
+    unordered_set<string> stream_names;            // in use
+    unordered_map<string, size_t> unnamed_streams; // per block kind, for default names
+    uint64_t stream(const string& name, const string& kind); // registers the stream, returns its seed
+    void assign_streams(Expr& expr, const string& name, const string& kind); // one stream per generator of expr
+    void take_expr_refs(const Expr& expr);                                   // entities read by expr, for partition()
+
+    string live_name; // shared memory of set_live_stats; empty: none
+    double live_interval = 0;
+
+    // rates named by add_parameter; build() sets the sensitivity of the blocks of the one chosen by set_gradient
+    struct Parameter {
+        Simulation::Block* block;
+        bool generate; // GENERATE or ADVANCE
+        double rate;
+        string name;
+    };
+    vector<Parameter> parameters;
+    void apply_gradient();
+
+    bool optimize_graph = true;
+    void optimize();    // graph passes of build(), see Simulation::GraphReport
+    void check_cycles(); // throws on a zero-time cycle that can never be left
+    unique_ptr<Simulation> finish();
 
 public:
     using priority_t = Simulation::priority_t;
+    using recipe_t = function<void(SimBuilder&)>; // adds a model to a fresh builder. Must build the same model every time
+    class Template; // subnetwork added many times by add_instances()
+
+    // split of the block graph into logical processes. Blocks that share an entity or are linked by
+    // a zero-time edge are never split; only ADVANCE blocks with a positive minimal delay may lead to another process
+    struct Partition {
+        vector<size_t> lp;            // logical process of every block
+        vector<size_t> queue_lp;      // owner of every queue
+        vector<size_t> storage_lp;    // owner of every storage
+        size_t count = 1;
+        double lookahead = numeric_limits<double>::infinity(); // min delay over edges between processes
+    };
+
+
     SimBuilder& add_label(const string& label);
     SimBuilder& add_storage(const string& label, size_t capacity);
+    // the path GENERATE (exponential, rate) -> ENTER storage -> ADVANCE (exponential, mean holding) -> LEAVE storage ->
+    // TERMINATE as one aggregate block (Simulation::FlowBlock), for heavy background traffic: the cost is two events per
+    // step instead of two per transaction. Not linked to the previous block
+    SimBuilder& add_flow(const string& storage, double rate, double holding, FlowOptions options = {});
     SimBuilder& add_queue(const string& label);
     SimBuilder& add_depart(const string& label);
     SimBuilder& add_enter(const string& label);
+    // reneging: a transaction that has waited patience (drawn when it starts waiting; infinity: no limit) leaves the
+    // delay chain for renege_label. Timers of transactions that get through are cancelled in O(1)
+    SimBuilder& add_enter(const string& label, Expr patience, const string& renege_label, const string& stream = "");
     SimBuilder& add_leave(const string& label);
-    SimBuilder& add_generate(RandomGenerator gen, priority_t priority = 0);
-    SimBuilder& add_advance(RandomGenerator gen);
+    SimBuilder& add_generate(RandomGenerator gen, priority_t priority = 0, const string& stream = ""); // stream: see set_streams
+    SimBuilder& add_generate(Expr interval, priority_t priority = 0, const string& stream = "");
+    SimBuilder& add_generate(RateTable rates, priority_t priority = 0, const string& stream = ""); // Poisson arrivals with a rate that varies in time (gpcc/rate.h)
+    SimBuilder& add_generate_trace(const string& path, TraceOptions options = {}, priority_t priority = 0); // arrivals of a file (gpcc/trace.h); records with a priority override the given one
+    SimBuilder& add_advance(RandomGenerator gen, const string& stream = "");
+    SimBuilder& add_advance(Expr delay, const string& stream = "");
     SimBuilder& add_gate(LogicNode expr);
+    SimBuilder& add_gate(LogicNode expr, Expr patience, const string& renege_label, const string& stream = ""); // as add_enter
+    SimBuilder& add_interrupt(const string& storage);        // transactions waiting for storage with a renege label renege now
+    SimBuilder& add_interrupt_gate(const string& gate_label); // ... waiting at the reneging GATE at gate_label
     SimBuilder& add_transfer_expr(const string& alt_label, LogicNode expr);
-    SimBuilder& add_transfer_prob(const string& alt_label, double prob, int seed = 1);
+    SimBuilder& add_transfer_prob(const string& alt_label, double prob, int seed = 1, const string& stream = "");
     SimBuilder& add_transfer_imm(const string& alt_label);
     SimBuilder& add_debug(const string debug_msg);
     SimBuilder& add_terminate();
+    SimBuilder& add_table(const string& label, Histogram buckets); // e.g. Histogram(Histogram::LOG, 0.01, 1.25, 64)
+    SimBuilder& add_mark();
+    SimBuilder& add_tabulate(const string& table, function<double()> value = nullptr); // empty value: M1, time since generation or the last MARK
+    SimBuilder& add_coroutine(function<Simulation::Coroutine(Simulation::Context)> body); // see gpcc/coroutine.h
+    SimBuilder& add_split(size_t count, const string& label); // count copies of the transaction, members of its family, start at label
+    SimBuilder& add_assemble(size_t count);                    // one transaction goes on per count family members
+    SimBuilder& add_gather(size_t count);                      // family members go on together, count at a time
+    SimBuilder& add_match(const string& conjugate_label);      // waits for a family member at the MATCH block of conjugate_label
+    SimBuilder& add_group(const string& name, const vector<string>& storages); // storages a SELECT chooses from, in this order
+    // enters the member of group chosen by policy (see gpcc/group.h); alt_label: where to go when no member has a free
+    // place, empty: wait for the least loaded one
+    SimBuilder& add_select(const string& group, StorageGroup::policy_t policy, const string& alt_label = "");
+    SimBuilder& add_leave_selected();                          // LEAVE of the storage the transaction's last SELECT entered
+    SimBuilder& add_instances(const Template& subnetwork, size_t count, size_t first = 0); // instances first, ..., first + count - 1, one after another
+
+    SimBuilder& set_reset_time(double time);                                 // RESET: statistics before time are discarded
+    SimBuilder& set_warmup_detection(double interval);                       // MSER-5 over observations averaged on interval
+    SimBuilder& add_stop_rule_queue(const string& label, double precision);  // stop once CI half-width / mean <= precision
+    SimBuilder& add_stop_rule_storage(const string& label, double precision);
+    SimBuilder& set_confidence(double level);
+    SimBuilder& set_batch_length(double length); // initial batch length for batch means. Default is end_time / 1024
+    SimBuilder& set_graph_optimization(bool enable); // on by default
+    SimBuilder& set_checkpoint(const string& path, double interval); // saves the state to path every interval of model time, see Simulation::restore
+    SimBuilder& set_live_stats(const string& name, double interval = 0.5); // publishes the clock and entity levels to POSIX shared memory
+                                                                          // name (e.g. "/gpcc") every interval seconds of wall time, see gpcc/live.h
+    // common random numbers: GENERATE, ADVANCE and TRANSFER(prob) added after this call ignore their seeds and draw from
+    // streams named by their stream argument (by default "GENERATE 0", "ADVANCE 1", ... in the order of their kind).
+    // A stream gives the same numbers in every model for the same replication. Default names count the blocks of a kind,
+    // so a block added before others of its kind moves them to other streams: name the streams that must stay put.
+    // antithetic: every stream yields 1 - U
+    SimBuilder& set_streams(uint64_t replication, bool antithetic = false);
+    // gradients by infinitesimal perturbation analysis: add_parameter names the rate of the exponential time of the
+    // previous GENERATE or ADVANCE (several blocks may share a name); with set_gradient(name) the run also estimates
+    // d(mean) / d(rate) of every queue and storage (Simulation::get_q_gradient, report). IPA assumes that a small
+    // change of the rate does not reorder events: FIFO storages, no gates or conditional transfers on the path
+    SimBuilder& add_parameter(const string& name);
+    SimBuilder& set_gradient(const string& parameter);
 
     LogicNode::func_t is_q_empty(const string& label);
     LogicNode::func_t is_storage_empty(const string& label);
     LogicNode::func_t is_storage_avail(const string& label);
     LogicNode::func_t is_storage_full(const string& label);
+    LogicNode::func_t test(Expr cond); // true when cond is not 0, e.g. test(q_length("q") > 10)
 
+    // standard numerical attributes for expressions (see gpcc/expr.h)
+    Expr q_length(const string& label);
+    Expr storage_content(const string& label);
+    Expr storage_capacity(const string& label); // a constant
+    Expr clock();
+    Expr priority();
+
+    Partition partition(size_t parts); // call before build()
     unique_ptr<Simulation> build();
+    unique_ptr<Simulation> build(const Partition& partition, size_t lp); // the model as logical process lp. The graph is not optimized: block indices address remote transactions
 
     SimBuilder(double end_time): sim(make_unique<Simulation>()) { sim->end_time = end_time; }
 };
 
+// Subnetwork defined once and added many times, e.g. a station of a plant:
+//
+//     SimBuilder::Template station;
+//     station.add_storage("machine", 2).add_queue("wait").add_enter("machine").add_depart("wait")
+//            .add_advance(RandomGenerator(minstd_rand(1), make_unique<exponential_distribution_wrapper>(2)))
+//            .add_leave("machine");
+//     builder.add_generate(...).add_instances(station, 1000).add_terminate();
+//
+// Storages and queues added by the template are local: instance i gets its own, named "machine[i]". Other names refer
+// to entities of the builder and are resolved once per add_instances(). Parameters that differ between instances are
+// given as functions of the instance number. Copies of a fixed ADVANCE time get their generators reseeded per instance
+// (with set_streams they draw from streams "name[i]" instead), so instances are independent
+class SimBuilder::Template {
+private:
+    struct Step {
+        BlockInfo::kind_t kind;
+        string name = "";                 // queue, storage or table
+        function<Expr(size_t)> time = {}; // ADVANCE
+        bool reseed = false;              // ADVANCE with a fixed time
+        string stream = "";
+    };
+    struct LocalStorage {
+        string name;
+        function<size_t(size_t)> capacity;
+    };
+    vector<Step> steps;
+    vector<LocalStorage> storages;
+    vector<string> queues;
+
+    friend class SimBuilder;
+public:
+    Template& add_storage(const string& name, size_t capacity);
+    Template& add_storage(const string& name, function<size_t(size_t)> capacity);
+    Template& add_queue(const string& name);
+    Template& add_depart(const string& name);
+    Template& add_enter(const string& name);
+    Template& add_leave(const string& name);
+    Template& add_advance(Expr delay, const string& stream = "");
+    Template& add_advance(function<Expr(size_t)> delay, const string& stream = "");
+    Template& add_mark();
+    Template& add_tabulate(const string& table); // M1
+};
+
 class SimBuilderException;
\ No newline at end of file
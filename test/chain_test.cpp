@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+using Chain = WaitChain<int, unsigned long>;
+
+static vector<int> drain(Chain& chain, double now) {
+    vector<int> res;
+    while (!chain.empty()) res.push_back(chain.pop(now));
+    return res;
+}
+
+TEST(ChainTest, HigherPriorityFirstFifoWithin) {
+    Chain chain;
+    chain.push(1, 10, 0);
+    chain.push(3, 30, 0);
+    chain.push(1, 11, 0);
+    chain.push(3, 31, 0);
+    chain.push(2, 20, 0);
+    EXPECT_EQ(chain.front(), 30);
+    EXPECT_EQ(chain.front_priority(), 3u);
+    EXPECT_EQ(drain(chain, 1), (vector<int>{30, 31, 20, 10, 11}));
+}
+
+TEST(ChainTest, ManyPriorityLevels) {
+    // more levels than a bitmap word, created in random order and reused after they empty
+    vector<int> levels(200);
+    for (int i = 0; i < 200; ++i) levels[i] = i;
+    shuffle(levels.begin(), levels.end(), mt19937(5));
+    Chain chain;
+    for (int round = 0; round < 2; ++round) {
+        for (int p : levels) chain.push(p, p, 0);
+        vector<int> expected = levels;
+        sort(expected.rbegin(), expected.rend());
+        EXPECT_EQ(drain(chain, 0), expected);
+    }
+}
+
+TEST(ChainTest, RemoveFromAnywhere) {
+    Chain chain;
+    uint32_t a = chain.push(1, 1, 0), b = chain.push(1, 2, 0), c = chain.push(1, 3, 0);
+    uint32_t d = chain.push(5, 4, 0, 77);
+    EXPECT_EQ(chain.remove(b, 1), 2);       // middle
+    EXPECT_EQ(chain.remove(d, 1), 4);       // the only one of its level
+    EXPECT_EQ(chain.front(), 1);
+    EXPECT_EQ(chain.remove(c, 1), 3);       // tail
+    chain.push(1, 5, 1);                    // goes behind a, reusing a node
+    EXPECT_EQ(chain.remove(a, 2), 1);       // head
+    EXPECT_EQ(chain.get_removed(), 4u);
+    uint32_t tag = 0;
+    chain.push(1, 6, 2, 9);
+    EXPECT_EQ(chain.pop(3, &tag), 5);
+    EXPECT_EQ(tag, Chain::nil);
+    EXPECT_EQ(chain.pop(3, &tag), 6);
+    EXPECT_EQ(tag, 9u);
+    EXPECT_TRUE(chain.empty());
+}
+
+TEST(ChainTest, Statistics) {
+    Chain chain;
+    chain.push(0, 1, 0);
+    chain.push(0, 2, 1);
+    chain.pop(3);
+    chain.pop(4);
+    EXPECT_EQ(chain.get_entries(), 2u);
+    EXPECT_EQ(chain.get_max(), 2u);
+    EXPECT_DOUBLE_EQ(chain.get_mean_wait(), 3);
+    EXPECT_DOUBLE_EQ(chain.get_mean_length(4), 1.5); // 1 for [0; 1], 2 for [1; 3], 1 for [3; 4]
+}
+
+TEST(ChainTest, ResetKeepsWaitingItems) {
+    Chain chain;
+    chain.push(0, 1, 0);
+    chain.push(0, 2, 1);
+    chain.reset_stat(2);
+    EXPECT_EQ(chain.get_entries(), 2u); // those waiting count as entries of the new period
+    EXPECT_EQ(chain.get_max(), 2u);
+    chain.pop(3);
+    EXPECT_DOUBLE_EQ(chain.get_mean_wait(), 1); // from the reset
+    EXPECT_DOUBLE_EQ(chain.get_mean_length(4), 1.5);
+    EXPECT_EQ(chain.size(), 1u);
+}
+
+// arrivals at 1, 2, ...; one server busy for 2 per transaction: k starts at 2k - 1 after waiting k - 1
+static unique_ptr<Simulation> single_server(double reset) {
+    SimBuilder b(10.5);
+    if (reset > 0) b.set_reset_time(reset);
+    b.add_storage("srv", 1).add_generate(Expr(1.0)).add_enter("srv").add_advance(Expr(2.0)).add_leave("srv").add_terminate();
+    auto sim = b.build();
+    sim->run_until(10.5);
+    return sim;
+}
+
+// fields of the CHAINS row of name
+static vector<string> chains_row(Simulation& sim, const string& name) {
+    testing::internal::CaptureStdout();
+    sim.report();
+    istringstream in(testing::internal::GetCapturedStdout());
+    string line;
+    bool chains = false;
+    while (getline(in, line)) {
+        if (line == "CHAINS:") chains = true;
+        else if (chains && line.rfind("\t" + name + "\t", 0) == 0) {
+            vector<string> fields;
+            istringstream row(line);
+            for (string field; row >> field;) fields.push_back(field);
+            return fields;
+        }
+    }
+    return {};
+}
+
+TEST(ChainTest, ReportedChainStatistics) {
+    auto sim = single_server(0);
+    auto chain = sim->get_storage_chain_stats(0);
+    EXPECT_EQ(chain.current, 5u); // 6..10
+    EXPECT_EQ(chain.max, 5u);
+    EXPECT_EQ(chain.entries, 9u);  // 2..10 had to wait
+    EXPECT_DOUBLE_EQ(chain.wait, 2.5); // 2..5 waited 1..4
+    auto row = chains_row(*sim, "srv");
+    ASSERT_EQ(row.size(), 6u);
+    EXPECT_EQ(row[1], "5");
+    EXPECT_EQ(row[4], "9");
+    EXPECT_DOUBLE_EQ(stod(row[5]), 2.5);
+}
+
+TEST(ChainTest, ResetTimeRestartsChainStatistics) {
+    auto sim = single_server(5.5);
+    auto chain = sim->get_storage_chain_stats(0);
+    EXPECT_EQ(chain.current, 5u);
+    EXPECT_EQ(chain.entries, 7u);      // 4 and 5 waiting at the reset, then 6..10
+    EXPECT_DOUBLE_EQ(chain.wait, 2.5); // 4 left at 7, 5 at 9: 1.5 and 3.5 after the reset
+}
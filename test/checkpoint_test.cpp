@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+static RandomGenerator exp_gen(unsigned seed, double rate) {
+    return RandomGenerator(minstd_rand(seed), make_unique<exponential_distribution_wrapper>(rate));
+}
+
+// two stations, a gate and a table; statistics are reset at 300
+static void model(SimBuilder& b) {
+    b.add_storage("rab1", 5).add_storage("rab2", 5)
+    .add_table("m1", Histogram(Histogram::LOG, 0.001, 1.2, 64))
+    .add_generate(exp_gen(1, 5), 1)
+    .add_queue("qrab1").add_enter("rab1").add_depart("qrab1")
+    .add_advance(exp_gen(2, 22)).add_leave("rab1").add_tabulate("m1").add_terminate()
+    .add_generate(exp_gen(3, 9), 2)
+    .add_queue("qrab2")
+    .add_gate(LogicNode(b.is_storage_avail("rab1")) | b.is_storage_avail("rab2"))
+    .add_transfer_expr("enter_r1", b.is_storage_avail("rab1"))
+    .add_transfer_imm("enter_r2")
+    .add_enter("rab1").add_label("enter_r1").add_depart("qrab2")
+    .add_advance(exp_gen(4, 36)).add_leave("rab1").add_terminate()
+    .add_enter("rab2").add_label("enter_r2").add_depart("qrab2")
+    .add_advance(exp_gen(5, 35)).add_leave("rab2").add_terminate();
+    b.set_reset_time(300);
+}
+
+static unique_ptr<Simulation> build(double end_time, const string& checkpoint = "", double interval = 0) {
+    SimBuilder b(end_time);
+    model(b);
+    if (!checkpoint.empty()) b.set_checkpoint(checkpoint, interval);
+    return b.build();
+}
+
+static string report_of(Simulation& sim) {
+    testing::internal::CaptureStdout();
+    sim.report();
+    return testing::internal::GetCapturedStdout();
+}
+
+static string full_run(double end_time) {
+    auto sim = build(end_time);
+    sim->run_until(end_time);
+    return report_of(*sim);
+}
+
+TEST(CheckpointTest, ImageContinuesAsTheSavedRun) {
+    auto saved = build(2000);
+    saved->run_until(250); // before the reset
+    auto image = saved->image();
+
+    auto restored = build(2000);
+    restored->restore_image(image);
+    restored->run_until(2000);
+    EXPECT_EQ(report_of(*restored), full_run(2000));
+}
+
+TEST(CheckpointTest, ImageRestoresIntoItsOwnSimulation) {
+    auto sim = build(2000);
+    sim->run_until(1000);
+    auto image = sim->image();
+    sim->run_until(2000);
+    string first = report_of(*sim);
+    sim->restore_image(image);
+    sim->run_until(2000);
+    EXPECT_EQ(report_of(*sim), first);
+}
+
+TEST(CheckpointTest, FileRoundTrip) {
+    string path = testing::TempDir() + "checkpoint_test_file.ckpt";
+    auto saved = build(2000);
+    saved->run_until(700);
+    saved->save_checkpoint(path);
+
+    auto restored = build(2000);
+    restored->restore(path);
+    restored->run_until(2000);
+    remove(path.c_str());
+    EXPECT_EQ(report_of(*restored), full_run(2000));
+}
+
+TEST(CheckpointTest, PeriodicCheckpointContinuesTheRun) {
+    string path = testing::TempDir() + "checkpoint_test_periodic.ckpt";
+    auto periodic = build(2000, path, 300);
+    periodic->run_until(2000);
+    periodic.reset(); // the writer thread finishes the last checkpoint
+
+    auto restored = build(2000);
+    restored->restore(path);
+    restored->run_until(2000);
+    remove(path.c_str());
+    EXPECT_EQ(report_of(*restored), full_run(2000));
+}
+
+TEST(CheckpointTest, OtherModelIsRejected) {
+    auto sim = build(100);
+    sim->run_until(50);
+    auto image = sim->image();
+
+    SimBuilder b(100);
+    b.add_generate(exp_gen(1, 1)).add_queue("q").add_advance(exp_gen(2, 2)).add_depart("q").add_terminate();
+    auto other = b.build();
+    EXPECT_THROW(other->restore_image(image), runtime_error);
+}
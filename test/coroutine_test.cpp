@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+static bool open_flag;
+static vector<pair<uint64_t, double>> resumed; // (transaction, time)
+
+static Simulation::Coroutine wait_open(Simulation::Context ctx) {
+    co_await ctx.wait_until([]() { return open_flag; });
+    resumed.emplace_back(ctx.transaction_id(), ctx.time());
+}
+
+static Simulation::Coroutine open_once(Simulation::Context) {
+    open_flag = true;
+    co_return;
+}
+
+TEST(CoroutineTest, WaitersResumeTogetherInOrder) {
+    open_flag = false;
+    resumed.clear();
+    SimBuilder b(30);
+    b.add_generate(Expr(0.01)).add_coroutine(wait_open).add_terminate();
+    b.add_generate(Expr(10.0)).add_coroutine(open_once).add_terminate();
+    auto sim = b.build();
+    sim->run_until(30);
+
+    size_t waited = 0;
+    for (auto& [id, time] : resumed) if (time == 10.0) ++waited;
+    EXPECT_GT(waited, 900u); // every arrival before the first opening
+    for (size_t i = 1; i < resumed.size(); ++i) {
+        EXPECT_LT(resumed[i - 1].first, resumed[i].first);
+        EXPECT_LE(resumed[i - 1].second, resumed[i].second);
+    }
+}
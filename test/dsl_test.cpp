@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+#include "dsl/dsl.h"
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+// the example from dsl.h
+static string dsl_report(double end_time) {
+    auto model = dsl::Storage<"rab1", 2> >> dsl::Generate<dsl::Exp<0.5>> >> dsl::Queue<"q"> >> dsl::Enter<"rab1">
+                 >> dsl::Depart<"q"> >> dsl::Advance<dsl::Uniform<1.0, 3.0>> >> dsl::Leave<"rab1"> >> dsl::Terminate;
+    dsl::Engine<decltype(model)> engine(end_time);
+    testing::internal::CaptureStdout();
+    engine.launch();
+    return testing::internal::GetCapturedStdout();
+}
+
+static string builder_report(double end_time) {
+    SimBuilder b(end_time);
+    b.set_graph_optimization(false);
+    b.add_storage("rab1", 2)
+    .add_generate(RandomGenerator(minstd_rand(1), make_unique<exponential_distribution_wrapper>(0.5)))
+    .add_queue("q").add_enter("rab1").add_depart("q")
+    .add_advance(RandomGenerator(minstd_rand(1), make_unique<uniform_real_distribution_wrapper>(1, 3)))
+    .add_leave("rab1").add_terminate();
+    auto sim = b.build();
+    testing::internal::CaptureStdout();
+    sim->launch();
+    return testing::internal::GetCapturedStdout();
+}
+
+TEST(DslTest, MatchesSimBuilderReport) {
+    string report = dsl_report(1000);
+    EXPECT_NE(report.find("rab1"), string::npos);
+    EXPECT_EQ(report, builder_report(1000));
+}
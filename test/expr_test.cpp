@@ -0,0 +1,28 @@
+#include <gtest/gtest.h>
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+static Expr q() { return Expr::q_length(0); }
+
+TEST(ExprTest, LowerBoundOfNonNegativeTerms) {
+    EXPECT_DOUBLE_EQ((Expr(2.0) + 0.5 * q()).lower_bound(), 2.0);
+    EXPECT_DOUBLE_EQ(max(q(), Expr(3.0)).lower_bound(), 3.0);
+    EXPECT_DOUBLE_EQ(min(q() + 4, Expr(3.0)).lower_bound(), 3.0);
+    RandomGenerator uniform(minstd_rand(1), make_unique<uniform_real_distribution_wrapper>(0.5, 1.5));
+    EXPECT_DOUBLE_EQ((Expr(move(uniform)) + 1).lower_bound(), 1.5);
+}
+
+// terms that may be negative must not be dropped from a sum
+TEST(ExprTest, LowerBoundOfNegativeTerms) {
+    EXPECT_DOUBLE_EQ((Expr(20.0) + (-q())).lower_bound(), 0.0);
+    EXPECT_DOUBLE_EQ((20 + Expr(-1.0) * q()).lower_bound(), 0.0);
+    EXPECT_DOUBLE_EQ((3 * (q() - 5) + 20).lower_bound(), 5.0);
+    EXPECT_DOUBLE_EQ((Expr(10.0) - min(q(), Expr(4.0))).lower_bound(), 6.0);
+}
+
+TEST(ExprTest, LowerBoundOfQuotients) {
+    EXPECT_DOUBLE_EQ((Expr(10.0) / (q() + 2)).lower_bound(), 0.0);
+    EXPECT_DOUBLE_EQ(((q() + 6) / 2).lower_bound(), 3.0);
+    EXPECT_DOUBLE_EQ((Expr(10.0) + Expr(1.0) / (q() - 1)).lower_bound(), 0.0); // the divisor may be 0
+}
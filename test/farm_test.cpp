@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <set>
+#include "experiment/farm.h"
+
+using namespace std;
+
+static void mm1(SimBuilder& b) {
+    b.add_storage("s", 1)
+    .add_generate(RandomGenerator(minstd_rand(1), make_unique<exponential_distribution_wrapper>(0.8)))
+    .add_queue("q").add_enter("s").add_depart("q")
+    .add_advance(RandomGenerator(minstd_rand(2), make_unique<exponential_distribution_wrapper>(1)))
+    .add_leave("s").add_terminate();
+}
+
+static double mean_wait(Simulation& s) { return s.get_q_stats(0).m; }
+
+// replication r run in this process, as a worker runs it
+static unique_ptr<Simulation> replication(size_t r, double end_time) {
+    SimBuilder b(end_time);
+    b.set_streams(r);
+    mm1(b);
+    auto sim = b.build();
+    sim->run_until(end_time);
+    return sim;
+}
+
+TEST(FarmTest, MatchesReplicationsInProcess) {
+    Farm farm(500, 12);
+    auto result = farm.add_metric("wait", mean_wait).set_workers(3).run(mm1);
+    EXPECT_EQ(result.replications, 12u);
+    EXPECT_TRUE(result.failures.empty());
+
+    double sum = 0;
+    uint64_t events = 0;
+    for (size_t r = 0; r < 12; ++r) {
+        auto sim = replication(r, 500);
+        sum += mean_wait(*sim);
+        events += sim->get_events();
+    }
+    ASSERT_EQ(result.metrics.size(), 1u);
+    EXPECT_DOUBLE_EQ(result.metrics[0].mean, sum / 12);
+    EXPECT_EQ(result.events, events);
+}
+
+TEST(FarmTest, CrashLosesOnlyItsReplication) {
+    // replications whose event count is a multiple of 3 crash their worker
+    Farm farm(500, 12);
+    farm.add_metric("wait", [](Simulation& s) {
+        if (s.get_events() % 3 == 0) abort();
+        return mean_wait(s);
+    }).set_workers(2);
+    auto result = farm.run(mm1);
+
+    set<size_t> crashed, failed;
+    double sum = 0;
+    size_t finished = 0;
+    for (size_t r = 0; r < 12; ++r) {
+        auto sim = replication(r, 500);
+        if (sim->get_events() % 3 == 0) crashed.insert(r);
+        else sum += mean_wait(*sim), ++finished;
+    }
+    ASSERT_FALSE(crashed.empty());
+    ASSERT_GT(finished, 0u);
+    for (auto& failure : result.failures) {
+        failed.insert(failure.replication);
+        EXPECT_NE(failure.reason.find("signal"), string::npos) << failure.reason;
+    }
+    EXPECT_EQ(failed, crashed);
+    EXPECT_EQ(result.replications, finished);
+    EXPECT_DOUBLE_EQ(result.metrics[0].mean, sum / finished);
+}
+
+TEST(FarmTest, TimeoutKillsTheReplication) {
+    Farm farm(100, 4);
+    farm.add_metric("wait", [](Simulation& s) {
+        if (s.get_events() % 2 == 0) while (true) this_thread::sleep_for(chrono::milliseconds(10));
+        return mean_wait(s);
+    }).set_workers(2).set_timeout(0.3);
+    auto result = farm.run(mm1);
+
+    size_t hung = 0;
+    for (size_t r = 0; r < 4; ++r) hung += replication(r, 100)->get_events() % 2 == 0;
+    ASSERT_GT(hung, 0u);
+    EXPECT_EQ(result.failures.size(), hung);
+    EXPECT_EQ(result.replications, 4 - hung);
+    for (auto& failure : result.failures) EXPECT_NE(failure.reason.find("timed out"), string::npos) << failure.reason;
+}
+
+TEST(FarmTest, RejectsFarmWithoutMetrics) {
+    Farm farm(100, 2);
+    EXPECT_THROW(farm.run(mm1), invalid_argument);
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "sim_builder/builder.h"
+#include "gpcc/stats.h"
+
+using namespace std;
+
+static RandomGenerator exp_gen(unsigned seed, double rate) {
+    return RandomGenerator(minstd_rand(seed), make_unique<exponential_distribution_wrapper>(rate));
+}
+
+enum Mode {DISCRETE, BINOMIAL, FLUID};
+
+struct Link {
+    double m, full, backlog;
+};
+
+// 100 of 112 places held by traffic of rate 1000 and holding 0.1 (the README case), in transactions or as a flow
+static Link link(Mode mode, uint64_t replication, double end_time = 100) {
+    const double rate = 1000, holding = 0.1;
+    SimBuilder b(end_time);
+    b.set_streams(replication);
+    b.add_storage("link", 112);
+    if (mode == DISCRETE) {
+        b.add_generate(exp_gen(1, rate), 0, "arrivals")
+         .add_queue("backlog").add_enter("link").add_depart("backlog")
+         .add_advance(exp_gen(2, 1 / holding), "holding")
+         .add_leave("link").add_terminate();
+    } else b.add_flow("link", rate, holding, FlowOptions{holding / 5, mode == FLUID, "backlog", "flow"});
+    auto sim = b.build();
+    sim->run_until(end_time);
+    auto s = sim->get_storage_stats(0);
+    return {s.m, s.full, sim->get_q_stats(sim->get_q_index("backlog")).m};
+}
+
+// half-width of the 99% CI of the difference of two means over independent replications
+static double half_width(const vector<double>& a, const vector<double>& b) {
+    auto var = [](const vector<double>& x) {
+        double mean = 0, sq = 0;
+        for (double v : x) mean += v / x.size();
+        for (double v : x) sq += (v - mean) * (v - mean);
+        return sq / (x.size() - 1) / x.size();
+    };
+    return t_quantile(0.995, a.size() + b.size() - 2) * sqrt(var(a) + var(b));
+}
+
+static double mean(const vector<double>& x) {
+    double sum = 0;
+    for (double v : x) sum += v;
+    return sum / x.size();
+}
+
+TEST(FlowTest, AgreesWithDiscreteTransactions) {
+    const size_t replications = 8;
+    vector<double> m[3], full[3], backlog[3];
+    for (Mode mode : {DISCRETE, BINOMIAL, FLUID}) {
+        for (uint64_t r = 1; r <= replications; ++r) {
+            auto l = link(mode, r);
+            m[mode].push_back(l.m);
+            full[mode].push_back(l.full);
+            backlog[mode].push_back(l.backlog);
+        }
+    }
+    EXPECT_NEAR(mean(m[DISCRETE]), 100, 1);
+    EXPECT_GT(mean(full[DISCRETE]), 0.01); // the capacity matters
+    EXPECT_NEAR(mean(m[BINOMIAL]), mean(m[DISCRETE]), half_width(m[BINOMIAL], m[DISCRETE]));
+    EXPECT_NEAR(mean(full[BINOMIAL]), mean(full[DISCRETE]), half_width(full[BINOMIAL], full[DISCRETE]));
+    EXPECT_NEAR(mean(backlog[BINOMIAL]), mean(backlog[DISCRETE]), half_width(backlog[BINOMIAL], backlog[DISCRETE]));
+    // the fluid flow keeps the mean only: without variation it never fills the link
+    EXPECT_NEAR(mean(m[FLUID]), mean(m[DISCRETE]), half_width(m[FLUID], m[DISCRETE]));
+    EXPECT_EQ(mean(full[FLUID]), 0);
+}
+
+TEST(FlowTest, WaitingTransactionsGetFreedPlacesFirst) {
+    // a flow with 10 times more traffic than the link carries always has a backlog; a discrete transaction
+    // arriving every 1 must still get in within one step, because the places the flow frees go to it first
+    const double step = 0.1, end_time = 50.05;
+    SimBuilder b(end_time);
+    b.add_storage("link", 10);
+    b.add_flow("link", 100, 1, FlowOptions{step, true, "backlog", "flow"});
+    b.add_generate(Expr(1.0)).add_queue("wait").add_enter("link").add_depart("wait").add_advance(Expr(0.5)).add_leave("link").add_terminate();
+    auto sim = b.build();
+    sim->run_until(end_time);
+    auto chain = sim->get_storage_chain_stats(0);
+    auto wait = sim->get_q_stats(sim->get_q_index("wait"));
+    EXPECT_EQ(chain.entries, 50u);
+    EXPECT_EQ(chain.current, 0u);
+    EXPECT_LE(chain.wait, step + 1e-9);
+    EXPECT_EQ(wait.max, 1u);
+    EXPECT_GT(sim->get_q_stats(sim->get_q_index("backlog")).m, 100);
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "sim_builder/builder.h"
+#include "gpcc/stats.h"
+
+using namespace std;
+
+static RandomGenerator exp_gen(uint64_t seed, double rate) {
+    return RandomGenerator(minstd_rand(seed), make_unique<exponential_distribution_wrapper>(rate));
+}
+
+// M/M/1 with parameters "lambda" and "mu"; mu2 > 0 adds a second exponential station "mu2" behind it
+static unique_ptr<Simulation> tandem(double lambda, double mu, double mu2, double end_time, const string& gradient, uint64_t seed) {
+    SimBuilder b(end_time);
+    b.add_storage("s", 1);
+    b.add_generate(exp_gen(seed, lambda)).add_parameter("lambda")
+     .add_queue("q").add_enter("s").add_depart("q")
+     .add_advance(exp_gen(seed * 48271 + 123456789, mu)).add_parameter("mu")
+     .add_leave("s");
+    if (mu2 > 0) {
+        b.add_storage("s2", 1);
+        b.add_queue("q2").add_enter("s2").add_depart("q2")
+         .add_advance(exp_gen(seed * 16807 + 987654321, mu2)).add_parameter("mu2")
+         .add_leave("s2");
+    }
+    b.add_terminate();
+    if (!gradient.empty()) b.set_gradient(gradient);
+    auto sim = b.build();
+    sim->run_until(end_time);
+    return sim;
+}
+
+// mean and half-width of the 99% CI over replications
+struct Estimate {
+    double mean, half_width;
+};
+
+static Estimate estimate(const vector<double>& x) {
+    double sum = 0, sq = 0;
+    for (double v : x) sum += v;
+    double mean = sum / x.size();
+    for (double v : x) sq += (v - mean) * (v - mean);
+    return {mean, t_quantile(0.995, x.size() - 1) * sqrt(sq / (x.size() - 1) / x.size())};
+}
+
+// M/M/1 with lambda 0.5, mu 1: Lq = lambda^2 / (mu (mu - lambda)), rho = lambda / mu
+TEST(GradientTest, MM1MatchesAnalyticDerivatives) {
+    vector<double> lq_lambda, rho_lambda, lq_mu, rho_mu;
+    for (uint64_t seed = 1; seed <= 10; ++seed) {
+        auto a = tandem(0.5, 1, 0, 1e5, "lambda", seed);
+        lq_lambda.push_back(a->get_q_gradient(0));
+        rho_lambda.push_back(a->get_storage_gradient(0));
+        auto b = tandem(0.5, 1, 0, 1e5, "mu", seed);
+        lq_mu.push_back(b->get_q_gradient(0));
+        rho_mu.push_back(b->get_storage_gradient(0));
+    }
+    auto check = [](const vector<double>& x, double exact) {
+        auto e = estimate(x);
+        EXPECT_NEAR(e.mean, exact, e.half_width);
+        EXPECT_LT(e.half_width, 0.1 * fabs(exact)); // and the CI is tight enough to mean something
+    };
+    check(lq_lambda, 3);     // (2 lambda mu - lambda^2) / (mu (mu - lambda))^2
+    check(rho_lambda, 1);
+    check(lq_mu, -1.5);      // -lambda^2 (2 mu - lambda) / (mu (mu - lambda))^2
+    check(rho_mu, -0.5);
+}
+
+TEST(GradientTest, TandemAgreesWithCommonRandomNumbers) {
+    // d/dmu of both queues of lambda 0.6 -> mu 1 -> mu2 0.8; central differences reuse the seeds
+    const double h = 0.02, end_time = 2e5;
+    vector<double> diff_q, diff_q2;
+    for (uint64_t seed = 1; seed <= 5; ++seed) {
+        auto ipa = tandem(0.6, 1, 0.8, end_time, "mu", seed);
+        auto up = tandem(0.6, 1 + h, 0.8, end_time, "", seed), down = tandem(0.6, 1 - h, 0.8, end_time, "", seed);
+        diff_q.push_back(ipa->get_q_gradient(0) - (up->get_q_stats(0).m - down->get_q_stats(0).m) / (2 * h));
+        diff_q2.push_back(ipa->get_q_gradient(1) - (up->get_q_stats(1).m - down->get_q_stats(1).m) / (2 * h));
+    }
+    for (auto& diff : {diff_q, diff_q2}) {
+        auto e = estimate(diff);
+        EXPECT_LT(fabs(e.mean), max(e.half_width, 0.05));
+    }
+}
+
+TEST(GradientTest, GradientInReport) {
+    auto sim = tandem(0.5, 1, 0, 1e3, "mu", 1);
+    testing::internal::CaptureStdout();
+    sim->report();
+    string report = testing::internal::GetCapturedStdout();
+    EXPECT_NE(report.find("GRADIENT"), string::npos);
+}
+
+TEST(GradientTest, UnknownParameterThrows) {
+    SimBuilder b(10);
+    b.add_generate(exp_gen(1, 1)).add_parameter("lambda").add_terminate();
+    b.set_gradient("mu");
+    EXPECT_THROW(b.build(), runtime_error);
+}
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+static RandomGenerator exp_gen(unsigned seed, double rate) {
+    return RandomGenerator(minstd_rand(seed), make_unique<exponential_distribution_wrapper>(rate));
+}
+
+// the model of test.cpp: two servers with their own streams, and a third stream that takes whichever is free
+static unique_ptr<Simulation> two_servers(bool optimize) {
+    SimBuilder builder(2000);
+    builder.set_graph_optimization(optimize)
+    .add_storage("rab1", 5)
+    .add_storage("rab2", 5)
+
+    .add_generate(exp_gen(1, 5), 1)
+    .add_queue("qrab1").add_enter("rab1").add_depart("qrab1")
+    .add_advance(exp_gen(2, 22))
+    .add_leave("rab1").add_terminate()
+
+    .add_generate(exp_gen(3, 9), 1)
+    .add_queue("qrab2").add_enter("rab2").add_depart("qrab2")
+    .add_advance(exp_gen(4, 19))
+    .add_leave("rab2").add_terminate()
+
+    .add_generate(exp_gen(5, 9), 1)
+    .add_queue("qrab3")
+    .add_gate(LogicNode(builder.is_storage_avail("rab1")) | builder.is_storage_avail("rab2"))
+    .add_transfer_expr("both_avail", LogicNode(builder.is_storage_avail("rab1")) & builder.is_storage_avail("rab2"))
+    .add_transfer_expr("enter_r1", builder.is_storage_avail("rab1"))
+    .add_transfer_imm("enter_r2")
+
+    .add_transfer_prob("enter_r1", 0.5, 8)
+    .add_label("both_avail")
+    .add_transfer_imm("enter_r2")
+
+    .add_enter("rab1").add_label("enter_r1")
+    .add_depart("qrab3")
+    .add_advance(exp_gen(6, 36))
+    .add_leave("rab1").add_terminate()
+
+    .add_enter("rab2").add_label("enter_r2")
+    .add_depart("qrab3")
+    .add_advance(exp_gen(7, 35))
+    .add_leave("rab2").add_terminate();
+    auto sim = builder.build();
+    sim->run_until(2000);
+    return sim;
+}
+
+TEST(GraphTest, OptimizedModelReportsTheSame) {
+    auto plain = two_servers(false), fast = two_servers(true);
+    auto& graph = fast->get_graph_report();
+    EXPECT_GT(graph.bypassed, 0u);
+    EXPECT_GT(graph.fused, 0u);
+    auto& none = plain->get_graph_report();
+    EXPECT_EQ(none.bypassed + none.fused + none.dropped, 0u);
+
+    EXPECT_EQ(plain->get_events(), fast->get_events());
+    ASSERT_EQ(plain->get_q_number(), fast->get_q_number());
+    for (size_t i = 0; i < plain->get_q_number(); ++i) {
+        auto a = plain->get_q_stats(i), b = fast->get_q_stats(i);
+        EXPECT_EQ(a.current, b.current);
+        EXPECT_EQ(a.max, b.max);
+        EXPECT_DOUBLE_EQ(a.m, b.m);
+        EXPECT_DOUBLE_EQ(a.empty, b.empty);
+    }
+    for (size_t i = 0; i < plain->get_storage_number(); ++i) {
+        auto a = plain->get_storage_stats(i), b = fast->get_storage_stats(i);
+        EXPECT_EQ(a.current, b.current);
+        EXPECT_DOUBLE_EQ(a.m, b.m);
+        EXPECT_DOUBLE_EQ(a.full, b.full);
+        auto ca = plain->get_storage_chain_stats(i), cb = fast->get_storage_chain_stats(i);
+        EXPECT_EQ(ca.entries, cb.entries);
+        EXPECT_DOUBLE_EQ(ca.wait, cb.wait);
+    }
+}
+
+TEST(GraphTest, CertainZeroTimeCycleThrows) {
+    SimBuilder b(10);
+    b.add_generate(Expr(1.0)).add_queue("q").add_label("again").add_depart("q").add_transfer_imm("again");
+    try {
+        b.build();
+        FAIL() << "the cycle was accepted";
+    } catch (const runtime_error& e) {
+        EXPECT_NE(string(e.what()).find("zero-time cycle"), string::npos);
+    }
+}
+
+TEST(GraphTest, ConditionalCycleWarns) {
+    SimBuilder b(10);
+    b.add_generate(Expr(1.0)).add_queue("q").add_label("again").add_depart("q").add_transfer_prob("again", 0.5)
+     .add_advance(Expr(1.0)).add_terminate();
+    testing::internal::CaptureStderr();
+    auto sim = b.build();
+    string warning = testing::internal::GetCapturedStderr();
+    EXPECT_NE(warning.find("may loop forever"), string::npos);
+    ASSERT_EQ(sim->get_graph_report().cycles.size(), 1u);
+    EXPECT_NE(sim->get_graph_report().cycles[0].find("TRANSFER(prob)"), string::npos);
+    sim->run_until(10); // and leaves it with probability 1
+}
+
+TEST(GraphTest, ReportListsChanges) {
+    SimBuilder b(10);
+    b.add_storage("s", 1)
+     .add_generate(Expr(1.0)).add_transfer_imm("serve")
+     .add_queue("unused").add_depart("unused").add_terminate()        // nothing leads here
+     .add_queue("q").add_label("serve").add_enter("s").add_depart("q") // one superblock
+     .add_advance(Expr(0.5)).add_leave("s").add_terminate();
+    auto sim = b.build();
+    auto& graph = sim->get_graph_report();
+    EXPECT_EQ(graph.bypassed, 1u);
+    EXPECT_EQ(graph.fused, 1u);
+    EXPECT_EQ(graph.fused_blocks, 3u);
+    // TRANSFER(imm), the three blocks after it, and QUEUE and ENTER inside the superblock. DEPART stays:
+    // a transaction that waits at ENTER resumes there
+    EXPECT_EQ(graph.dropped, 6u);
+    EXPECT_TRUE(graph.cycles.empty());
+    sim->run_until(10);
+    EXPECT_EQ(sim->get_storage_chain_stats(0).entries, 0u);
+    testing::internal::CaptureStdout();
+    sim->report();
+    string report = testing::internal::GetCapturedStdout();
+    EXPECT_NE(report.find("Graph: 1 transfers bypassed, 1 superblocks of 3 blocks, 6 unreachable blocks dropped"), string::npos);
+}
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include <random>
+#include "gpcc/group.h"
+
+using namespace std;
+
+// linear scan over the members, ties to the lower one
+struct Brute {
+    vector<size_t> capacity, content, waiting;
+
+    size_t select(StorageGroup::policy_t policy) const {
+        size_t best = StorageGroup::none;
+        for (size_t m = 0; m < capacity.size(); ++m) {
+            int64_t used = content[m] + waiting[m], spare = int64_t(capacity[m]) - used;
+            switch (policy) {
+                case StorageGroup::FIRST_AVAILABLE: if (content[m] < capacity[m]) return m; break;
+                case StorageGroup::MIN_LOAD: // per place
+                    if (best == StorageGroup::none || used * int64_t(capacity[best]) < int64_t(content[best] + waiting[best]) * int64_t(capacity[m])) best = m;
+                    break;
+                case StorageGroup::MAX_FREE:
+                    if (best == StorageGroup::none || spare > int64_t(capacity[best]) - int64_t(content[best] + waiting[best])) best = m;
+                    break;
+            }
+        }
+        return best;
+    }
+};
+
+static const StorageGroup::policy_t policies[] = {StorageGroup::FIRST_AVAILABLE, StorageGroup::MIN_LOAD, StorageGroup::MAX_FREE};
+
+static void check(size_t n, uint64_t seed, size_t steps) {
+    mt19937_64 gen(seed);
+    Brute brute;
+    vector<size_t> storages(n);
+    for (size_t m = 0; m < n; ++m) {
+        storages[m] = m;
+        brute.capacity.push_back(1 + gen() % 5);
+    }
+    brute.content.resize(n);
+    brute.waiting.assign(n, 0);
+    StorageGroup group(storages, brute.capacity);
+    for (size_t m = 0; m < n; ++m) { // members already in use when the policies are enabled
+        brute.content[m] = gen() % (brute.capacity[m] + 1);
+        group.update(m, brute.content[m], 0);
+    }
+    for (auto policy : policies) group.enable(policy);
+    for (auto policy : policies) ASSERT_EQ(group.select(policy), brute.select(policy)) << "policy " << policy << " after enable";
+
+    for (size_t step = 0; step < steps; ++step) {
+        size_t m = gen() % n;
+        brute.content[m] = gen() % (brute.capacity[m] + 1);
+        brute.waiting[m] = brute.content[m] == brute.capacity[m] ? gen() % 4 : 0; // transactions wait only at full members
+        group.update(m, brute.content[m], brute.waiting[m]);
+        for (auto policy : policies) ASSERT_EQ(group.select(policy), brute.select(policy)) << "policy " << policy << " step " << step;
+    }
+}
+
+TEST(GroupTest, SelectMatchesLinearScan) {
+    for (size_t n = 1; n <= 40; ++n) for (uint64_t seed = 1; seed <= 20; ++seed) check(n, seed, 20 * n);
+    for (size_t n : {64, 65, 200}) check(n, n, 20 * n); // bitmaps of more than one word
+}
+
+TEST(GroupTest, SelectMatchesLinearScanPastOneSummaryWord) {
+    check(5000, 42, 5000); // more than 4096 members: a second summary word
+}
+
+TEST(GroupTest, MinLoadPrefersFreePlacesOverSmallerLoad) {
+    StorageGroup group({0, 1}, {1, 10});
+    group.enable(StorageGroup::MIN_LOAD);
+    group.update(0, 1, 0); // full
+    group.update(1, 2, 0); // 8 free places
+    EXPECT_EQ(group.select(StorageGroup::MIN_LOAD), 1u);
+    group.update(1, 10, 3);
+    group.update(0, 1, 1);
+    EXPECT_EQ(group.select(StorageGroup::MIN_LOAD), 1u); // 13 / 10 against 2 / 1
+}
@@ -0,0 +1,39 @@
+#include <gtest/gtest.h>
+#include "lanes/lanes.h"
+
+using namespace std;
+
+static RandomGenerator exp_gen(double rate) {
+    return RandomGenerator(minstd_rand(1), make_unique<exponential_distribution_wrapper>(rate));
+}
+
+// M/M/1 with load 0.8: Lq = 3.2
+static void mm1(SimBuilder& b) {
+    b.add_storage("server", 1)
+    .add_generate(exp_gen(0.8), 0, "arrivals").add_queue("q").add_enter("server").add_depart("q")
+    .add_advance(exp_gen(1), "service").add_leave("server").add_terminate();
+}
+
+TEST(LanesTest, LaneDoesNotDependOnOtherLanes) {
+    LaneSimulation two(mm1, 2e3, 2), five(mm1, 2e3, 5);
+    two.run();
+    five.run();
+    for (size_t l = 0; l < 2; ++l) EXPECT_EQ(two.get_q_mean(0, l), five.get_q_mean(0, l));
+}
+
+TEST(LanesTest, MeanOverLanesMatchesTheory) {
+    LaneSimulation sim(mm1, 2e4, 16);
+    sim.run();
+    double sum = 0;
+    for (size_t l = 0; l < 16; ++l) sum += sim.get_q_mean(0, l);
+    EXPECT_NEAR(sum / 16, 3.2, 0.3);
+}
+
+TEST(LanesTest, ReportUsesConfidenceLevel) {
+    LaneSimulation sim(mm1, 1e3, 4);
+    EXPECT_THROW(sim.set_confidence(1), runtime_error);
+    sim.set_confidence(0.9).run();
+    testing::internal::CaptureStdout();
+    sim.report();
+    EXPECT_NE(testing::internal::GetCapturedStdout().find("Confidence level: 0.90"), string::npos);
+}
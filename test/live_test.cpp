@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "gpcc/live.h"
+
+using namespace std;
+
+static LiveStats at(double time) {
+    LiveStats stats{};
+    stats.time = time;
+    stats.end_time = 100;
+    return stats;
+}
+
+TEST(LiveTest, ReadsPublication) {
+    string name = "/gpcc_live_test_read";
+    LiveSegment segment(name, 0, {"q"}, {{"s", 2}});
+    segment.publish(at(10), {LiveLevel{3, 5, 1.5, 0.25, 0}, LiveLevel{2, 2, 1.0, 0.5, 0.5}});
+    LiveView view(name);
+    auto snapshot = view.read();
+    EXPECT_FALSE(snapshot.stale);
+    EXPECT_EQ(snapshot.stats.time, 10);
+    ASSERT_EQ(snapshot.levels.size(), 2u);
+    EXPECT_EQ(snapshot.levels[0].max, 5u);
+    EXPECT_EQ(snapshot.levels[1].full, 0.5);
+}
+
+TEST(LiveTest, WriterStuckMidUpdateGivesStaleSnapshot) {
+    string name = "/gpcc_live_test_stale";
+    LiveSegment segment(name, 0, {"q"}, {});
+    segment.publish(at(10), {LiveLevel{1, 1, 0.5, 0.5, 0}});
+    LiveView view(name);
+    EXPECT_FALSE(view.read().stale);
+
+    // a writer that died between making seq odd and even again
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    ASSERT_GE(fd, 0);
+    void* map = mmap(nullptr, sizeof(LiveHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    ASSERT_NE(map, MAP_FAILED);
+    static_cast<LiveHeader*>(map)->seq.fetch_add(1);
+    munmap(map, sizeof(LiveHeader));
+
+    auto snapshot = view.read();
+    EXPECT_TRUE(snapshot.stale);
+    EXPECT_EQ(snapshot.stats.time, 10);
+    ASSERT_EQ(snapshot.levels.size(), 1u);
+    EXPECT_EQ(snapshot.levels[0].mean, 0.5);
+}
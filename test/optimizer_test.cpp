@@ -0,0 +1,33 @@
+#include <gtest/gtest.h>
+#include "experiment/optimizer.h"
+
+using namespace std;
+
+// arrivals of rate 3 to c servers of rate 1; a server costs 4 and a waiting transaction 5 per unit of time.
+// By Erlang C, Lq is 1.53 for 4 servers and 0.35 for 5, so 5 servers (cost 21.8) beat 4 (23.6) and 6 (24.5);
+// fewer than 4 cannot keep up
+static void servers(SimBuilder& b, const Optimizer::point_t& x) {
+    b.add_storage("srv", size_t(x[0]));
+    b.add_generate(RandomGenerator(minstd_rand(1), make_unique<exponential_distribution_wrapper>(3)), 0, "arrivals")
+     .add_queue("q").add_enter("srv").add_depart("q")
+     .add_advance(RandomGenerator(minstd_rand(2), make_unique<exponential_distribution_wrapper>(1)), "service")
+     .add_leave("srv").add_terminate();
+}
+
+static double cost(Simulation& sim, const Optimizer::point_t& x) {
+    return 4 * x[0] + 5 * sim.get_q_stats(0).m;
+}
+
+TEST(OptimizerTest, OcbaAgreesWithExhaustiveSearch) {
+    Optimizer opt(500);
+    opt.add_integer("servers", 1, 8).set_threads(4).set_confidence(0.95);
+    auto grid = opt.exhaustive(servers, cost, 40);
+    auto ocba = opt.optimize(servers, cost);
+    ASSERT_EQ(grid.candidates.size(), 8u);
+    EXPECT_EQ(grid.candidates[grid.best].point[0], 5);
+    EXPECT_EQ(ocba.candidates[ocba.best].point[0], 5);
+    EXPECT_GE(ocba.pcs, 0.95);
+    EXPECT_LT(ocba.events, grid.events);
+    EXPECT_LT(ocba.replications, grid.replications);
+    EXPECT_NEAR(ocba.mean, grid.mean, ocba.half_width + grid.half_width);
+}
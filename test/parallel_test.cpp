@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "parallel/parallel.h"
+
+using namespace std;
+
+static RandomGenerator exp_gen(unsigned seed, double rate) {
+    return RandomGenerator(minstd_rand(seed), make_unique<exponential_distribution_wrapper>(rate));
+}
+
+// the report without the line about graph changes: parallel runs build the graph as written
+static string report_of(function<void()> launch) {
+    testing::internal::CaptureStdout();
+    launch();
+    istringstream in(testing::internal::GetCapturedStdout());
+    string line, res;
+    while (getline(in, line)) if (line.rfind("Graph:", 0) != 0) res += line + '\n';
+    return res;
+}
+
+static string sequential(SimBuilder::recipe_t recipe, double end_time) {
+    SimBuilder b(end_time);
+    recipe(b);
+    auto sim = b.build();
+    return report_of([&]() { sim->launch(); });
+}
+
+static string parallel(SimBuilder::recipe_t recipe, double end_time, size_t threads) {
+    ParallelSimulation p(recipe, end_time, threads);
+    EXPECT_GT(p.processes(), 1u);
+    return report_of([&]() { p.launch(); });
+}
+
+// two stations joined by ADVANCE blocks with a minimal delay, so they can run in different processes
+static void tandem(SimBuilder& b) {
+    b.add_storage("A", 2).add_storage("B", 1)
+    .add_generate(exp_gen(12345, 1.5), 1)
+    .add_queue("qA").add_enter("A").add_depart("qA")
+    .add_advance(exp_gen(777, 1)).add_leave("A")
+    .add_advance(RandomGenerator(minstd_rand(4242), make_unique<uniform_real_distribution_wrapper>(0.5, 1.5)))
+    .add_queue("qB").add_enter("B").add_depart("qB")
+    .add_advance(exp_gen(9999, 2)).add_leave("B").add_terminate();
+}
+
+TEST(ParallelTest, MatchesSequentialRun) {
+    EXPECT_EQ(parallel(tandem, 1e4, 2), sequential(tandem, 1e4));
+}
+
+TEST(ParallelTest, LookaheadIsMinimalCrossingDelay) {
+    ParallelSimulation p(tandem, 1e3, 2);
+    EXPECT_DOUBLE_EQ(p.lookahead(), 0.5);
+}
+
+// the copies start at a label whose branch alone uses the queue qC
+static void split_branch(SimBuilder& b) {
+    tandem(b);
+    b.add_generate(exp_gen(31, 1), 1)
+    .add_advance(RandomGenerator(minstd_rand(57), make_unique<uniform_real_distribution_wrapper>(0.5, 1.5)))
+    .add_split(1, "copy").add_terminate()
+    .add_queue("qC").add_label("copy").add_advance(exp_gen(63, 0.5)).add_depart("qC").add_terminate();
+}
+
+TEST(ParallelTest, SplitCopiesStayWithTheirLabel) {
+    EXPECT_EQ(parallel(split_branch, 1e4, 2), sequential(split_branch, 1e4));
+}
+
+// the copy waits at ASSEMBLE for its parent, which comes after an ADVANCE that could be cut
+static void assembly(SimBuilder& b) {
+    tandem(b);
+    b.add_generate(exp_gen(31, 1), 1).add_split(1, "meet")
+    .add_advance(RandomGenerator(minstd_rand(57), make_unique<uniform_real_distribution_wrapper>(0.5, 1.5)))
+    .add_assemble(2).add_label("meet").add_queue("qC").add_advance(exp_gen(63, 0.5)).add_depart("qC").add_terminate();
+}
+
+TEST(ParallelTest, FamiliesAssembleInOneProcess) {
+    EXPECT_EQ(parallel(assembly, 1e4, 2), sequential(assembly, 1e4));
+}
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+TEST(RateTest, CumulativeRate) {
+    RateTable steps({0, 10, 20}, {1, 5, 0.5}, RateTable::STEPS);
+    EXPECT_DOUBLE_EQ(steps.cumulative(5), 5);
+    EXPECT_DOUBLE_EQ(steps.cumulative(15), 35);
+    EXPECT_DOUBLE_EQ(steps.cumulative(40), 70); // the last rate goes on
+
+    RateTable linear({0, 10}, {0, 10}, RateTable::LINEAR, 20); // up to 10, back to 0 at 20
+    EXPECT_DOUBLE_EQ(linear.cumulative(10), 50);
+    EXPECT_DOUBLE_EQ(linear.cumulative(20), 100);
+    EXPECT_DOUBLE_EQ(linear.cumulative(25), 100 + 12.5); // the next period
+}
+
+TEST(RateTest, GapInvertsCumulativeRate) {
+    RateTable steps({0, 10, 20}, {1, 5, 0.5}, RateTable::STEPS, 30);
+    RateTable linear({0, 7, 9, 17, 19}, {2, 40, 25, 60, 5}, RateTable::LINEAR, 24);
+    for (const RateTable* table : {&steps, &linear}) {
+        for (double now : {0.0, 3.5, 9.99, 10.0, 23.0, 29.0, 71.3}) {
+            for (double e : {1e-3, 0.5, 2.0, 40.0, 300.0}) {
+                double gap = table->gap(now, e);
+                EXPECT_GE(gap, 0);
+                EXPECT_NEAR(table->cumulative(now + gap), table->cumulative(now) + e, 1e-9 * (1 + table->cumulative(now) + e));
+            }
+        }
+    }
+}
+
+TEST(RateTest, ZeroTailEndsArrivals) {
+    RateTable table({0, 10}, {2, 0}, RateTable::STEPS);
+    EXPECT_TRUE(isinf(table.gap(5, 20)));
+    EXPECT_DOUBLE_EQ(table.gap(5, 4), 2);
+}
+
+TEST(RateTest, RejectsBadTables) {
+    EXPECT_THROW(RateTable({}, {}), invalid_argument);
+    EXPECT_THROW(RateTable({1}, {1}), invalid_argument);
+    EXPECT_THROW(RateTable({0, 5, 5}, {1, 1, 1}), invalid_argument);
+    EXPECT_THROW(RateTable({0}, {-1}), invalid_argument);
+    EXPECT_THROW(RateTable({0, 10}, {1, 1}, RateTable::STEPS, 10), invalid_argument);
+    EXPECT_THROW(RateTable({0, 10}, {0, 0}, RateTable::LINEAR, 20), invalid_argument);
+}
+
+// arrivals of replication r by time t: nobody leaves the queue before the end
+static size_t arrivals(uint64_t r, const RateTable& rates, double t) {
+    SimBuilder b(t);
+    b.set_streams(r);
+    b.add_generate(rates, 0, "arrivals").add_queue("q").add_advance(Expr(1e9)).add_depart("q").add_terminate();
+    auto sim = b.build();
+    sim->run_until(t);
+    return sim->get_q_stats(0).current;
+}
+
+TEST(RateTest, ArrivalCountsArePoissonWithTheTableMean) {
+    RateTable rates({0, 10, 20}, {1, 5, 0.5}, RateTable::STEPS, 30);
+    const size_t n = 400;
+    for (double t : {10.0, 20.0, 40.0}) {
+        double sum = 0, sum2 = 0;
+        for (uint64_t r = 0; r < n; ++r) {
+            double k = arrivals(r, rates, t);
+            sum += k;
+            sum2 += k * k;
+        }
+        double mean = sum / n, var = (sum2 - sum * mean) / (n - 1), expected = rates.cumulative(t);
+        EXPECT_NEAR(mean, expected, 4 * sqrt(expected / n)) << "by " << t;
+        EXPECT_NEAR(var / expected, 1, 0.25) << "by " << t; // Poisson: the variance is the mean
+    }
+}
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+static RandomGenerator exp_gen(unsigned seed, double rate) {
+    return RandomGenerator(minstd_rand(seed), make_unique<exponential_distribution_wrapper>(rate));
+}
+
+// M/M/c+M (Erlang-A): mean number waiting
+static double erlang_a_lq(double lambda, double mu, double theta, size_t c) {
+    vector<double> p(1, 1.0);
+    for (size_t n = 1; p.back() > 1e-300; ++n) p.push_back(p.back() * lambda / (n <= c ? n * mu : c * mu + (n - c) * theta));
+    double z = 0, lq = 0;
+    for (size_t n = 0; n < p.size(); ++n) {
+        z += p[n];
+        if (n > c) lq += (n - c) * p[n];
+    }
+    return lq / z;
+}
+
+// lambda 4, mu 1, patience rate 0.5, 3 servers; gate: wait at a reneging GATE instead of in the storage's chain
+static unique_ptr<Simulation> erlang_a(bool gate, double end_time) {
+    SimBuilder b(end_time);
+    b.set_streams(11);
+    b.add_storage("srv", 3);
+    b.add_generate(exp_gen(1, 4), 0, "arrivals");
+    if (gate) b.add_gate(LogicNode(b.is_storage_avail("srv")), Expr(exp_gen(3, 0.5)), "gone", "patience").add_enter("srv");
+    else b.add_enter("srv", Expr(exp_gen(3, 0.5)), "gone", "patience");
+    b.add_advance(exp_gen(2, 1), "service").add_leave("srv").add_terminate();
+    b.add_queue("lost").add_label("gone").add_depart("lost").add_terminate();
+    auto sim = b.build();
+    sim->run_until(end_time);
+    return sim;
+}
+
+TEST(RenegeTest, StorageChainMatchesErlangA) {
+    double lq = erlang_a_lq(4, 1, 0.5, 3), end_time = 5e4;
+    auto sim = erlang_a(false, end_time);
+    auto chain = sim->get_storage_chain_stats(0);
+    EXPECT_NEAR(chain.m, lq, 0.05 * lq);
+    EXPECT_NEAR(chain.reneged / (4 * end_time), 0.5 * lq / 4, 0.05 * 0.5 * lq / 4); // P(abandon) = theta Lq / lambda
+}
+
+TEST(RenegeTest, GateMatchesErlangA) {
+    double lq = erlang_a_lq(4, 1, 0.5, 3), end_time = 5e4;
+    auto sim = erlang_a(true, end_time);
+    auto chain = sim->get_gate_chain_stats(0);
+    EXPECT_NEAR(chain.m, lq, 0.05 * lq);
+    EXPECT_NEAR(chain.reneged / (4 * end_time), 0.5 * lq / 4, 0.05 * 0.5 * lq / 4);
+}
+
+static vector<pair<uint64_t, double>> gone; // (transaction, time) at the renege label
+
+static Simulation::Coroutine record(Simulation::Context ctx) {
+    gone.emplace_back(ctx.transaction_id(), ctx.time());
+    co_return;
+}
+
+// arrivals at 1, 2, ...; one server busy for 10 per transaction. interrupt > 0: an INTERRUPT passes at that time
+static unique_ptr<Simulation> single_server(double patience, double interrupt, double end_time) {
+    gone.clear();
+    SimBuilder b(end_time);
+    b.add_storage("srv", 1);
+    b.add_generate(Expr(1.0)).add_enter("srv", Expr(patience), "gone").add_advance(Expr(10.0)).add_leave("srv").add_terminate();
+    b.add_coroutine(record).add_label("gone").add_terminate();
+    if (interrupt > 0) b.add_generate(Expr(interrupt)).add_interrupt("srv").add_terminate();
+    auto sim = b.build();
+    sim->run_until(end_time);
+    return sim;
+}
+
+TEST(RenegeTest, PatienceRunsOutOnTime) {
+    // 1 is served from 1 to 11; 2..7 give up at 5.5..10.5; 8 gets in at 11, half a unit before its patience ends
+    auto sim = single_server(3.5, 0, 12);
+    auto chain = sim->get_storage_chain_stats(0);
+    EXPECT_EQ(chain.reneged, 6u);
+    EXPECT_EQ(chain.current, 4u); // 9..12
+    ASSERT_EQ(gone.size(), 6u);
+    for (size_t i = 0; i < gone.size(); ++i) EXPECT_DOUBLE_EQ(gone[i].second, i + 5.5);
+}
+
+TEST(RenegeTest, InterruptEmptiesTheChainInOrder) {
+    // 2, 3, 4 and 5 are waiting when the interrupt passes at 5.5
+    auto sim = single_server(100, 5.5, 6);
+    auto chain = sim->get_storage_chain_stats(0);
+    EXPECT_EQ(chain.reneged, 4u);
+    EXPECT_EQ(chain.current, 1u); // 6, which came after it
+    ASSERT_EQ(gone.size(), 4u);
+    for (size_t i = 0; i < gone.size(); ++i) {
+        EXPECT_DOUBLE_EQ(gone[i].second, 5.5);
+        if (i > 0) {
+            EXPECT_LT(gone[i - 1].first, gone[i].first); // in the order they started waiting
+        }
+    }
+}
+
+TEST(RenegeTest, EndlessPatienceChangesNothing) {
+    auto run = [](bool renege) {
+        SimBuilder b(2e3);
+        b.add_storage("srv", 2);
+        b.add_generate(exp_gen(1, 2.2));
+        if (renege) b.add_enter("srv", Expr(numeric_limits<double>::infinity()), "gone");
+        else b.add_enter("srv");
+        b.add_advance(exp_gen(2, 1)).add_leave("srv").add_terminate();
+        b.add_queue("lost").add_label("gone").add_depart("lost").add_terminate();
+        auto sim = b.build();
+        sim->run_until(2e3);
+        return sim;
+    };
+    auto plain = run(false), renege = run(true);
+    EXPECT_EQ(renege->get_storage_stats(0).m, plain->get_storage_stats(0).m);
+    EXPECT_EQ(renege->get_storage_chain_stats(0).m, plain->get_storage_chain_stats(0).m);
+    EXPECT_EQ(renege->get_storage_chain_stats(0).reneged, 0u);
+}
+
+TEST(RenegeTest, CheckpointKeepsPendingTimers) {
+    auto sim = erlang_a(false, 1e3);
+    auto image = sim->image(); // taken at 1e3 with timers pending
+    sim->run_until(2e3);
+    auto first = sim->get_storage_chain_stats(0);
+    sim->restore_image(image);
+    sim->run_until(2e3);
+    auto second = sim->get_storage_chain_stats(0);
+    EXPECT_EQ(second.m, first.m);
+    EXPECT_EQ(second.reneged, first.reneged);
+    EXPECT_EQ(second.entries, first.entries);
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+static RandomGenerator exp_gen(unsigned seed, double rate) {
+    return RandomGenerator(minstd_rand(seed), make_unique<exponential_distribution_wrapper>(rate));
+}
+
+static unique_ptr<Simulation> mm2(double end_time) {
+    SimBuilder b(end_time);
+    b.add_storage("srv", 2)
+    .add_generate(exp_gen(1, 1.5)).add_queue("q").add_enter("srv").add_depart("q")
+    .add_advance(exp_gen(2, 1)).add_leave("srv").add_terminate();
+    return b.build();
+}
+
+static string report_of(function<void()> print) {
+    testing::internal::CaptureStdout();
+    print();
+    return testing::internal::GetCapturedStdout();
+}
+
+TEST(RunTest, PiecewiseRunMatchesLaunch) {
+    auto whole = mm2(1e4);
+    string expected = report_of([&]() { whole->launch(); });
+
+    auto pieces = mm2(1e4);
+    pieces->run_until(2500);
+    EXPECT_EQ(pieces->get_time(), 2500);
+    auto early = pieces->get_q_stats(0); // queries do not finish anything
+    EXPECT_GT(early.m, 0);
+    EXPECT_EQ(pieces->step(100), 100u);
+    pieces->run_until(7000);
+    pieces->get_storage_stats(0);
+    pieces->run_until(1e4);
+    EXPECT_EQ(pieces->get_events(), whole->get_events());
+    EXPECT_EQ(report_of([&]() { pieces->report(); }), expected);
+}
+
+TEST(RunTest, StepCountsEvents) {
+    auto sim = mm2(1e4);
+    uint64_t before = sim->get_events();
+    EXPECT_EQ(sim->step(250), 250u);
+    EXPECT_EQ(sim->get_events(), before + 250);
+    EXPECT_THROW(sim->run_until(sim->get_time() / 2), SimulationException);
+}
+
+TEST(RunTest, PauseWhileIdleIsDropped) {
+    auto sim = mm2(1e4);
+    sim->pause();
+    sim->run_until(100);
+    EXPECT_EQ(sim->get_time(), 100);
+    EXPECT_GT(sim->get_events(), 0u);
+    sim->pause();
+    EXPECT_EQ(sim->step(5), 5u);
+}
+
+TEST(RunTest, PauseFromAnotherThreadStopsAndResumes) {
+    auto whole = mm2(5e5);
+    whole->run_until(5e5);
+
+    auto sim = mm2(5e5);
+    thread runner([&]() { sim->run_until(5e5); });
+    this_thread::sleep_for(chrono::milliseconds(20));
+    sim->pause();
+    runner.join();
+    EXPECT_LT(sim->get_time(), 5e5); // the run is long enough to still be going after 20 ms
+    sim->run_until(5e5);
+    EXPECT_EQ(sim->get_events(), whole->get_events());
+    EXPECT_EQ(sim->get_q_stats(0).max, whole->get_q_stats(0).max);
+    EXPECT_NEAR(sim->get_q_stats(0).m, whole->get_q_stats(0).m, 1e-9);
+}
@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+#include "experiment/splitting.h"
+
+using namespace std;
+
+// M/M/1 with load 0.5
+static void mm1(SimBuilder& b) {
+    b.add_storage("s", 1)
+    .add_generate(RandomGenerator(minstd_rand(1), make_unique<exponential_distribution_wrapper>(0.5)))
+    .add_queue("q").add_enter("s").add_depart("q")
+    .add_advance(RandomGenerator(minstd_rand(2), make_unique<exponential_distribution_wrapper>(1)))
+    .add_leave("s").add_terminate();
+}
+
+static Simulation::Expr queue_length(SimBuilder& b) { return b.q_length("q"); }
+
+TEST(SplittingTest, AgreesWithCrudeRuns) {
+    // P(the queue reaches 8 within 100): about 0.04, small enough to split, large enough for crude runs
+    Splitting split(100, {2, 4, 6, 8}, 1000);
+    split.set_repetitions(10).set_confidence(0.99).set_seed(3);
+    auto estimate = split.estimate(mm1, queue_length);
+    auto crude = split.crude(mm1, queue_length, 10000);
+    ASSERT_GT(crude.p, 0);
+    EXPECT_NEAR(estimate.p, crude.p, estimate.half_width + crude.half_width);
+    ASSERT_EQ(estimate.stages.size(), 4u);
+    double product = 1;
+    for (double s : estimate.stages) {
+        EXPECT_GT(s, 0);
+        EXPECT_LE(s, 1);
+        product *= s;
+    }
+    EXPECT_NEAR(product, estimate.p, estimate.p); // the same order: the mean of products is not the product of means
+}
+
+TEST(SplittingTest, ThreadsDoNotChangeTheEstimate) {
+    Splitting split(50, {3, 5}, 100);
+    split.set_repetitions(4).set_seed(1);
+    double one = split.set_threads(1).estimate(mm1, queue_length).p;
+    EXPECT_EQ(split.set_threads(4).estimate(mm1, queue_length).p, one);
+    EXPECT_NE(split.set_seed(2).estimate(mm1, queue_length).p, one);
+}
+
+TEST(SplittingTest, RejectsBadLevels) {
+    EXPECT_THROW(Splitting(100, {}, 10), invalid_argument);
+    EXPECT_THROW(Splitting(100, {4, 2}, 10), invalid_argument);
+    EXPECT_THROW(Splitting(100, {4}, 0), invalid_argument);
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "sim_builder/builder.h"
+#include "gpcc/stats.h"
+
+using namespace std;
+
+TEST(StatsTest, TQuantileMatchesTables) {
+    struct Row {
+        double p;
+        size_t df;
+        double t;
+    };
+    for (auto [p, df, t] : {Row{0.975, 1, 12.7062}, Row{0.975, 2, 4.3027}, Row{0.975, 3, 3.1824}, Row{0.975, 5, 2.5706},
+                            Row{0.975, 10, 2.2281}, Row{0.975, 30, 2.0423}, Row{0.995, 5, 4.0321}, Row{0.995, 30, 2.7500},
+                            Row{0.95, 20, 1.7247}, Row{0.9995, 63, 3.4573}}) {
+        EXPECT_NEAR(t_quantile(p, df), t, 2e-3 * t) << "p " << p << " df " << df;
+        EXPECT_NEAR(t_quantile(1 - p, df), -t, 2e-3 * t);
+    }
+    EXPECT_NEAR(t_quantile(0.975, 100000), 1.95996, 1e-4); // normal
+    EXPECT_EQ(t_quantile(0.975, 0), numeric_limits<double>::infinity());
+}
+
+TEST(StatsTest, BatchMeansCollapse) {
+    BatchMeans bm(1);
+    double integral = 0;
+    for (int i = 0; i < 63; ++i) {
+        EXPECT_TRUE(bm.add(i, 1));
+        integral += i;
+    }
+    EXPECT_EQ(bm.batches(), 63u);
+    EXPECT_DOUBLE_EQ(bm.mean(), integral / 63);
+    bm.add(63, 1); // the 64th batch: pairs merge and the batch length doubles
+    integral += 63;
+    EXPECT_EQ(bm.batches(), 32u);
+    EXPECT_DOUBLE_EQ(bm.mean(), integral / 64);
+    EXPECT_FALSE(bm.add(5, 1.5)); // 1.5 of the next batch of 2
+    EXPECT_TRUE(bm.add(7, 0.5));
+    EXPECT_EQ(bm.batches(), 33u);
+    EXPECT_DOUBLE_EQ(bm.mean(), (integral + 1.5 * 5 + 0.5 * 7) / 66);
+}
+
+TEST(StatsTest, BatchMeansSplitLongIntervals) {
+    // a value held over several batches fills them all; the time average does not depend on how it is cut
+    BatchMeans a(1), b(1);
+    a.add(2, 10.25);
+    a.add(6, 29.75);
+    for (int i = 0; i < 10; ++i) b.add(2, 1);
+    b.add(2, 0.25);
+    b.add(6, 0.75);
+    for (int i = 0; i < 29; ++i) b.add(6, 1);
+    EXPECT_EQ(a.batches(), 40u);
+    EXPECT_EQ(b.batches(), 40u);
+    EXPECT_DOUBLE_EQ(a.mean(), (2 * 10.25 + 6 * 29.75) / 40);
+    EXPECT_DOUBLE_EQ(a.mean(), b.mean());
+    EXPECT_DOUBLE_EQ(a.half_width(0.95), b.half_width(0.95));
+}
+
+TEST(StatsTest, BatchMeansHalfWidth) {
+    BatchMeans bm(1);
+    for (size_t i = 0; i + 1 < BatchMeans::min_batches; ++i) bm.add(i % 2, 1);
+    EXPECT_EQ(bm.half_width(0.95), numeric_limits<double>::infinity());
+    bm.add(1, 1);
+    // 20 batches alternating 0 and 1: s^2 = 20 / 4 / 19
+    EXPECT_DOUBLE_EQ(bm.half_width(0.95), t_quantile(0.975, 19) * sqrt(5.0 / 19 / 20));
+    bm.reset(2);
+    EXPECT_EQ(bm.batches(), 0u);
+    EXPECT_EQ(bm.mean(), 0);
+}
+
+// mean queue length of M/M/1 with lambda 0.5, mu 1 (Lq = 0.5) over independent replications
+TEST(StatsTest, QueueLengthIntervalCovers) {
+    const size_t replications = 100;
+    const double end_time = 1e4;
+    size_t covered = 0;
+    for (uint64_t r = 1; r <= replications; ++r) {
+        SimBuilder b(end_time);
+        b.set_streams(r).add_storage("srv", 1)
+         .add_generate(RandomGenerator(minstd_rand(1), make_unique<exponential_distribution_wrapper>(0.5)), 0, "arrivals")
+         .add_queue("q").add_enter("srv").add_depart("q")
+         .add_advance(RandomGenerator(minstd_rand(2), make_unique<exponential_distribution_wrapper>(1)), "service")
+         .add_leave("srv").add_terminate();
+        auto sim = b.build();
+        sim->run_until(end_time);
+        auto q = sim->get_q_stats(0);
+        if (fabs(q.m - 0.5) <= q.m_hw) ++covered;
+    }
+    // nominal 95%; batch means of a correlated series cover a little less
+    EXPECT_GE(covered, 85u);
+}
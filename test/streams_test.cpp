@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+static RandomGenerator exp_gen(double rate) {
+    return RandomGenerator(minstd_rand(1), make_unique<exponential_distribution_wrapper>(rate));
+}
+
+// M/M/1 on named streams (empty names: default ones); extra: a second, unrelated path added before it
+static double mm1_mean(uint64_t replication, bool extra, const string& arrivals = "arrivals", const string& service = "service") {
+    SimBuilder b(1e4);
+    b.set_streams(replication);
+    b.add_storage("server", 1);
+    bool named = !arrivals.empty();
+    if (extra) b.add_generate(exp_gen(0.5), 0, named ? "other" : "").add_advance(exp_gen(1), named ? "other hold" : "").add_terminate();
+    b.add_generate(exp_gen(0.8), 0, arrivals).add_queue("q").add_enter("server").add_depart("q")
+     .add_advance(exp_gen(1), service).add_leave("server").add_terminate();
+    auto sim = b.build();
+    sim->run_until(1e4);
+    return sim->get_q_stats(sim->get_q_index("q")).m;
+}
+
+TEST(StreamsTest, SameReplicationSameNumbers) {
+    EXPECT_EQ(mm1_mean(3, false), mm1_mean(3, false));
+}
+
+TEST(StreamsTest, ReplicationsAreIndependent) {
+    EXPECT_NE(mm1_mean(3, false), mm1_mean(4, false));
+}
+
+TEST(StreamsTest, NamedStreamsIgnoreOtherBlocks) {
+    // the other path only splits the time integrals into more terms
+    EXPECT_NEAR(mm1_mean(3, false), mm1_mean(3, true), 1e-9);
+}
+
+TEST(StreamsTest, UnnamedStreamsShiftWithInsertedBlocks) {
+    EXPECT_GT(abs(mm1_mean(3, false, "", "") - mm1_mean(3, true, "", "")), 1e-3);
+}
+
+TEST(StreamsTest, StreamNameUsedTwiceThrows) {
+    SimBuilder b(10);
+    b.set_streams(1);
+    b.add_generate(exp_gen(1), 0, "s");
+    EXPECT_THROW(b.add_advance(exp_gen(1), "s"), runtime_error);
+}
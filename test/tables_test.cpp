@@ -0,0 +1,32 @@
+#include <gtest/gtest.h>
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+// arrivals every time unit, each spends 2.5 in the system
+static unique_ptr<Simulation> deterministic(double reset) {
+    SimBuilder b(100.5);
+    if (reset > 0) b.set_reset_time(reset);
+    b.add_table("m1", Histogram(Histogram::LINEAR, 0, 0.5, 16));
+    b.add_generate(Expr(1.0)).add_queue("q").add_advance(Expr(2.5)).add_depart("q").add_tabulate("m1").add_terminate();
+    auto sim = b.build();
+    sim->run_until(100.5);
+    return sim;
+}
+
+TEST(TablesTest, TabulateRecordsTimeInSystem) {
+    auto sim = deterministic(0);
+    const Histogram& m1 = sim->get_table(sim->get_table_index("m1"));
+    EXPECT_EQ(uint64_t(m1.weight()), 98u); // arrivals at 1..98 have left by 100.5
+    EXPECT_DOUBLE_EQ(m1.mean(), 2.5);
+    EXPECT_DOUBLE_EQ(m1.max(), 2.5);
+}
+
+TEST(TablesTest, ResetDiscardsEarlierStatistics) {
+    auto sim = deterministic(50.25);
+    const Histogram& m1 = sim->get_table(sim->get_table_index("m1"));
+    EXPECT_EQ(uint64_t(m1.weight()), 51u); // departures at 50.5..100.5
+    auto q = sim->get_q_stats(sim->get_q_index("q"));
+    EXPECT_NEAR(q.m, 2.5, 0.02); // 2 or 3 in the queue, 3 half of the time
+    EXPECT_EQ(q.max, 3u);
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include <ctime>
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+// station i: a machine with i + 1 places busy for i + 1 per transaction, and its queue
+static SimBuilder::Template station() {
+    SimBuilder::Template t;
+    t.add_storage("m", [](size_t i) { return i + 1; }).add_queue("w").add_enter("m").add_depart("w")
+     .add_advance([](size_t i) { return Expr(double(i + 1)); }).add_leave("m");
+    return t;
+}
+
+TEST(TemplateTest, InstancesAreNamedAndChained) {
+    // arrivals every 10 pass the stations one after another without waiting: 1 + 2 + 3 < 10
+    SimBuilder b(1000);
+    b.add_generate(Expr(10.0)).add_instances(station(), 3).add_terminate();
+    auto sim = b.build();
+    sim->run_until(1000);
+    ASSERT_EQ(sim->get_storage_number(), 3u);
+    ASSERT_EQ(sim->get_q_number(), 3u);
+    for (size_t i = 0; i < 3; ++i) {
+        string n = to_string(i);
+        size_t m = sim->get_storage_index("m[" + n + "]"), w = sim->get_q_index("w[" + n + "]");
+        auto s = sim->get_storage_stats(m);
+        EXPECT_EQ(s.capacity, i + 1);
+        // 99 transactions, each held for i + 1 from 10 k + 1 + 2 + ... + i
+        EXPECT_DOUBLE_EQ(s.m, 99.0 * (i + 1) / 1000);
+        EXPECT_EQ(s.max, 1u);
+        EXPECT_EQ(sim->get_q_stats(w).current, 0u);
+        EXPECT_EQ(sim->get_storage_chain_stats(m).entries, 0u);
+    }
+    EXPECT_EQ(sim->get_storage_stats(0).current, 1u); // the arrival at 1000 is at the first station
+
+    testing::internal::CaptureStdout();
+    sim->report();
+    string report = testing::internal::GetCapturedStdout();
+    for (string name : {"\tm[0]\t", "\tm[2]\t", "\tw[1]\t"}) EXPECT_NE(report.find(name), string::npos) << name;
+}
+
+TEST(TemplateTest, NumberingStartsAtFirst) {
+    SimBuilder b(100);
+    b.add_storage("exit", 1);
+    b.add_generate(Expr(10.0)).add_instances(station(), 2, 5).add_enter("exit").add_advance(Expr(1.0)).add_leave("exit").add_terminate();
+    auto sim = b.build();
+    sim->run_until(100);
+    EXPECT_THROW(sim->get_storage_index("m[0]"), exception);
+    EXPECT_EQ(sim->get_storage_stats(sim->get_storage_index("m[6]")).capacity, 7u);
+    EXPECT_GT(sim->get_storage_stats(sim->get_storage_index("exit")).m, 0); // the chain leads on to the builder's blocks
+}
+
+TEST(TemplateTest, MillionBlocksBuildQuickly) {
+    // 200000 stations of 5 blocks; measured at 0.34 s to add and 0.34 s to build. Processor time of this process,
+    // so that tests running alongside do not count; the bound leaves room for a slower machine
+    clock_t start = clock();
+    SimBuilder b(100);
+    SimBuilder::Template t;
+    t.add_storage("s", 2).add_queue("q").add_enter("s").add_depart("q")
+     .add_advance(RandomGenerator(minstd_rand(2), make_unique<exponential_distribution_wrapper>(2))).add_leave("s");
+    b.add_generate(RandomGenerator(minstd_rand(1), make_unique<exponential_distribution_wrapper>(1)));
+    b.add_instances(t, 200000).add_terminate();
+    auto sim = b.build();
+    double seconds = double(clock() - start) / CLOCKS_PER_SEC;
+    RecordProperty("build_seconds", to_string(seconds));
+    EXPECT_LT(seconds, 3);
+    EXPECT_EQ(sim->get_storage_number(), 200000u);
+    EXPECT_EQ(sim->get_q_index("q[199999]"), 199999u);
+    EXPECT_EQ(sim->step(5), 5u);
+}
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <cstdio>
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+// a trace file in the test's temporary directory, removed with the object
+struct TraceFile {
+    string path;
+
+    TraceFile(const string& name, const string& content): path(testing::TempDir() + name) {
+        ofstream(path, ios::binary) << content;
+    }
+    ~TraceFile() { remove(path.c_str()); }
+};
+
+static vector<double> intervals(TraceReader& reader, size_t n, vector<uint64_t>* priorities = nullptr) {
+    vector<double> res;
+    double interval;
+    uint64_t priority = 0;
+    while (res.size() < n && reader.next(interval, priority)) {
+        res.push_back(interval);
+        if (priorities != nullptr) priorities->push_back(priority);
+    }
+    return res;
+}
+
+TEST(TraceTest, CsvTimestampsWithHeaderAfterComments) {
+    TraceFile file("trace_header.csv", "# exported by a logger\n\n# second comment\ntime,priority\n1.0\n 2.5 , 3\n\n4\n");
+    TraceReader reader(file.path, {});
+    vector<uint64_t> priorities;
+    EXPECT_EQ(intervals(reader, 10, &priorities), (vector<double>{1, 1.5, 1.5}));
+    EXPECT_EQ(priorities, (vector<uint64_t>{0, 3, 3})); // next() leaves priority alone for a record without one
+}
+
+TEST(TraceTest, ScaleAndOrigin) {
+    TraceFile file("trace_scale.csv", "10\n11\n13\n");
+    TraceOptions options;
+    options.scale = 60; // minutes of trace time
+    options.origin = 9;
+    TraceReader reader(file.path, options);
+    EXPECT_EQ(intervals(reader, 10), (vector<double>{60, 60, 120}));
+}
+
+TEST(TraceTest, IntervalsLoop) {
+    TraceFile file("trace_loop.csv", "x\n1\n2\n");
+    TraceOptions options;
+    options.values = TraceOptions::INTERVALS;
+    TraceReader once(file.path, options);
+    EXPECT_EQ(intervals(once, 10), (vector<double>{1, 2}));
+    options.loop = true;
+    TraceReader looped(file.path, options);
+    EXPECT_EQ(intervals(looped, 5), (vector<double>{1, 2, 1, 2, 1}));
+}
+
+TEST(TraceTest, BinaryWithPriorities) {
+    string content;
+    auto put = [&content](auto value) { content.append(reinterpret_cast<const char*>(&value), sizeof(value)); };
+    put(0.5); put(uint64_t(2));
+    put(1.5); put(uint64_t(7));
+    TraceFile file("trace.bin", content);
+    TraceOptions options;
+    options.format = TraceOptions::BINARY;
+    options.with_priority = true;
+    TraceReader reader(file.path, options);
+    vector<uint64_t> priorities;
+    EXPECT_EQ(intervals(reader, 10, &priorities), (vector<double>{0.5, 1}));
+    EXPECT_EQ(priorities, (vector<uint64_t>{2, 7}));
+
+    options.with_priority = false;
+    TraceFile partial("trace_partial.bin", content.substr(0, 12));
+    EXPECT_THROW(TraceReader(partial.path, options), runtime_error);
+}
+
+TEST(TraceTest, BadTracesThrow) {
+    TraceFile empty("trace_empty.csv", "");
+    EXPECT_THROW(TraceReader(empty.path, {}), runtime_error);
+    TraceFile comments("trace_comments.csv", "# nothing\n\n");
+    EXPECT_THROW(TraceReader(comments.path, {}), runtime_error);
+
+    double interval;
+    uint64_t priority;
+    TraceFile late_header("trace_late_header.csv", "1\ntime\n2\n");
+    TraceReader late(late_header.path, {});
+    EXPECT_TRUE(late.next(interval, priority));
+    EXPECT_THROW(late.next(interval, priority), runtime_error);
+
+    TraceFile back("trace_back.csv", "5\n4\n");
+    TraceReader backwards(back.path, {});
+    EXPECT_TRUE(backwards.next(interval, priority));
+    EXPECT_THROW(backwards.next(interval, priority), runtime_error);
+}
+
+TEST(TraceTest, SaveAndLoadContinueTheTrace) {
+    TraceFile file("trace_state.csv", "h\n1\n2\n4\n8\n");
+    TraceReader reader(file.path, {});
+    intervals(reader, 2);
+    StateWriter out;
+    reader.save(out);
+    auto rest = intervals(reader, 10);
+
+    TraceReader copy(file.path, {});
+    StateReader in(out.bytes());
+    copy.load(in);
+    EXPECT_EQ(intervals(copy, 10), rest);
+    EXPECT_EQ(rest, (vector<double>{2, 4}));
+}
+
+TEST(TraceTest, GenerateReplaysArrivals) {
+    TraceFile file("trace_model.csv", "time\n1\n2.5\n4\n");
+    SimBuilder b(10);
+    b.add_generate_trace(file.path).add_queue("q").add_advance(Expr(100.0)).add_depart("q").add_terminate();
+    auto sim = b.build();
+    sim->run_until(3);
+    EXPECT_EQ(sim->get_q_stats(0).current, 2u);
+    sim->run_until(10);
+    EXPECT_EQ(sim->get_q_stats(0).current, 3u); // no loop: the GENERATE stops
+}
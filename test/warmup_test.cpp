@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <sstream>
+#include "sim_builder/builder.h"
+
+using namespace std;
+
+static RandomGenerator exp_gen(unsigned seed, double rate) {
+    return RandomGenerator(minstd_rand(seed), make_unique<exponential_distribution_wrapper>(rate));
+}
+
+// M/M/1 with lambda 0.5 and mu 1 (Lq = 0.5); burst > 0: arrivals come 40 times faster until then, which leaves
+// about 20 * burst transactions waiting, drained at 0.5 per unit of time
+static unique_ptr<SimBuilder> mm1(double end_time, double burst = 0) {
+    auto b = make_unique<SimBuilder>(end_time);
+    b->set_streams(7).add_storage("srv", 1);
+    if (burst > 0) b->add_generate(RateTable({0, burst}, {20, 0.5}));
+    else b->add_generate(exp_gen(1, 0.5));
+    b->add_queue("q").add_enter("srv").add_depart("q").add_advance(exp_gen(2, 1), "service").add_leave("srv").add_terminate();
+    return b;
+}
+
+static double reset_at(Simulation& sim) {
+    testing::internal::CaptureStdout();
+    sim.report();
+    string report = testing::internal::GetCapturedStdout();
+    string tag = "Statistics reset at ";
+    size_t at = report.find(tag);
+    return at == string::npos ? 0 : stod(report.substr(at + tag.size()));
+}
+
+TEST(WarmupTest, MserTruncatesInitialBacklog) {
+    const double end_time = 5e4;
+    auto biased = mm1(end_time, 10)->build();
+    biased->run_until(end_time);
+    auto b = mm1(end_time, 10);
+    b->set_warmup_detection(5);
+    auto sim = b->build();
+    sim->run_until(end_time);
+
+    double start = reset_at(*sim);
+    EXPECT_GT(start, 300);              // about 190 waiting at 10 take about 380 to drain
+    EXPECT_LT(start, 0.1 * end_time);   // and the rest of the run is kept
+    auto q = sim->get_q_stats(0);
+    EXPECT_NEAR(q.m, 0.5, max(2 * q.m_hw, 0.05));
+    EXPECT_GT(biased->get_q_stats(0).m, 1); // the backlog without the deletion
+    EXPECT_EQ(reset_at(*biased), 0);
+}
+
+TEST(WarmupTest, StopsAtTargetPrecision) {
+    const double end_time = 1e7, precision = 0.05;
+    auto b = mm1(end_time);
+    b->add_stop_rule_queue("q", precision);
+    auto sim = b->build();
+    sim->run_until(end_time);
+    EXPECT_TRUE(sim->is_stopped());
+    EXPECT_LT(sim->get_time(), end_time / 10);
+    auto q = sim->get_q_stats(0);
+    EXPECT_LE(q.m_hw, precision * q.m);
+    EXPECT_NEAR(q.m, 0.5, 2 * q.m_hw);
+
+    auto tighter = mm1(end_time);
+    tighter->add_stop_rule_queue("q", precision / 2);
+    auto longer = tighter->build();
+    longer->run_until(end_time);
+    EXPECT_TRUE(longer->is_stopped());
+    EXPECT_GT(longer->get_time(), 2 * sim->get_time()); // the half-width shrinks as 1 / sqrt(time)
+}
+
+TEST(WarmupTest, EndTimeLimitsStoppingRule) {
+    auto b = mm1(100);
+    b->add_stop_rule_queue("q", 1e-4);
+    auto sim = b->build();
+    sim->run_until(100);
+    EXPECT_FALSE(sim->is_stopped());
+    EXPECT_EQ(sim->get_time(), 100);
+}
+
+TEST(WarmupTest, ResetDiscardsEarlierStatistics) {
+    // arrivals at 1, 2, ...; one server busy for 2 per transaction, so by t the queue holds
+    // floor(t) - floor((t + 1) / 2): 2 on [5.5; 6), 3 on [6; 8), 4 on [8; 10), 5 on [10; 10.5]
+    SimBuilder b(10.5);
+    b.set_reset_time(5.5);
+    b.add_storage("srv", 1).add_generate(Expr(1.0)).add_queue("q").add_enter("srv").add_depart("q")
+     .add_advance(Expr(2.0)).add_leave("srv").add_terminate();
+    auto sim = b.build();
+    sim->run_until(10.5);
+    auto q = sim->get_q_stats(0);
+    EXPECT_DOUBLE_EQ(q.m, (0.5 * 2 + 2 * 3 + 2 * 4 + 0.5 * 5) / 5);
+    EXPECT_EQ(q.current, 5u);
+    EXPECT_EQ(q.max, 5u);
+    EXPECT_DOUBLE_EQ(q.empty, 0); // the queue was empty before 2 only
+    auto srv = sim->get_storage_stats(0);
+    EXPECT_DOUBLE_EQ(srv.m, 1);
+    EXPECT_EQ(reset_at(*sim), 5.5);
+}
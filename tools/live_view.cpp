@@ -0,0 +1,77 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <signal.h>
+#include "gpcc/live.h"
+
+using namespace std;
+
+// Viewer of the live statistics of a running simulation (SimBuilder::set_live_stats):
+//     live_view /gpcc [refresh seconds] [--once]
+// redraws the table until the run finishes or its process exits
+static void print(const LiveView& view, const LiveView::Snapshot& snapshot, bool clear) {
+    const LiveStats& s = snapshot.stats;
+    if (clear) cout << "\033[H\033[2J";
+    cout << fixed << showpoint << setprecision(4);
+    cout << "pid " << view.pid() << "\ttime " << s.time << " / " << s.end_time << " (" << setprecision(1)
+         << (s.end_time > 0 ? 100 * s.time / s.end_time : 0) << "%)\twall " << s.wall << " s\t"
+         << noshowpoint << setprecision(0) << s.rate << " events/s\t" << s.events << " events" << (s.finished ? "\tfinished" : "") << (snapshot.stale ? "\tstale" : "") << '\n';
+    cout << showpoint << setprecision(4);
+    if (s.stat_start > 0) cout << "Statistics reset at " << s.stat_start << '\n';
+
+    size_t queues = view.queues();
+    if (queues > 0) {
+        cout << "QUEUES:\n\tqueue\t\tCurrent\t\tMax\t\tM\t\tP(0)\n";
+        for (size_t i = 0; i < queues; ++i) {
+            const LiveLevel& l = snapshot.levels[i];
+            cout << '\t' << view.entity(i).name << "\t\t" << l.current << "\t\t" << l.max << "\t\t" << l.mean << "\t\t" << l.empty << '\n';
+        }
+    }
+    if (view.storages() > 0) {
+        cout << "STORAGES:\n\tstorage\t\tCap\t\tCurrent\t\tMax\t\tM\t\tK\t\tP(0)\t\tP(full)\n";
+        for (size_t i = queues; i < queues + view.storages(); ++i) {
+            const LiveLevel& l = snapshot.levels[i];
+            const LiveEntity& e = view.entity(i);
+            cout << '\t' << e.name << "\t\t" << e.capacity << "\t\t" << l.current << "\t\t" << l.max << "\t\t" << l.mean << "\t\t"
+                 << (e.capacity > 0 ? l.mean / e.capacity : 0) << "\t\t" << l.empty << "\t\t" << l.full << '\n';
+        }
+    }
+    cout << flush;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <shared memory name> [refresh seconds] [--once]\n";
+        return 2;
+    }
+    string name = argv[1];
+    double refresh = 1;
+    bool once = false;
+    for (int i = 2; i < argc; ++i) {
+        if (!strcmp(argv[i], "--once")) once = true;
+        else refresh = atof(argv[i]);
+    }
+    if (!(refresh > 0)) refresh = 1;
+
+    try {
+        LiveView view(name);
+        while (true) {
+            LiveView::Snapshot snapshot = view.read();
+            print(view, snapshot, !once);
+            if (once || snapshot.stats.finished) return 0;
+            if (kill(view.pid(), 0) != 0 && errno == ESRCH) {
+                cout << "the simulation exited\n";
+                return 0;
+            }
+            this_thread::sleep_for(chrono::duration<double>(refresh));
+        }
+    }
+    catch (const exception& e) {
+        cerr << e.what() << '\n';
+        return 1;
+    }
+}